@@ -0,0 +1,129 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <vector>
+#include <stdint.h>
+#include <SDL.h>
+#include "cube.hh"
+#include "util.hh"
+#include "threadpool.hh"
+#include "simulation.hh"
+#include "autoplayer.hh"
+
+namespace {
+  // A lost life costs as much as a handful of good pickups
+  const Sint64 LIFE_VALUE = 5000;
+  // Rollouts are checked against the deadline in batches this big
+  const Uint32 ROLLOUT_BATCH = 8;
+
+  Sint64 value(const SimBoard& board)
+  {
+    return static_cast<Sint64>(board.score()) - LIFE_VALUE * board.livesLost();
+  }
+}
+
+AutoPlayer::Tally::Tally()
+  : nodes(0)
+{
+  for (int i = 0; i < 4; ++i) {
+    value[i] = 0;
+    games[i] = 0;
+  }
+}
+
+AutoPlayer::Search::Search(AutoPlayer& player, const SimBoard& board, uint64_t deadline)
+  : m_player(player), m_board(board), m_deadline(deadline)
+{
+}
+
+void AutoPlayer::Search::execute(Uint32 index)
+{
+  Tally& tally = m_player.m_tallies[index];
+  const Sint64 start = value(m_board);
+  SimBoard sim(m_board);
+  util::Random random(m_player.m_seed * (index + 1) + 1);
+
+  do {
+    for (Uint32 n = 0; n < ROLLOUT_BATCH; ++n) {
+      const Uint32 first = (n + index) & 3;
+      const cube::ROLL_DIRECTION dir = static_cast<cube::ROLL_DIRECTION>(first);
+      if (!m_board.canRoll(dir))
+        continue;
+
+      sim = m_board;
+      sim.random().setState(random.next() | 1);
+      sim.roll(dir);
+      for (Uint32 depth = 1; depth < m_player.m_depth && !sim.livesLost(); ++depth) {
+        // random legal move, or wait if there is none
+        const Uint32 r = random.next(4);
+        Uint32 d = 0;
+        while (d < 4 && !sim.canRoll(static_cast<cube::ROLL_DIRECTION>((r + d) & 3)))
+          ++d;
+        if (d < 4)
+          sim.roll(static_cast<cube::ROLL_DIRECTION>((r + d) & 3));
+        else
+          sim.wait();
+      }
+      tally.value[first] += value(sim) - start;
+      ++tally.games[first];
+      tally.nodes += (sim.time() - m_board.time()) / sim.params().move_delay;
+    }
+  } while (util::timeMicros() < m_deadline);
+}
+
+AutoPlayer::AutoPlayer(ThreadPool& pool, Uint32 budget, Uint32 depth)
+  : m_pool(pool), m_budget(budget), m_depth(depth),
+    m_tallies(pool.threads()), m_seed(1), m_nodes(0), m_micros(0)
+{
+}
+
+cube::ROLL_DIRECTION AutoPlayer::think(const SimBoard& board)
+{
+  // Boxed in; any direction is as good as another, and the search
+  // would only spin until its deadline finding no moves to try
+  int first = 0;
+  while (first < 4 && !board.canRoll(static_cast<cube::ROLL_DIRECTION>(first)))
+    ++first;
+  if (first == 4)
+    return static_cast<cube::ROLL_DIRECTION>(0);
+
+  const uint64_t start = util::timeMicros();
+  for (Uint32 i = 0; i < m_tallies.size(); ++i)
+    m_tallies[i] = Tally();
+
+  Search search(*this, board, start + m_budget);
+  m_pool.run(search, m_tallies.size());
+  m_seed = m_seed * 1664525 + 1013904223;
+
+  Tally total;
+  for (Uint32 i = 0; i < m_tallies.size(); ++i) {
+    for (int d = 0; d < 4; ++d) {
+      total.value[d] += m_tallies[i].value[d];
+      total.games[d] += m_tallies[i].games[d];
+    }
+    total.nodes += m_tallies[i].nodes;
+  }
+
+  int best = -1;
+  double best_value = 0;
+  for (int d = 0; d < 4; ++d) {
+    if (!total.games[d])
+      continue;
+    const double average = static_cast<double>(total.value[d]) / total.games[d];
+    if (best < 0 || average > best_value) {
+      best = d;
+      best_value = average;
+    }
+  }
+
+  m_nodes += total.nodes;
+  m_micros += util::timeMicros() - start;
+  return static_cast<cube::ROLL_DIRECTION>(best < 0 ? 0 : best);
+}
+
+double AutoPlayer::nodesPerSecond() const
+{
+  return m_micros ? m_nodes * 1000000.0 / m_micros : 0.0;
+}
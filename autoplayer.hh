@@ -0,0 +1,71 @@
+/*
+ * Computer player. Picks the next move by playing lots of short random
+ * games ahead from the current position on SimBoard clones, spread
+ * over a thread pool, and choosing the first move of the ones that
+ * went best on average.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_AUTOPLAYER_HH
+#define BNB_AUTOPLAYER_HH
+
+#include <vector>
+#include <stdint.h>
+#include <SDL.h>
+#include "cube.hh"
+#include "threadpool.hh"
+
+class SimBoard;
+
+class AutoPlayer {
+public:
+  // 'budget' is how many microseconds think() may spend, 'depth' how
+  // many moves each lookahead game is played out.
+  AutoPlayer(ThreadPool& pool, Uint32 budget = 4000, Uint32 depth = 24);
+
+  // Best move from the position on 'board'
+  cube::ROLL_DIRECTION think(const SimBoard& board);
+
+  // Search statistics, accumulated over all calls to think()
+  uint64_t nodes() const { return m_nodes; }
+  uint64_t microseconds() const { return m_micros; }
+  double nodesPerSecond() const;
+  void resetStats() { m_nodes = 0; m_micros = 0; }
+
+private:
+  AutoPlayer(const AutoPlayer&);
+  AutoPlayer& operator=(const AutoPlayer&);
+
+  // Each thread rolls out games and adds up the results for every
+  // first move in its own slot, so they never share anything.
+  struct Tally {
+    Tally();
+    Sint64 value[4];
+    Uint32 games[4];
+    uint64_t nodes;
+  };
+
+  class Search : public ThreadPool::Job {
+  public:
+    Search(AutoPlayer& player, const SimBoard& board, uint64_t deadline);
+    void execute(Uint32 index);
+  private:
+    Search(const Search&);
+    Search& operator=(const Search&);
+    AutoPlayer& m_player;
+    const SimBoard& m_board;
+    uint64_t m_deadline;
+  };
+
+  ThreadPool& m_pool;
+  Uint32 m_budget;
+  Uint32 m_depth;
+  std::vector<Tally> m_tallies;
+  Uint32 m_seed;
+  uint64_t m_nodes;
+  uint64_t m_micros;
+};
+
+#endif
@@ -5,7 +5,9 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include <cstdlib>
+#include <algorithm>
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include "except.hh"
@@ -16,28 +18,69 @@
 #include "highscorestate.hh"
 #include "textdisplaystate.hh"
 #include "aboutdata.hh"
+#include "options.hh"
+#include "blit.hh"
+#include "textwriter.hh"
+#include "fontmanager.hh"
 #include "bbengine.hh"
 
-BBEngine::BBEngine(int width, int height, int bpp)
-  : m_updateTimer(0), m_screen(0), m_lastUpdate(SDL_GetTicks()), m_currentState(0)
+BBEngine::BBEngine(int width, int height, int bpp, bool fullscreen)
+  : m_display(0), m_screen(0), m_canvas(0), m_composite(0), m_scaler(0),
+    m_transition(), m_display_rects(), m_capture(0),
+    m_lastUpdate(SDL_GetTicks()),
+    m_interval(options().fps ? std::max(1000000 / options().fps, 1u) : FRAME_INTERVAL),
+    m_scheduler(m_interval), m_states(0), m_dirty(WIDTH, HEIGHT)
 {
-  m_screen = SDL_SetVideoMode(width, height, bpp, SDL_SWSURFACE);
-  if (!m_screen)
+  if (!width || !height) {
+    // must be asked before the first SDL_SetVideoMode()
+    const SDL_VideoInfo* info = SDL_GetVideoInfo();
+    if (fullscreen && info && info->current_w > 0) {
+      width = info->current_w;
+      height = info->current_h;
+    } else {
+      width = WIDTH;
+      height = HEIGHT;
+    }
+  }
+  m_display = SDL_SetVideoMode(width, height, bpp,
+                               SDL_SWSURFACE | (fullscreen ? SDL_FULLSCREEN : 0));
+  if (!m_display)
     throw Exception("Unable to set video mode: " + std::string(SDL_GetError()));
 
+  if (m_display->w == WIDTH && m_display->h == HEIGHT) {
+    m_screen = m_display;
+  } else {
+    if (m_display->format->BitsPerPixel != 32)
+      throw Exception("Scaling needs a 32 bits per pixel display");
+    m_canvas = createScreen();
+    m_screen = m_canvas;
+    m_scaler = new Scaler(WIDTH, HEIGHT, m_display->w, m_display->h);
+  }
+  blit::init();
+
+  if (!options().capture_dir.empty())
+    m_capture = new Capture(options().capture_dir, WIDTH, HEIGHT);
+
   if (!TTF_WasInit()) {
     if (TTF_Init() == -1)
       throw Exception("Unable to initialize SDL_ttf: " + std::string(TTF_GetError()));
   }
 
-  m_currentState = new MenuState;
+  m_states = new StateStack(options().state_cache_kb * 1024);
+  m_states->push(GOTO_MENU, new MenuState);
 }
 
 BBEngine::~BBEngine()
 {
-  delete m_currentState;
-  if (m_updateTimer)
-    SDL_RemoveTimer(m_updateTimer);
+  delete m_capture;
+  delete m_states;
+  delete m_scaler;
+  if (m_composite)
+    SDL_FreeSurface(m_composite);
+  if (m_canvas)
+    SDL_FreeSurface(m_canvas);
+  textCache().clear();
+  fonts().clear();
   if (TTF_WasInit())
     TTF_Quit();
 }
@@ -59,118 +102,222 @@ int BBEngine::exec()
   SDL_Delay(120);
   while (SDL_PollEvent(&event));
 
-  // Get the update timer running - this is what drives our regular
-  // updates/redraws.
-  m_updateTimer = SDL_AddTimer(30, updateCallback, 0);
+  // Nothing but the keyboard and the window concerns us; everything
+  // else is dropped before it reaches the queue.
+  const Uint8 ignored[] = { SDL_ACTIVEEVENT, SDL_MOUSEMOTION, SDL_MOUSEBUTTONDOWN,
+                            SDL_MOUSEBUTTONUP, SDL_JOYAXISMOTION, SDL_JOYBALLMOTION,
+                            SDL_JOYHATMOTION, SDL_JOYBUTTONDOWN, SDL_JOYBUTTONUP,
+                            SDL_SYSWMEVENT, SDL_VIDEORESIZE, SDL_USEREVENT };
+  for (Uint32 i = 0; i < sizeof(ignored) / sizeof(ignored[0]); ++i)
+    SDL_EventState(ignored[i], SDL_IGNORE);
 
-  // Check for input or timeout
-  // This is the main event loop that drives everything
+  // This is the main loop that drives everything. Input is handled as
+  // it arrives, in between waiting for the next frame to be due.
   bool quit_it = false;
-  bool paused = false;
-  PlayState* playstate = 0;
+  bool exposed = false;
+  pace();
+  m_scheduler.start();
   while (!quit_it) {
-    if (!SDL_WaitEvent(&event))
-      throw Exception("Error while waiting for SDL events");
-
-    Uint32 now = SDL_GetTicks();
-    enum STATE_CHANGE new_state = NO_CHANGE;
-    switch (event.type) {
-    case SDL_KEYDOWN:
-    case SDL_KEYUP: {
-      // pass the key to the current state handler
-      new_state = m_currentState->handleKey(event.key);
-      if (new_state != NO_CHANGE)
-        changeStateTo(new_state);
-      break;
-    }
-    case SDL_QUIT:
-      // user wants to quit
-      quit_it = true;
-      break;
-    case SDL_USEREVENT:
-      // This is our regular update timer, let's go update state and
-      // redraw.
-
-      // do updates relevant for the state that we are in
-      new_state = m_currentState->update(now - m_lastUpdate);
-      m_lastUpdate = now;
-      if (new_state != NO_CHANGE)
-        changeStateTo(new_state);
-
-      // redraw now that we have potentially updated something
-      m_currentState->draw(m_screen);
-
-      // If we are in the play state and the game is paused, reduce
-      // our timer tick to 150ms to save a bit of power until the user
-      // unpauses.
-      playstate = dynamic_cast<PlayState*>(m_currentState);
-      if (playstate) {
-        if (playstate->isPaused() && !paused) {
-          paused = true;
-          SDL_RemoveTimer(m_updateTimer);
-          m_updateTimer = SDL_AddTimer(150, updateCallback, 0);
-        } else if (!playstate->isPaused() && paused) {
-          paused = false;
-          SDL_RemoveTimer(m_updateTimer);
-          m_updateTimer = SDL_AddTimer(30, updateCallback, 0);
-        }
+    while (!quit_it && SDL_PollEvent(&event)) {
+      switch (event.type) {
+      case SDL_KEYDOWN:
+      case SDL_KEYUP: {
+        // pass the key to the current state handler
+        const enum STATE_CHANGE new_state = m_states->top()->handleKey(event.key);
+        if (new_state != NO_CHANGE)
+          changeStateTo(new_state);
+        // an unpause shouldn't have to wait out the slow tick
+        pace();
+        break;
       }
-
-      // and update the resulting screen
-      SDL_Flip(m_screen);
-      break;
-    default:
-      // unknown event type - really ought to be filtered out; maybe
-      // add a warning print or something in the future.
+      case SDL_VIDEOEXPOSE:
+        exposed = true;
+        break;
+      case SDL_QUIT:
+        // user wants to quit
+        quit_it = true;
+        break;
+      }
+    }
+    if (quit_it || !m_scheduler.wait())
       continue;
+
+    // Time for a frame. If we fell behind, the ticks we missed are
+    // simply skipped; the update below covers all of the time.
+    m_scheduler.beginFrame();
+    const Uint32 now = SDL_GetTicks();
+
+    // do updates relevant for the state that we are in
+    const enum STATE_CHANGE new_state = m_states->top()->update(now - m_lastUpdate);
+    m_lastUpdate = now;
+    if (new_state != NO_CHANGE)
+      changeStateTo(new_state);
+
+    // redraw now that we have potentially updated something
+    m_dirty.clear();
+    m_states->top()->draw(m_screen, m_dirty);
+    if (exposed) {
+      // the window system lost what was on the display
+      m_dirty.addAll();
+      exposed = false;
+    }
+    pace();
+
+    // and update the parts of the screen that changed
+    present();
+    if (m_capture) {
+      // Mid transition the whole frame changes, however little
+      // the state itself redrew.
+      const bool all = m_transition.active() || m_dirty.full();
+      m_capture->capture(shown(), all ? 0 : &m_dirty.rects());
     }
   }
 
   return EXIT_SUCCESS;
 }
 
+void BBEngine::pace()
+{
+  m_scheduler.setInterval(m_states->top()->frameInterval(m_interval));
+}
+
+SDL_Surface* BBEngine::createScreen() const
+{
+  const SDL_PixelFormat* fmt = m_display->format;
+  SDL_Surface* s = SDL_CreateRGBSurface(SDL_SWSURFACE, WIDTH, HEIGHT, fmt->BitsPerPixel,
+                                        fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask);
+  if (!s)
+    throw Exception("Unable to create screen surface: " + std::string(SDL_GetError()));
+  return s;
+}
+
+SDL_Surface* BBEngine::shown() const
+{
+  if (!m_scaler)
+    return m_display;
+  return m_transition.active() ? m_composite : m_canvas;
+}
+
+void BBEngine::present()
+{
+  if (m_transition.active()) {
+    SDL_Surface* out = m_scaler ? m_composite : m_display;
+    if (m_transition.compose(m_screen, out, SDL_GetTicks())) {
+      if (m_scaler) {
+        SDL_Rect all = { 0, 0, WIDTH, HEIGHT };
+        m_scaler->scale(out, all, m_display);
+      }
+      SDL_Flip(m_display);
+      return;
+    }
+    // It's over. Show the incoming state's frame in full and, unless
+    // scaling, have it draw straight on the display again.
+    if (!m_scaler) {
+      blit::blitSurface(m_canvas, 0, m_display, 0);
+      m_screen = m_display;
+    }
+    m_dirty.addAll();
+  }
+
+  if (m_dirty.empty())
+    return;
+
+  if (!m_scaler) {
+    if (m_dirty.full()) {
+      SDL_Flip(m_display);
+    } else {
+      std::vector<SDL_Rect>& rects = m_dirty.rects();
+      SDL_UpdateRects(m_display, rects.size(), &rects[0]);
+    }
+    return;
+  }
+
+  std::vector<SDL_Rect>& rects = m_dirty.rects();
+  m_display_rects.clear();
+  for (std::vector<SDL_Rect>::iterator it = rects.begin(); it != rects.end(); ++it)
+    m_display_rects.push_back(m_scaler->scale(m_screen, *it, m_display));
+  if (m_dirty.full())
+    SDL_Flip(m_display);
+  else
+    SDL_UpdateRects(m_display, m_display_rects.size(), &m_display_rects[0]);
+}
+
 void BBEngine::changeStateTo(enum STATE_CHANGE new_state)
 {
-  delete m_currentState;
+  // Keep the frame on the display to transition away from. The game
+  // gets wiped in and out, the other screens cross-fade.
+  const bool play = new_state == GOTO_PLAY || new_state == RESUME_PLAY
+    || dynamic_cast<PlayState*>(m_states->top());
+  if (shown()->format->BitsPerPixel == 32) {
+    m_transition.start(shown(), play ? Transition::WIPE : Transition::FADE);
+    if (m_scaler && !m_composite)
+      m_composite = createScreen();
+    if (!m_scaler) {
+      if (!m_canvas)
+        m_canvas = createScreen();
+      m_screen = m_canvas;
+    }
+  }
+
   switch (new_state) {
   case NO_CHANGE:
     std::cerr << "error: NO_CHANGE state in changeStateTo" << std::endl;
     break;
   case GOTO_MENU:
-    m_currentState = new MenuState();
+    // Back down to the menu if it's under us, otherwise bring it up
+    // over whatever is running - a game stays where it is.
+    if (m_states->contains(GOTO_MENU)) {
+      while (m_states->topKind() != GOTO_MENU)
+        m_states->pop();
+    } else {
+      m_states->push(GOTO_MENU, createState(GOTO_MENU));
+    }
     break;
+  case RESUME_PLAY:
+    if (m_states->contains(GOTO_PLAY)) {
+      while (m_states->topKind() != GOTO_PLAY)
+        m_states->pop();
+      break;
+    }
+    // nothing to resume, so start a new game
   case GOTO_PLAY:
-    m_currentState = new PlayState();
+    // A game left on the stack is over; everything else may be used
+    // again.
+    while (!m_states->empty())
+      m_states->pop(m_states->topKind() != GOTO_PLAY);
+    m_states->push(GOTO_PLAY, createState(GOTO_PLAY));
     break;
   case GOTO_HELP:
-    m_currentState = new HelpState();
-    break;
   case GOTO_HIGHSCORE:
-    m_currentState = new HighscoreState();
-    break;
   case GOTO_ABOUT:
-    m_currentState = new TextDisplayState(ABOUT_TEXT);
+    m_states->push(new_state, createState(new_state));
     break;
   default:
     throw Exception("Unknown state in changeStateTo");
   }
+
+  if (m_states->topKind() == GOTO_MENU)
+    static_cast<MenuState*>(m_states->top())->setResumable(m_states->contains(GOTO_PLAY));
 }
 
-Uint32 updateCallback(Uint32 interval, void*)
+State* BBEngine::createState(enum STATE_CHANGE kind)
 {
-  // All we do here is just push a event into SDL's event queue so
-  // that our main game loop will wake up regularly and update game
-  // state and redraw etc.
-  SDL_Event event;
-  SDL_UserEvent userevent;
-  userevent.type = SDL_USEREVENT;
-  userevent.code = 0;
-  userevent.data1 = NULL;
-  userevent.data2 = NULL;
-
-  event.type = SDL_USEREVENT;
-  event.user = userevent;
+  State* state = m_states->takeCached(kind);
+  if (state)
+    return state;
 
-  SDL_PushEvent(&event);
-  return interval;
+  switch (kind) {
+  case GOTO_MENU:
+    return new MenuState();
+  case GOTO_PLAY:
+    return new PlayState();
+  case GOTO_HELP:
+    return new HelpState();
+  case GOTO_HIGHSCORE:
+    return new HighscoreState();
+  case GOTO_ABOUT:
+    return new TextDisplayState(ABOUT_TEXT);
+  default:
+    throw Exception("Unknown state in createState");
+  }
 }
@@ -8,15 +8,31 @@
 #ifndef BNB_BBENGINE_HH
 #define BNB_BBENGINE_HH
 
+#include <vector>
 #include <SDL.h>
 #include "states.hh"
+#include "statestack.hh"
+#include "dirtyrects.hh"
+#include "scaler.hh"
+#include "transition.hh"
+#include "capture.hh"
+#include "framescheduler.hh"
 
 class BBEngine;
 typedef void (BBEngine::*BBEngineStateHandler)(const SDL_KeyboardEvent& k);
 
 class BBEngine {
 public:
-  BBEngine(int width, int height, int bpp);
+  // The size all screens are laid out for
+  static const Uint16 WIDTH = 800;
+  static const Uint16 HEIGHT = 600;
+  // microseconds between frames unless asked for another rate
+  static const Uint32 FRAME_INTERVAL = 30000;
+
+  // The display can be any size - 0 means WIDTH x HEIGHT in a window
+  // or the desktop size fullscreen. When it isn't WIDTH x HEIGHT the
+  // game is drawn off screen and scaled to the display.
+  BBEngine(int width, int height, int bpp, bool fullscreen = false);
   ~BBEngine();
   // Get the show on the road. Return value is intended to be returned from main.
   int exec();
@@ -25,12 +41,35 @@ private:
   BBEngine(const BBEngine&);
   BBEngine& operator=(const BBEngine&);
   void changeStateTo(enum STATE_CHANGE new_state);
-  SDL_TimerID m_updateTimer;
+  // A state of 'kind', from the cache if there is one
+  State* createState(enum STATE_CHANGE kind);
+  // Push what changed this frame to the display
+  void present();
+  // A new WIDTH x HEIGHT surface in the display's format
+  SDL_Surface* createScreen() const;
+  // The WIDTH x HEIGHT frame currently on the display
+  SDL_Surface* shown() const;
+  // Run the running state at the rate it asks for
+  void pace();
+  SDL_Surface* m_display;
+  // What the states draw on; the display itself, unless scaling or in
+  // a transition, in which case it's the canvas
   SDL_Surface* m_screen;
+  SDL_Surface* m_canvas;
+  // transition frames on their way to the scaler
+  SDL_Surface* m_composite;
+  Scaler* m_scaler;
+  Transition m_transition;
+  std::vector<SDL_Rect> m_display_rects;
+  // records the frames shown, if asked to
+  Capture* m_capture;
   Uint32 m_lastUpdate;
-  State* m_currentState;
+  // the rate the game runs at, and what keeps it to it
+  Uint32 m_interval;
+  FrameScheduler m_scheduler;
+  // the one on top is the one running
+  StateStack* m_states;
+  DirtyRects m_dirty;
 };
 
-Uint32 updateCallback(Uint32 interval, void* param);
-
 #endif
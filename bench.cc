@@ -0,0 +1,227 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include "except.hh"
+#include "util.hh"
+#include "cube.hh"
+#include "threadpool.hh"
+#include "simulation.hh"
+#include "autoplayer.hh"
+#include "states.hh"
+#include "menustate.hh"
+#include "playstate.hh"
+#include "textdisplaystate.hh"
+#include "aboutdata.hh"
+#include "bbengine.hh"
+#include "framescheduler.hh"
+#include "blit.hh"
+#include "textwriter.hh"
+#include "fontmanager.hh"
+#include "glyphatlas.hh"
+#include "config.h"
+#include "bench.hh"
+
+namespace {
+  const Uint32 BENCH_BOT_MOVES = 250;
+
+  // Lets the autoplayer play BENCH_BOT_MOVES moves of a fresh game
+  double benchBotOn(ThreadPool& pool)
+  {
+    SimBoard board(16, 16, SimBoard::Params(), 8, 8, 1);
+    AutoPlayer player(pool);
+    for (Uint32 i = 0; i < BENCH_BOT_MOVES; ++i) {
+      const cube::ROLL_DIRECTION dir = player.think(board);
+      board.roll(dir);
+    }
+    std::cout << pool.threads() << " thread(s): "
+              << static_cast<Uint32>(player.nodesPerSecond()) << " nodes/s, "
+              << board.score() << " points and "
+              << board.livesLost() << " lives lost in "
+              << BENCH_BOT_MOVES << " moves" << std::endl;
+    return player.nodesPerSecond();
+  }
+
+  const Uint32 BENCH_TEXT_ROUNDS = 2000;
+  // what the game draws most: the score, menu items, the pause
+  // screen and lines of the About text
+  const char* const BENCH_TEXT[] = {
+    "Score: 00001234",
+    "> New Game <",
+    "Press \"Pause\" or \"P\" to continue.",
+    "Blocks and Bombs is a game where you roll a cube around a board"
+  };
+
+  // Game time passing per frame, as when playing
+  const Uint32 BENCH_RENDER_TICK = 30;
+  // frames drawn at the game's own pace, to see how well it keeps it
+  const Uint32 BENCH_PACING_FRAMES = 100;
+
+  void pressKey(State& state, SDLKey key)
+  {
+    SDL_KeyboardEvent event;
+    event.type = SDL_KEYDOWN;
+    event.state = SDL_PRESSED;
+    event.keysym.sym = key;
+    event.keysym.mod = KMOD_NONE;
+    event.keysym.unicode = 0;
+    state.handleKey(event);
+    event.type = SDL_KEYUP;
+    event.state = SDL_RELEASED;
+    state.handleKey(event);
+  }
+
+  // Updates and draws 'state' for 'frames' frames, pressing 'key'
+  // every 'every' frames if given, and reports how long drawing took.
+  // Takes ownership of 'state'.
+  void benchScene(const char* name, State* state, SDL_Surface* screen, Uint32 frames,
+                  SDLKey key = SDLK_UNKNOWN, Uint32 every = 0)
+  {
+    const util::GC<State> owner(state);
+    DirtyRects dirty(screen->w, screen->h);
+    std::vector<Uint32> micros;
+    micros.reserve(frames);
+    Uint64 pixels = 0;
+    for (Uint32 frame = 0; frame < frames; ++frame) {
+      if (every && frame % every == every - 1)
+        pressKey(*state, key);
+      state->update(BENCH_RENDER_TICK);
+      dirty.clear();
+      const uint64_t start = util::timeMicros();
+      state->draw(screen, dirty);
+      micros.push_back(util::timeMicros() - start);
+      pixels += dirty.area();
+    }
+    if (micros.empty())
+      return;
+
+    const Uint32 first = micros[0];
+    Uint64 total = 0;
+    for (std::vector<Uint32>::const_iterator it = micros.begin(); it != micros.end(); ++it)
+      total += *it;
+    std::sort(micros.begin(), micros.end());
+    const Uint32 n = micros.size();
+    std::cout << util::fmt2str("%-12s", name) << " first " << first << "us, mean "
+              << total / n << "us, p50 " << micros[n / 2] << "us, p90 "
+              << micros[n * 9 / 10] << "us, p99 " << micros[n * 99 / 100] << "us, max "
+              << micros[n - 1] << "us, " << pixels / n << " pixels per frame" << std::endl;
+  }
+
+  // Runs 'state' the way the game does, a frame each time one is due,
+  // for 'frames' frames and reports how well the deadlines were kept.
+  // Takes ownership of 'state'.
+  void benchPacing(State* state, SDL_Surface* screen, Uint32 frames)
+  {
+    const util::GC<State> owner(state);
+    DirtyRects dirty(screen->w, screen->h);
+    FrameScheduler scheduler(BBEngine::FRAME_INTERVAL);
+    scheduler.start();
+    while (scheduler.frames() < frames) {
+      if (!scheduler.wait())
+        continue;
+      scheduler.beginFrame();
+      state->update(BENCH_RENDER_TICK);
+      dirty.clear();
+      state->draw(screen, dirty);
+    }
+    scheduler.report();
+  }
+}
+
+int benchBot()
+{
+  ThreadPool single(1);
+  const double one = benchBotOn(single);
+  ThreadPool all;
+  const double many = benchBotOn(all);
+  if (one > 0)
+    std::cout << "speedup: " << many / one << "x" << std::endl;
+  return 0;
+}
+
+int benchRender(Uint32 frames)
+{
+  SDL_Surface* screen = SDL_SetVideoMode(BBEngine::WIDTH, BBEngine::HEIGHT, 32, SDL_SWSURFACE);
+  if (!screen)
+    throw Exception("Unable to set video mode: " + std::string(SDL_GetError()));
+  blit::init();
+  if (TTF_Init() == -1)
+    throw Exception("Unable to initialize SDL_ttf: " + std::string(TTF_GetError()));
+
+  std::cout << frames << " frames per scene at " << BBEngine::WIDTH << "x" << BBEngine::HEIGHT
+            << " using " << blit::kernelName(blit::kernel()) << " blitters" << std::endl;
+  benchScene("menu", new MenuState, screen, frames);
+  benchScene("empty board", new PlayState, screen, frames);
+  PlayState* full = new PlayState;
+  full->fillBoard();
+  benchScene("full board", full, screen, frames);
+  PlayState* paused = new PlayState;
+  pressKey(*paused, SDLK_p);
+  benchScene("paused", paused, screen, frames);
+  benchScene("about", new TextDisplayState(ABOUT_TEXT), screen, frames, SDLK_DOWN, 10);
+  PlayState* paced = new PlayState;
+  paced->fillBoard();
+  benchPacing(paced, screen, BENCH_PACING_FRAMES);
+
+  reportTextCache();
+  textCache().clear();
+  fonts().clear();
+  TTF_Quit();
+  return 0;
+}
+
+int benchText()
+{
+  SDL_Surface* screen = SDL_SetVideoMode(BBEngine::WIDTH, BBEngine::HEIGHT, 32, SDL_SWSURFACE);
+  if (!screen)
+    throw Exception("Unable to set video mode: " + std::string(SDL_GetError()));
+  blit::init();
+  if (TTF_Init() == -1)
+    throw Exception("Unable to initialize SDL_ttf: " + std::string(TTF_GetError()));
+
+  const SDL_Color color = { 50, 250, 50, 0 };
+  const int sizes[] = { 20, 40 };
+  for (Uint32 s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    TTF_Font* font = fonts().font(RESOURCES_DIR"/fonts/whitrabt.ttf", sizes[s]);
+    const GlyphAtlas atlas(font, color);
+    for (Uint32 t = 0; t < sizeof(BENCH_TEXT) / sizeof(BENCH_TEXT[0]); ++t) {
+      const std::string text(BENCH_TEXT[t]);
+
+      uint64_t start = util::timeMicros();
+      for (Uint32 i = 0; i < BENCH_TEXT_ROUNDS; ++i) {
+        SDL_Surface* surface = TTF_RenderText_Blended(font, text.c_str(), color);
+        if (!surface)
+          throw Exception("Unable to render text: " + std::string(TTF_GetError()));
+        SDL_Rect dst = { 10, 10, 0, 0 };
+        blit::blitSurface(surface, 0, screen, &dst);
+        SDL_FreeSurface(surface);
+      }
+      const double ttf = static_cast<double>(util::timeMicros() - start) / BENCH_TEXT_ROUNDS;
+
+      start = util::timeMicros();
+      for (Uint32 i = 0; i < BENCH_TEXT_ROUNDS; ++i) {
+        SDL_Rect dst = { 10, 10, 0, 0 };
+        atlas.render(screen, &dst, text);
+      }
+      const double glyphs = static_cast<double>(util::timeMicros() - start) / BENCH_TEXT_ROUNDS;
+
+      std::cout << util::fmt2str("%2dpt %2u chars: TTF_RenderText_Blended %7.1fus, "
+                                 "glyph atlas %6.1fus, %5.1fx", sizes[s],
+                                 static_cast<unsigned int>(text.size()), ttf, glyphs,
+                                 glyphs > 0 ? ttf / glyphs : 0.0) << std::endl;
+    }
+  }
+
+  reportTextCache();
+  fonts().clear();
+  TTF_Quit();
+  return 0;
+}
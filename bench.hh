@@ -0,0 +1,26 @@
+/*
+ * Benchmarks, run instead of the game when asked for on the command
+ * line. Results go to stdout.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_BENCH_HH
+#define BNB_BENCH_HH
+
+#include <SDL.h>
+
+// Autoplayer search speed, single threaded and on all CPUs
+int benchBot();
+
+// Frame times drawing scripted scenes, 'frames' frames each, then how
+// closely a full board keeps to the game's frame rate. Needs SDL video
+// initialized but sets the video mode itself.
+int benchRender(Uint32 frames);
+
+// Drawing text with SDL_ttf against drawing it from a glyph atlas.
+// Same requirements as benchRender().
+int benchText();
+
+#endif
@@ -0,0 +1,749 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <SDL.h>
+#include <SDL_cpuinfo.h>
+#include "except.hh"
+#include "util.hh"
+#include "blit.hh"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BNB_BLIT_SSE2
+#include <emmintrin.h>
+#if defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define BNB_BLIT_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+namespace {
+  typedef void (*BlendRow)(const Uint32* src, Uint32* dst, int n);
+  typedef void (*FillRow)(Uint32 color, Uint32* dst, int n);
+  typedef void (*CopyRow)(const Uint32* src, Uint32* dst, int n);
+  typedef void (*LerpRow)(const Uint32* a, const Uint32* b, Uint32* out, int n, Uint32 weight);
+  typedef void (*LerpPixels)(const Uint32* a, const Uint32* b, Uint32* out, int n,
+                             const Uint16* weights);
+
+  struct Kernels {
+    BlendRow blend;
+    FillRow fill;
+    CopyRow copy;
+  };
+
+  // The kernels are templates over where the alpha byte sits (24 for
+  // ARGB/ABGR, 0 for RGBA/BGRA) and over which of SDL's two blends
+  // they reproduce: its ARGB to RGB fast path truncates and copies
+  // opaque pixels as they are, while the generic path rounds up.
+  //
+  // Every channel is d + (s - d) * a / 256, computed as
+  // (d * (256 - a) + s * a) / 256 so it never goes negative and fits
+  // in 16 bits. Whatever the destination has in its alpha byte is
+  // left alone.
+  template <int ASHIFT, bool ROUND>
+  inline Uint32 blendPixel(Uint32 s, Uint32 d)
+  {
+    const Uint32 amask = 0xffu << ASHIFT;
+    const Uint32 a = (s >> ASHIFT) & 0xff;
+    if (!a)
+      return d;
+    if (!ROUND && a == 0xff)
+      return (s & ~amask) | (d & amask);
+    Uint32 out = d & amask;
+    for (int shift = 0; shift < 32; shift += 8) {
+      if (shift == ASHIFT)
+        continue;
+      const Uint32 sc = (s >> shift) & 0xff;
+      const Uint32 dc = (d >> shift) & 0xff;
+      out |= ((dc * (256 - a) + sc * a + (ROUND ? 255 : 0)) >> 8) << shift;
+    }
+    return out;
+  }
+
+  template <int ASHIFT, bool ROUND>
+  void scalarBlend(const Uint32* src, Uint32* dst, int n)
+  {
+    for (int i = 0; i < n; ++i)
+      dst[i] = blendPixel<ASHIFT, ROUND>(src[i], dst[i]);
+  }
+
+  template <int ASHIFT, bool ROUND>
+  void scalarFill(Uint32 color, Uint32* dst, int n)
+  {
+    for (int i = 0; i < n; ++i)
+      dst[i] = blendPixel<ASHIFT, ROUND>(color, dst[i]);
+  }
+
+  void scalarCopy(const Uint32* src, Uint32* dst, int n)
+  {
+    std::memcpy(dst, src, n * sizeof(Uint32));
+  }
+
+  void scalarLerp(const Uint32* a, const Uint32* b, Uint32* out, int n, Uint32 weight)
+  {
+    for (int i = 0; i < n; ++i)
+      out[i] = blit::lerp(a[i], b[i], weight);
+  }
+
+  void scalarLerpPixels(const Uint32* a, const Uint32* b, Uint32* out, int n,
+                        const Uint16* weights)
+  {
+    for (int i = 0; i < n; ++i)
+      out[i] = blit::lerp(a[i], b[i], weights[i]);
+  }
+
+#ifdef BNB_BLIT_SSE2
+  // Four pixels at a time, each channel widened to 16 bits
+  template <int ASHIFT, bool ROUND>
+  __attribute__((target("sse2")))
+  inline __m128i sse2Blend4(__m128i s, __m128i d)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i amask = _mm_set1_epi32(static_cast<int>(0xffu << ASHIFT));
+    const __m128i s_alpha = _mm_and_si128(s, amask);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(s_alpha, zero)) == 0xffff)
+      return d;
+
+    const __m128i max = _mm_set1_epi16(256);
+    __m128i slo = _mm_unpacklo_epi8(s, zero);
+    __m128i shi = _mm_unpackhi_epi8(s, zero);
+    __m128i alo, ahi;
+    if (ASHIFT == 24) {
+      alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(slo, 0xff), 0xff);
+      ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(shi, 0xff), 0xff);
+    } else {
+      alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(slo, 0x00), 0x00);
+      ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(shi, 0x00), 0x00);
+    }
+    slo = _mm_mullo_epi16(slo, alo);
+    shi = _mm_mullo_epi16(shi, ahi);
+    __m128i dlo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(max, alo));
+    __m128i dhi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(max, ahi));
+    dlo = _mm_add_epi16(dlo, slo);
+    dhi = _mm_add_epi16(dhi, shi);
+    if (ROUND) {
+      const __m128i bias = _mm_set1_epi16(255);
+      dlo = _mm_add_epi16(dlo, bias);
+      dhi = _mm_add_epi16(dhi, bias);
+    }
+    __m128i out = _mm_packus_epi16(_mm_srli_epi16(dlo, 8), _mm_srli_epi16(dhi, 8));
+    if (!ROUND) {
+      const __m128i opaque = _mm_cmpeq_epi32(s_alpha, amask);
+      out = _mm_or_si128(_mm_and_si128(opaque, s), _mm_andnot_si128(opaque, out));
+    }
+    return _mm_or_si128(_mm_andnot_si128(amask, out), _mm_and_si128(amask, d));
+  }
+
+  template <int ASHIFT, bool ROUND>
+  __attribute__((target("sse2")))
+  void sse2Blend(const Uint32* src, Uint32* dst, int n)
+  {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), sse2Blend4<ASHIFT, ROUND>(s, d));
+    }
+    scalarBlend<ASHIFT, ROUND>(src + i, dst + i, n - i);
+  }
+
+  template <int ASHIFT, bool ROUND>
+  __attribute__((target("sse2")))
+  void sse2Fill(Uint32 color, Uint32* dst, int n)
+  {
+    const __m128i s = _mm_set1_epi32(static_cast<int>(color));
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), sse2Blend4<ASHIFT, ROUND>(s, d));
+    }
+    scalarFill<ASHIFT, ROUND>(color, dst + i, n - i);
+  }
+
+  __attribute__((target("sse2")))
+  void sse2Copy(const Uint32* src, Uint32* dst, int n)
+  {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), a);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), b);
+    }
+    scalarCopy(src + i, dst + i, n - i);
+  }
+
+  __attribute__((target("sse2")))
+  void sse2Lerp(const Uint32* a, const Uint32* b, Uint32* out, int n, Uint32 weight)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wb = _mm_set1_epi16(weight);
+    const __m128i wa = _mm_set1_epi16(256 - weight);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+      const __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                                       _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+      const __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                                       _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                       _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+    scalarLerp(a + i, b + i, out + i, n - i, weight);
+  }
+
+  __attribute__((target("sse2")))
+  void sse2LerpPixels(const Uint32* a, const Uint32* b, Uint32* out, int n,
+                      const Uint16* weights)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(256);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+      // w0 w1 w2 w3 spread out to one per channel
+      const __m128i w = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(weights + i));
+      const __m128i pairs = _mm_unpacklo_epi16(w, w);
+      const __m128i wlo = _mm_unpacklo_epi32(pairs, pairs);
+      const __m128i whi = _mm_unpackhi_epi32(pairs, pairs);
+      const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+      const __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero),
+                                                       _mm_sub_epi16(max, wlo)),
+                                       _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wlo));
+      const __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero),
+                                                       _mm_sub_epi16(max, whi)),
+                                       _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), whi));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                       _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+    scalarLerpPixels(a + i, b + i, out + i, n - i, weights + i);
+  }
+#endif
+
+#ifdef BNB_BLIT_AVX2
+  // Same as the SSE2 version, eight pixels at a time
+  template <int ASHIFT, bool ROUND>
+  __attribute__((target("avx2")))
+  inline __m256i avx2Blend8(__m256i s, __m256i d)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i amask = _mm256_set1_epi32(static_cast<int>(0xffu << ASHIFT));
+    const __m256i s_alpha = _mm256_and_si256(s, amask);
+    if (_mm256_testz_si256(s_alpha, s_alpha))
+      return d;
+
+    const __m256i max = _mm256_set1_epi16(256);
+    __m256i slo = _mm256_unpacklo_epi8(s, zero);
+    __m256i shi = _mm256_unpackhi_epi8(s, zero);
+    __m256i alo, ahi;
+    if (ASHIFT == 24) {
+      alo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(slo, 0xff), 0xff);
+      ahi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(shi, 0xff), 0xff);
+    } else {
+      alo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(slo, 0x00), 0x00);
+      ahi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(shi, 0x00), 0x00);
+    }
+    slo = _mm256_mullo_epi16(slo, alo);
+    shi = _mm256_mullo_epi16(shi, ahi);
+    __m256i dlo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), _mm256_sub_epi16(max, alo));
+    __m256i dhi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), _mm256_sub_epi16(max, ahi));
+    dlo = _mm256_add_epi16(dlo, slo);
+    dhi = _mm256_add_epi16(dhi, shi);
+    if (ROUND) {
+      const __m256i bias = _mm256_set1_epi16(255);
+      dlo = _mm256_add_epi16(dlo, bias);
+      dhi = _mm256_add_epi16(dhi, bias);
+    }
+    __m256i out = _mm256_packus_epi16(_mm256_srli_epi16(dlo, 8), _mm256_srli_epi16(dhi, 8));
+    if (!ROUND)
+      out = _mm256_blendv_epi8(out, s, _mm256_cmpeq_epi32(s_alpha, amask));
+    return _mm256_blendv_epi8(out, d, amask);
+  }
+
+  template <int ASHIFT, bool ROUND>
+  __attribute__((target("avx2")))
+  void avx2Blend(const Uint32* src, Uint32* dst, int n)
+  {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), avx2Blend8<ASHIFT, ROUND>(s, d));
+    }
+    scalarBlend<ASHIFT, ROUND>(src + i, dst + i, n - i);
+  }
+
+  template <int ASHIFT, bool ROUND>
+  __attribute__((target("avx2")))
+  void avx2Fill(Uint32 color, Uint32* dst, int n)
+  {
+    const __m256i s = _mm256_set1_epi32(static_cast<int>(color));
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), avx2Blend8<ASHIFT, ROUND>(s, d));
+    }
+    scalarFill<ASHIFT, ROUND>(color, dst + i, n - i);
+  }
+
+  __attribute__((target("avx2")))
+  void avx2Copy(const Uint32* src, Uint32* dst, int n)
+  {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), a);
+    }
+    scalarCopy(src + i, dst + i, n - i);
+  }
+#endif
+
+  template <int ASHIFT, bool ROUND>
+  Kernels kernelsFor(blit::KERNEL kernel)
+  {
+    Kernels k;
+    switch (kernel) {
+#ifdef BNB_BLIT_AVX2
+    case blit::AVX2:
+      k.blend = avx2Blend<ASHIFT, ROUND>;
+      k.fill = avx2Fill<ASHIFT, ROUND>;
+      k.copy = avx2Copy;
+      return k;
+#endif
+#ifdef BNB_BLIT_SSE2
+    case blit::SSE2:
+      k.blend = sse2Blend<ASHIFT, ROUND>;
+      k.fill = sse2Fill<ASHIFT, ROUND>;
+      k.copy = sse2Copy;
+      return k;
+#endif
+    default:
+      k.blend = scalarBlend<ASHIFT, ROUND>;
+      k.fill = scalarFill<ASHIFT, ROUND>;
+      k.copy = scalarCopy;
+      return k;
+    }
+  }
+
+  Kernels kernelsFor(blit::KERNEL kernel, int ashift, bool round)
+  {
+    if (ashift == 24)
+      return round ? kernelsFor<24, true>(kernel) : kernelsFor<24, false>(kernel);
+    return round ? kernelsFor<0, true>(kernel) : kernelsFor<0, false>(kernel);
+  }
+
+  blit::KERNEL bestKernel()
+  {
+#ifdef BNB_BLIT_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      return blit::AVX2;
+#endif
+#ifdef BNB_BLIT_SSE2
+    if (SDL_HasSSE2())
+      return blit::SSE2;
+#endif
+    return blit::SCALAR;
+  }
+
+  struct Format {
+    Uint32 rmask, gmask, bmask, amask;
+  };
+
+  Format formatOf(const SDL_PixelFormat* fmt)
+  {
+    Format f = { fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask };
+    return f;
+  }
+
+  bool sameFormat(const SDL_PixelFormat* fmt, const Format& f)
+  {
+    return fmt->BitsPerPixel == 32 && fmt->Rmask == f.rmask && fmt->Gmask == f.gmask
+      && fmt->Bmask == f.bmask && fmt->Amask == f.amask;
+  }
+
+  bool hasSSE2(blit::KERNEL kernel)
+  {
+    return kernel == blit::SSE2 || kernel == blit::AVX2;
+  }
+
+  // What init() settled on. Sprites are only blended by us when they
+  // are in the format SDL_DisplayFormatAlpha() gives and go onto a
+  // surface in the screen's format, since that's what was checked.
+  struct State {
+    State()
+      : kernel(blit::NONE), kernels(), lerp(scalarLerp), lerp_pixels(scalarLerpPixels),
+        sprite(), screen()
+    { }
+    blit::KERNEL kernel;
+    Kernels kernels;
+    // don't need to match SDL, so always the best there is
+    LerpRow lerp;
+    LerpPixels lerp_pixels;
+    Format sprite;
+    Format screen;
+  };
+
+  State& state()
+  {
+    static State s;
+    return s;
+  }
+
+  SDL_Surface* createSurface(int w, int h, const Format& f, Uint32 flags = SDL_SWSURFACE)
+  {
+    SDL_Surface* s = SDL_CreateRGBSurface(flags, w, h, 32, f.rmask, f.gmask, f.bmask, f.amask);
+    if (!s)
+      throw Exception("Unable to create blitter test surface: " + std::string(SDL_GetError()));
+    return s;
+  }
+
+  // Fill a surface with random bytes; alpha gets the full range as well.
+  void scramble(SDL_Surface* s, util::Random& random)
+  {
+    for (int y = 0; y < s->h; ++y) {
+      Uint32* row = reinterpret_cast<Uint32*>(static_cast<Uint8*>(s->pixels) + y * s->pitch);
+      for (int x = 0; x < s->w; ++x)
+        row[x] = random.next();
+    }
+  }
+
+  bool samePixels(const SDL_Surface* a, const SDL_Surface* b)
+  {
+    const SDL_PixelFormat* fmt = a->format;
+    const Uint32 mask = fmt->Rmask | fmt->Gmask | fmt->Bmask | fmt->Amask;
+    for (int y = 0; y < a->h; ++y) {
+      const Uint32* ra = reinterpret_cast<const Uint32*>(static_cast<const Uint8*>(a->pixels) + y * a->pitch);
+      const Uint32* rb = reinterpret_cast<const Uint32*>(static_cast<const Uint8*>(b->pixels) + y * b->pitch);
+      for (int x = 0; x < a->w; ++x)
+        if ((ra[x] ^ rb[x]) & mask)
+          return false;
+    }
+    return true;
+  }
+
+  // Run the kernels and SDL over the same random sprites, fills and
+  // backgrounds and see if they agree.
+  bool matchesSDL(const Kernels& k, const Format& sprite, const Format& screen)
+  {
+    const int size = 64;
+    util::Random random(0x5eed);
+    SDL_Surface* src = createSurface(size, size, sprite, SDL_SWSURFACE|SDL_SRCALPHA);
+    SDL_Surface* fill = createSurface(size, size, sprite, SDL_SWSURFACE|SDL_SRCALPHA);
+    SDL_Surface* theirs = createSurface(size, size, screen);
+    SDL_Surface* ours = createSurface(size, size, screen);
+    const int ashift = sprite.amask == 0xff000000 ? 24 : 0;
+
+    bool same = true;
+    for (int pass = 0; same && pass < 4; ++pass) {
+      scramble(src, random);
+      scramble(theirs, random);
+      // one row of each alpha value, so the edge cases are there for sure
+      Uint32* row = static_cast<Uint32*>(src->pixels);
+      for (int x = 0; x < size; ++x)
+        row[x] = (row[x] & ~sprite.amask) | ((x * 255 / (size - 1)) << ashift);
+      std::memcpy(ours->pixels, theirs->pixels, size * theirs->pitch);
+
+      SDL_BlitSurface(src, 0, theirs, 0);
+      for (int y = 0; y < size; ++y)
+        k.blend(reinterpret_cast<const Uint32*>(static_cast<Uint8*>(src->pixels) + y * src->pitch),
+                reinterpret_cast<Uint32*>(static_cast<Uint8*>(ours->pixels) + y * ours->pitch),
+                size);
+      same = samePixels(theirs, ours);
+
+      const Uint8 alpha = (pass * 85 + 42) & 0xff;
+      const Uint32 color = SDL_MapRGBA(fill->format, random.next(256), random.next(256),
+                                       random.next(256), alpha);
+      SDL_FillRect(fill, 0, color);
+      SDL_BlitSurface(fill, 0, theirs, 0);
+      for (int y = 0; y < size; ++y)
+        k.fill(color, reinterpret_cast<Uint32*>(static_cast<Uint8*>(ours->pixels) + y * ours->pitch),
+               size);
+      same = same && samePixels(theirs, ours);
+    }
+
+    SDL_FreeSurface(ours);
+    SDL_FreeSurface(theirs);
+    SDL_FreeSurface(fill);
+    SDL_FreeSurface(src);
+    return same;
+  }
+
+  // Clip the way SDL_BlitSurface() does, to 'clip' rather than the
+  // clip rectangle of dst. Returns false if nothing is left.
+  bool clip(SDL_Surface* src, SDL_Rect* srcrect, const SDL_Rect& clip, SDL_Rect* dstrect,
+            SDL_Rect& from, SDL_Rect& to)
+  {
+    int srcx, srcy, w, h;
+    if (srcrect) {
+      srcx = srcrect->x;
+      w = srcrect->w;
+      if (srcx < 0) {
+        w += srcx;
+        dstrect->x -= srcx;
+        srcx = 0;
+      }
+      w = std::min(w, src->w - srcx);
+      srcy = srcrect->y;
+      h = srcrect->h;
+      if (srcy < 0) {
+        h += srcy;
+        dstrect->y -= srcy;
+        srcy = 0;
+      }
+      h = std::min(h, src->h - srcy);
+    } else {
+      srcx = srcy = 0;
+      w = src->w;
+      h = src->h;
+    }
+
+    int dx = clip.x - dstrect->x;
+    if (dx > 0) {
+      w -= dx;
+      dstrect->x += dx;
+      srcx += dx;
+    }
+    dx = dstrect->x + w - clip.x - clip.w;
+    if (dx > 0)
+      w -= dx;
+    int dy = clip.y - dstrect->y;
+    if (dy > 0) {
+      h -= dy;
+      dstrect->y += dy;
+      srcy += dy;
+    }
+    dy = dstrect->y + h - clip.y - clip.h;
+    if (dy > 0)
+      h -= dy;
+
+    if (w <= 0 || h <= 0) {
+      dstrect->w = dstrect->h = 0;
+      return false;
+    }
+    from.x = srcx;
+    from.y = srcy;
+    from.w = dstrect->w = w;
+    from.h = dstrect->h = h;
+    to = *dstrect;
+    return true;
+  }
+
+  Uint32* pixelAt(SDL_Surface* s, int x, int y)
+  {
+    return reinterpret_cast<Uint32*>(static_cast<Uint8*>(s->pixels) + y * s->pitch) + x;
+  }
+
+  enum PATH { PATH_SDL, PATH_BLEND, PATH_COPY };
+
+  // Per-pixel alpha from our images, or a plain copy between surfaces
+  // in the screen's format - anything else is left to SDL.
+  PATH pathFor(const SDL_Surface* src, const SDL_Surface* dst)
+  {
+    const State& st = state();
+    if (st.kernel == blit::NONE || !sameFormat(dst->format, st.screen)
+        || (src->flags & SDL_SRCCOLORKEY))
+      return PATH_SDL;
+    if ((src->flags & SDL_SRCALPHA) && sameFormat(src->format, st.sprite))
+      return PATH_BLEND;
+    if (sameFormat(src->format, st.screen)
+        && (!(src->flags & SDL_SRCALPHA) || src->format->alpha == SDL_ALPHA_OPAQUE))
+      return PATH_COPY;
+    return PATH_SDL;
+  }
+
+  void blitRows(PATH path, SDL_Surface* src, const SDL_Rect& from, SDL_Surface* dst,
+                const SDL_Rect& to)
+  {
+    const Kernels& k = state().kernels;
+    for (int y = 0; y < from.h; ++y) {
+      const Uint32* s = pixelAt(src, from.x, from.y + y);
+      Uint32* d = pixelAt(dst, to.x, to.y + y);
+      if (path == PATH_BLEND)
+        k.blend(s, d, from.w);
+      else
+        k.copy(s, d, from.w);
+    }
+  }
+}
+
+namespace blit {
+  void init()
+  {
+    State& st = state();
+    st.kernel = NONE;
+#ifdef BNB_BLIT_SSE2
+    if (hasSSE2(bestKernel())) {
+      st.lerp = sse2Lerp;
+      st.lerp_pixels = sse2LerpPixels;
+    }
+#endif
+
+    const SDL_Surface* screen = SDL_GetVideoSurface();
+    if (!screen || screen->format->BitsPerPixel != 32)
+      return;
+    st.screen = formatOf(screen->format);
+
+    // Find out what SDL_DisplayFormatAlpha() turns our images into
+    SDL_Surface* tmp = SDL_CreateRGBSurface(SDL_SWSURFACE|SDL_SRCALPHA, 1, 1, 32,
+                                            0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+    if (!tmp)
+      throw Exception("Unable to create blitter test surface: " + std::string(SDL_GetError()));
+    SDL_Surface* converted = SDL_DisplayFormatAlpha(tmp);
+    SDL_FreeSurface(tmp);
+    if (!converted)
+      throw Exception("Unable to convert blitter test surface: " + std::string(SDL_GetError()));
+    st.sprite = formatOf(converted->format);
+    SDL_FreeSurface(converted);
+    if (st.sprite.amask != 0xff000000 && st.sprite.amask != 0x000000ff)
+      return;
+    if (st.sprite.rmask != st.screen.rmask || st.sprite.gmask != st.screen.gmask
+        || st.sprite.bmask != st.screen.bmask)
+      return;
+
+    const KERNEL best = bestKernel();
+    const int ashift = st.sprite.amask == 0xff000000 ? 24 : 0;
+    for (int rounding = 0; rounding < 2; ++rounding) {
+      const Kernels k = kernelsFor(best, ashift, rounding != 0);
+      if (matchesSDL(k, st.sprite, st.screen)) {
+        st.kernel = best;
+        st.kernels = k;
+        return;
+      }
+    }
+    std::cerr << "Warning: unable to match SDL's alpha blending, leaving all blits to SDL"
+              << std::endl;
+  }
+
+  KERNEL kernel()
+  {
+    return state().kernel;
+  }
+
+  const char* kernelName(KERNEL kernel)
+  {
+    switch (kernel) {
+    case SCALAR: return "scalar";
+    case SSE2: return "SSE2";
+    case AVX2: return "AVX2";
+    default: return "SDL";
+    }
+  }
+
+  int blitSurface(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst, SDL_Rect* dstrect)
+  {
+    const PATH path = pathFor(src, dst);
+    if (path == PATH_SDL)
+      return SDL_BlitSurface(src, srcrect, dst, dstrect);
+
+    SDL_Rect full = { 0, 0, 0, 0 };
+    if (!dstrect)
+      dstrect = &full;
+    SDL_Rect from, to;
+    if (!clip(src, srcrect, dst->clip_rect, dstrect, from, to))
+      return 0;
+
+    if (SDL_MUSTLOCK(src) && SDL_LockSurface(src) < 0)
+      return -1;
+    if (SDL_MUSTLOCK(dst) && SDL_LockSurface(dst) < 0) {
+      if (SDL_MUSTLOCK(src))
+        SDL_UnlockSurface(src);
+      return -1;
+    }
+    blitRows(path, src, from, dst, to);
+    if (SDL_MUSTLOCK(dst))
+      SDL_UnlockSurface(dst);
+    if (SDL_MUSTLOCK(src))
+      SDL_UnlockSurface(src);
+    return 0;
+  }
+
+  bool canBlit(const SDL_Surface* src, const SDL_Surface* dst)
+  {
+    return pathFor(src, dst) != PATH_SDL && !SDL_MUSTLOCK(src) && !SDL_MUSTLOCK(dst);
+  }
+
+  int blitSurface(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst, SDL_Rect* dstrect,
+                  const SDL_Rect& clip_rect)
+  {
+    if (!canBlit(src, dst))
+      return -1;
+
+    const SDL_Rect& dst_clip = dst->clip_rect;
+    SDL_Rect area;
+    area.x = std::max(clip_rect.x, dst_clip.x);
+    area.y = std::max(clip_rect.y, dst_clip.y);
+    const int x1 = std::min(clip_rect.x + clip_rect.w, dst_clip.x + dst_clip.w);
+    const int y1 = std::min(clip_rect.y + clip_rect.h, dst_clip.y + dst_clip.h);
+    area.w = std::max(x1 - area.x, 0);
+    area.h = std::max(y1 - area.y, 0);
+
+    SDL_Rect full = { 0, 0, 0, 0 };
+    if (!dstrect)
+      dstrect = &full;
+    SDL_Rect from, to;
+    if (clip(src, srcrect, area, dstrect, from, to))
+      blitRows(pathFor(src, dst), src, from, dst, to);
+    return 0;
+  }
+
+  void lerpRow(const Uint32* a, const Uint32* b, Uint32* out, int n, Uint32 weight)
+  {
+    state().lerp(a, b, out, n, weight);
+  }
+
+  void lerpRow(const Uint32* a, const Uint32* b, Uint32* out, int n, const Uint16* weights)
+  {
+    state().lerp_pixels(a, b, out, n, weights);
+  }
+
+  void fillAlpha(SDL_Surface* dst, const SDL_Rect* rect, Uint8 r, Uint8 g, Uint8 b,
+                 Uint8 alpha)
+  {
+    const State& st = state();
+    SDL_Rect area = { 0, 0, 0, 0 };
+    if (rect) {
+      area = *rect;
+    } else {
+      area.w = dst->w;
+      area.h = dst->h;
+    }
+
+    if (st.kernel == NONE || !sameFormat(dst->format, st.screen)) {
+      // Let SDL do it the way we always did, with a filled surface
+      SDL_Surface* tmp = SDL_CreateRGBSurface(SDL_SWSURFACE|SDL_SRCALPHA, area.w, area.h, 32,
+                                              0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+      if (!tmp)
+        throw Exception("Unable to create fill surface: " + std::string(SDL_GetError()));
+      SDL_FillRect(tmp, 0, SDL_MapRGBA(tmp->format, r, g, b, alpha));
+      SDL_BlitSurface(tmp, 0, dst, &area);
+      SDL_FreeSurface(tmp);
+      return;
+    }
+
+    // A fill has no source to clip against, only the clip rectangle
+    const SDL_Rect& clip = dst->clip_rect;
+    const int x0 = std::max(static_cast<int>(area.x), static_cast<int>(clip.x));
+    const int y0 = std::max(static_cast<int>(area.y), static_cast<int>(clip.y));
+    const int x1 = std::min(area.x + area.w, clip.x + clip.w);
+    const int y1 = std::min(area.y + area.h, clip.y + clip.h);
+    if (x0 >= x1 || y0 >= y1)
+      return;
+
+    const int ashift = st.sprite.amask == 0xff000000 ? 24 : 0;
+    const Uint32 color = (SDL_MapRGB(dst->format, r, g, b) & ~st.sprite.amask)
+      | (static_cast<Uint32>(alpha) << ashift);
+    if (SDL_MUSTLOCK(dst) && SDL_LockSurface(dst) < 0)
+      return;
+    for (int y = y0; y < y1; ++y)
+      st.kernels.fill(color, pixelAt(dst, x0, y), x1 - x0);
+    if (SDL_MUSTLOCK(dst))
+      SDL_UnlockSurface(dst);
+  }
+}
@@ -0,0 +1,65 @@
+/*
+ * Our own blitters for the 32bpp display formats. SDL 1.2 handles
+ * per-pixel alpha one pixel at a time, which is where most of our
+ * frame time goes, so sprite blits, opaque copies and translucent
+ * fills are done here with SSE2 or AVX2 when the CPU has them. The
+ * results are the same, bit for bit, as what SDL would have produced -
+ * that is checked at startup and anything we can't match is simply
+ * handed to SDL.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_BLIT_HH
+#define BNB_BLIT_HH
+
+#include <SDL.h>
+
+namespace blit {
+  enum KERNEL { NONE = 0, SCALAR, SSE2, AVX2 };
+
+  // Picks the best kernels for this CPU and checks them against SDL
+  // for the display formats. Call once the video mode is set; until
+  // then everything goes through SDL.
+  void init();
+
+  // The kernels in use, NONE if we found no match for SDL's output
+  KERNEL kernel();
+  const char* kernelName(KERNEL kernel);
+
+  // Same as SDL_BlitSurface()
+  int blitSurface(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst, SDL_Rect* dstrect);
+
+  // Can src go onto dst through our kernels alone, without SDL and
+  // without locking?
+  bool canBlit(const SDL_Surface* src, const SDL_Surface* dst);
+
+  // Same as above, but also clipped to 'clip_rect', and it leaves dst
+  // untouched outside of it. Only for surfaces canBlit() agrees to
+  // (returns -1 otherwise), and then safe to call from several
+  // threads at once as long as their clip rectangles don't overlap.
+  int blitSurface(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst, SDL_Rect* dstrect,
+                  const SDL_Rect& clip_rect);
+
+  // Linear interpolation between two 32bpp pixels, channel by
+  // channel, 'weight' (0 - 256) being how much of b to take
+  inline Uint32 lerp(Uint32 a, Uint32 b, Uint32 weight)
+  {
+    const Uint32 rb = ((a & 0x00ff00ff) * (256 - weight) + (b & 0x00ff00ff) * weight) >> 8;
+    const Uint32 ag = ((a >> 8) & 0x00ff00ff) * (256 - weight) + ((b >> 8) & 0x00ff00ff) * weight;
+    return (rb & 0x00ff00ff) | (ag & 0xff00ff00);
+  }
+
+  // The same for whole rows of pixels, with one weight for all of
+  // them or one per pixel
+  void lerpRow(const Uint32* a, const Uint32* b, Uint32* out, int n, Uint32 weight);
+  void lerpRow(const Uint32* a, const Uint32* b, Uint32* out, int n, const Uint16* weights);
+
+  // Blend a colour over the rectangle (all of dst if 0) the same way
+  // blitting a surface filled with that colour and alpha would.
+  void fillAlpha(SDL_Surface* dst, const SDL_Rect* rect, Uint8 r, Uint8 g, Uint8 b,
+                 Uint8 alpha);
+}
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <SDL.h>
+#include <SDL_thread.h>
+#include "except.hh"
+#include "util.hh"
+#include "capture.hh"
+
+Capture::Capture(const std::string& dir, Uint16 width, Uint16 height)
+  : m_dir(dir), m_width(width), m_height(height), m_slots(SLOTS),
+    m_frame(static_cast<Uint32>(width) * height), m_row(static_cast<Uint32>(width) * 3),
+    m_rshift(16), m_gshift(8), m_bshift(0), m_lock(SDL_CreateMutex()),
+    m_ready(SDL_CreateCond()), m_head(0), m_tail(0), m_queued(0), m_quit(false),
+    m_thread(0), m_number(0), m_resync(true), m_captured(0), m_dropped(0),
+    m_copy_micros(0), m_copied(0), m_written(0), m_write_micros(0), m_failed(false)
+{
+  if (!m_lock || !m_ready)
+    throw Exception("Unable to create capture synchronization primitives: "
+                    + std::string(SDL_GetError()));
+
+  // Everything is allocated now so capturing never has to. A slot
+  // holds at most a whole frame, and room for more rectangles than
+  // DirtyRects ever hands out before marking the whole screen.
+  for (std::vector<Slot>::iterator it = m_slots.begin(); it != m_slots.end(); ++it) {
+    it->rects.reserve(64);
+    it->pixels.resize(static_cast<Uint32>(width) * height);
+  }
+
+  m_thread = SDL_CreateThread(writerMain, this);
+  if (!m_thread) {
+    SDL_DestroyCond(m_ready);
+    SDL_DestroyMutex(m_lock);
+    throw Exception("Unable to start capture writer: " + std::string(SDL_GetError()));
+  }
+}
+
+Capture::~Capture()
+{
+  SDL_LockMutex(m_lock);
+  m_quit = true;
+  SDL_CondSignal(m_ready);
+  SDL_UnlockMutex(m_lock);
+  SDL_WaitThread(m_thread, 0);
+
+  if (m_captured + m_dropped)
+    std::cout << "captured " << m_captured << " frames to " << m_dir << ", dropped "
+              << m_dropped << ", copying "
+              << (m_captured ? m_copied / m_captured : 0) << " pixels in "
+              << (m_captured ? m_copy_micros / m_captured : 0)
+              << "us per frame on the game thread, writing took "
+              << (m_written ? m_write_micros / m_written : 0) << "us per frame" << std::endl;
+
+  SDL_DestroyCond(m_ready);
+  SDL_DestroyMutex(m_lock);
+}
+
+void Capture::capture(SDL_Surface* frame, const std::vector<SDL_Rect>* rects)
+{
+  const Uint32 number = m_number++;
+  if (frame->format->BytesPerPixel != 4 || frame->w != m_width || frame->h != m_height)
+    throw Exception("Can only capture " + util::uint2str(m_width) + "x"
+                    + util::uint2str(m_height) + " frames at 32 bits per pixel");
+
+  SDL_LockMutex(m_lock);
+  const bool room = m_queued < SLOTS;
+  SDL_UnlockMutex(m_lock);
+  if (!room) {
+    // The writer can't keep up. What changed in this frame is lost
+    // to it, so the next frame has to go over in full.
+    ++m_dropped;
+    m_resync = true;
+    return;
+  }
+
+  if (!m_captured) {
+    // the writer only looks at these once it has a frame
+    const SDL_PixelFormat* fmt = frame->format;
+    m_rshift = fmt->Rshift;
+    m_gshift = fmt->Gshift;
+    m_bshift = fmt->Bshift;
+  }
+
+  const uint64_t start = util::timeMicros();
+  // The writer isn't looking at this slot until we queue it
+  Slot& slot = m_slots[m_head];
+  slot.number = number;
+  slot.rects.clear();
+  if (!rects || m_resync) {
+    SDL_Rect all = { 0, 0, m_width, m_height };
+    slot.rects.push_back(all);
+    m_resync = false;
+  } else {
+    slot.rects = *rects;
+  }
+
+  if (SDL_MUSTLOCK(frame))
+    SDL_LockSurface(frame);
+  Uint32* out = &slot.pixels[0];
+  for (std::vector<SDL_Rect>::const_iterator it = slot.rects.begin();
+       it != slot.rects.end(); ++it) {
+    const Uint8* row = static_cast<const Uint8*>(frame->pixels) + it->y * frame->pitch
+      + it->x * 4;
+    for (Uint32 y = 0; y < it->h; ++y, row += frame->pitch, out += it->w)
+      std::memcpy(out, row, it->w * 4);
+  }
+  if (SDL_MUSTLOCK(frame))
+    SDL_UnlockSurface(frame);
+  m_copied += out - &slot.pixels[0];
+  m_copy_micros += util::timeMicros() - start;
+  ++m_captured;
+
+  SDL_LockMutex(m_lock);
+  m_head = (m_head + 1) % SLOTS;
+  ++m_queued;
+  SDL_CondSignal(m_ready);
+  SDL_UnlockMutex(m_lock);
+}
+
+int Capture::writerMain(void* data)
+{
+  static_cast<Capture*>(data)->writer();
+  return 0;
+}
+
+void Capture::writer()
+{
+  SDL_LockMutex(m_lock);
+  for (;;) {
+    while (!m_queued && !m_quit)
+      SDL_CondWait(m_ready, m_lock);
+    if (!m_queued)
+      break;
+    const Slot& slot = m_slots[m_tail];
+    SDL_UnlockMutex(m_lock);
+
+    const uint64_t start = util::timeMicros();
+    write(slot);
+    m_write_micros += util::timeMicros() - start;
+
+    SDL_LockMutex(m_lock);
+    m_tail = (m_tail + 1) % SLOTS;
+    --m_queued;
+  }
+  SDL_UnlockMutex(m_lock);
+}
+
+void Capture::write(const Slot& slot)
+{
+  // bring our copy of the frame up to date
+  const Uint32* in = &slot.pixels[0];
+  for (std::vector<SDL_Rect>::const_iterator it = slot.rects.begin();
+       it != slot.rects.end(); ++it) {
+    Uint32* row = &m_frame[it->y * m_width + it->x];
+    for (Uint32 y = 0; y < it->h; ++y, row += m_width, in += it->w)
+      std::memcpy(row, in, it->w * 4);
+  }
+
+  if (m_failed)
+    return;
+  const std::string name = m_dir + "/frame-" + util::uint2str(slot.number, 6) + ".ppm";
+  FILE* file = std::fopen(name.c_str(), "wb");
+  bool ok = file != 0;
+  if (ok)
+    ok = std::fprintf(file, "P6\n%u %u\n255\n", m_width, m_height) > 0;
+  const Uint32* pixel = &m_frame[0];
+  for (Uint32 y = 0; ok && y < m_height; ++y) {
+    for (Uint32 x = 0; x < m_width; ++x, ++pixel) {
+      m_row[x * 3] = *pixel >> m_rshift;
+      m_row[x * 3 + 1] = *pixel >> m_gshift;
+      m_row[x * 3 + 2] = *pixel >> m_bshift;
+    }
+    ok = std::fwrite(&m_row[0], 1, m_row.size(), file) == m_row.size();
+  }
+  if (file && std::fclose(file))
+    ok = false;
+
+  if (ok) {
+    ++m_written;
+  } else {
+    // Nothing we can do about it from here; don't fill the log with
+    // the same complaint for every frame.
+    std::cerr << "warning: unable to write " << name << ", stopping capture" << std::endl;
+    m_failed = true;
+  }
+}
@@ -0,0 +1,88 @@
+/*
+ * Records the frames the game presents to a directory on disk, for
+ * QA and trailers, without the timing hit of grabbing the screen from
+ * the outside. Each frame - or only the parts of it that changed - is
+ * copied into a ring of buffers allocated up front, and a writer
+ * thread turns them into a numbered sequence of binary PPM images.
+ * The game never waits for the disk: when the ring is full the frame
+ * is dropped and counted, and the next one is copied in full. Gaps in
+ * the numbering show where frames were dropped.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_CAPTURE_HH
+#define BNB_CAPTURE_HH
+
+#include <string>
+#include <vector>
+#include <SDL.h>
+#include <SDL_thread.h>
+
+class Capture {
+public:
+  static const Uint32 SLOTS = 12;
+
+  // Frames are 'width' x 'height' and 32 bits per pixel
+  Capture(const std::string& dir, Uint16 width, Uint16 height);
+  // Writes out whatever is still in the ring
+  ~Capture();
+
+  // Queue a frame. 'rects' are the parts that changed since the last
+  // frame, or 0 if everything might have.
+  void capture(SDL_Surface* frame, const std::vector<SDL_Rect>* rects);
+
+  Uint32 captured() const { return m_captured; }
+  Uint32 dropped() const { return m_dropped; }
+
+private:
+  struct Slot {
+    Slot() : number(0), rects(), pixels() { }
+    Uint32 number;
+    // the changed rectangles; their pixels are stored one after the
+    // other in 'pixels'
+    std::vector<SDL_Rect> rects;
+    std::vector<Uint32> pixels;
+  };
+
+  Capture(const Capture&);
+  Capture& operator=(const Capture&);
+  static int writerMain(void* data);
+  void writer();
+  void write(const Slot& slot);
+
+  std::string m_dir;
+  Uint16 m_width;
+  Uint16 m_height;
+  std::vector<Slot> m_slots;
+  // where the frames go together on the writer's side
+  std::vector<Uint32> m_frame;
+  std::vector<Uint8> m_row;
+  Uint8 m_rshift;
+  Uint8 m_gshift;
+  Uint8 m_bshift;
+
+  SDL_mutex* m_lock;
+  SDL_cond* m_ready;
+  // next slot to fill, next to write, and how many are waiting
+  Uint32 m_head;
+  Uint32 m_tail;
+  Uint32 m_queued;
+  bool m_quit;
+  SDL_Thread* m_thread;
+
+  // only touched by the game's thread
+  Uint32 m_number;
+  bool m_resync;
+  Uint32 m_captured;
+  Uint32 m_dropped;
+  Uint64 m_copy_micros;
+  Uint64 m_copied;
+  // only touched by the writer
+  Uint32 m_written;
+  Uint64 m_write_micros;
+  bool m_failed;
+};
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <SDL.h>
+#include "except.hh"
+#include "resources.hh"
+#include "cube.hh"
+
+namespace {
+  using namespace cube;
+
+  Faces rollFaces(const Faces& f, ROLL_DIRECTION dir)
+  {
+    Faces r = f;
+    switch (dir) {
+    case ROLL_UP:
+      r.bottom = f.up;
+      r.up = f.top;
+      r.top = f.down;
+      r.down = f.bottom;
+      break;
+    case ROLL_DOWN:
+      r.bottom = f.down;
+      r.down = f.top;
+      r.top = f.up;
+      r.up = f.bottom;
+      break;
+    case ROLL_LEFT:
+      r.bottom = f.left;
+      r.left = f.top;
+      r.top = f.right;
+      r.right = f.bottom;
+      break;
+    case ROLL_RIGHT:
+      r.bottom = f.right;
+      r.right = f.top;
+      r.top = f.left;
+      r.left = f.bottom;
+      break;
+    }
+    return r;
+  }
+
+  // Built once by rolling the starting cube around until no new
+  // orientations turn up.
+  struct Tables {
+    Tables();
+    Faces faces[ORIENTATIONS];
+    Uint8 rolls[ORIENTATIONS][4];
+    Uint8 index[6][6];  // by top and up colour
+  };
+
+  Tables::Tables()
+  {
+    for (int t = 0; t < 6; ++t)
+      for (int u = 0; u < 6; ++u)
+        index[t][u] = ORIENTATIONS;
+
+    const Faces start = { RED, PURPLE, BLUE, CYAN, GREEN, YELLOW };
+    faces[0] = start;
+    index[start.top][start.up] = 0;
+    Uint8 count = 1;
+    for (Uint8 o = 0; o < count; ++o) {
+      for (int d = ROLL_UP; d <= ROLL_RIGHT; ++d) {
+        const Faces next = rollFaces(faces[o], static_cast<ROLL_DIRECTION>(d));
+        Uint8& i = index[next.top][next.up];
+        if (i == ORIENTATIONS) {
+          if (count == ORIENTATIONS)
+            throw Exception("Cube has more than 24 orientations");
+          faces[count] = next;
+          i = count++;
+        }
+        rolls[o][d] = i;
+      }
+    }
+  }
+
+  const Tables& tables()
+  {
+    static const Tables t;
+    return t;
+  }
+}
+
+namespace cube {
+  Uint8 initialOrientation()
+  {
+    return 0;
+  }
+
+  Uint8 orientation(BLOCK_COLOR top, BLOCK_COLOR up)
+  {
+    return tables().index[top][up];
+  }
+
+  const Faces& faces(Uint8 orientation)
+  {
+    return tables().faces[orientation];
+  }
+
+  Uint8 roll(Uint8 orientation, ROLL_DIRECTION dir)
+  {
+    return tables().rolls[orientation][dir];
+  }
+}
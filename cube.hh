@@ -0,0 +1,46 @@
+/*
+ * The player's cube can only ever be in one of 24 orientations, since
+ * its six coloured faces are fixed and it can only be rolled. This
+ * numbers those orientations and provides lookup tables for what a
+ * roll does to them.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_CUBE_HH
+#define BNB_CUBE_HH
+
+#include <SDL.h>
+#include "resources.hh"
+
+namespace cube {
+  const Uint8 ORIENTATIONS = 24;
+
+  enum ROLL_DIRECTION { ROLL_UP = 0, ROLL_DOWN, ROLL_LEFT, ROLL_RIGHT };
+
+  // The colour of each face of the cube, 'up' being the side facing
+  // the top of the screen etc.
+  struct Faces {
+    BLOCK_COLOR top;
+    BLOCK_COLOR bottom;
+    BLOCK_COLOR up;
+    BLOCK_COLOR down;
+    BLOCK_COLOR left;
+    BLOCK_COLOR right;
+  };
+
+  // The orientation the player starts out in
+  Uint8 initialOrientation();
+
+  // Orientation with the given top and up faces. Returns ORIENTATIONS
+  // if no orientation of the cube has that combination.
+  Uint8 orientation(BLOCK_COLOR top, BLOCK_COLOR up);
+
+  const Faces& faces(Uint8 orientation);
+  Uint8 roll(Uint8 orientation, ROLL_DIRECTION dir);
+
+  inline BLOCK_COLOR top(Uint8 orientation) { return faces(orientation).top; }
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <SDL.h>
+#include "dirtyrects.hh"
+
+namespace {
+  // Merging is worth it when the union is at most this many pixels
+  // bigger than the two rectangles on their own - about one tile.
+  const Uint32 MERGE_SLACK = 32 * 32;
+  // Past this percentage of the screen one big update is cheaper
+  const Uint32 FULL_PERCENT = 60;
+
+  Uint32 rectArea(const SDL_Rect& r)
+  {
+    return r.w * r.h;
+  }
+
+  SDL_Rect unite(const SDL_Rect& a, const SDL_Rect& b)
+  {
+    const Sint32 x1 = std::min(a.x, b.x);
+    const Sint32 y1 = std::min(a.y, b.y);
+    const Sint32 x2 = std::max(a.x + a.w, b.x + b.w);
+    const Sint32 y2 = std::max(a.y + a.h, b.y + b.h);
+    SDL_Rect r;
+    r.x = x1;
+    r.y = y1;
+    r.w = x2 - x1;
+    r.h = y2 - y1;
+    return r;
+  }
+}
+
+bool intersects(const SDL_Rect& a, const SDL_Rect& b)
+{
+  return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+DirtyRects::DirtyRects(Uint16 width, Uint16 height)
+  : m_width(width), m_height(height), m_rects(), m_full(false)
+{
+  m_rects.reserve(MAX_RECTS + 1);
+}
+
+void DirtyRects::add(const SDL_Rect& rect)
+{
+  if (m_full)
+    return;
+
+  // clip to the screen
+  const Sint32 x1 = std::max<Sint32>(rect.x, 0);
+  const Sint32 y1 = std::max<Sint32>(rect.y, 0);
+  const Sint32 x2 = std::min<Sint32>(rect.x + rect.w, m_width);
+  const Sint32 y2 = std::min<Sint32>(rect.y + rect.h, m_height);
+  if (x2 <= x1 || y2 <= y1)
+    return;
+  SDL_Rect r;
+  r.x = x1;
+  r.y = y1;
+  r.w = x2 - x1;
+  r.h = y2 - y1;
+
+  // Swallow every rectangle it's cheap to merge with. Growing 'r' can
+  // make earlier ones mergeable too, so start over after each merge.
+  for (std::vector<SDL_Rect>::size_type i = 0; i < m_rects.size(); ) {
+    const SDL_Rect u = unite(m_rects[i], r);
+    if (rectArea(u) <= rectArea(m_rects[i]) + rectArea(r) + MERGE_SLACK) {
+      r = u;
+      m_rects[i] = m_rects.back();
+      m_rects.pop_back();
+      i = 0;
+    } else {
+      ++i;
+    }
+  }
+  m_rects.push_back(r);
+
+  if (m_rects.size() > MAX_RECTS
+      || area() * 100 > static_cast<Uint32>(m_width * m_height) * FULL_PERCENT)
+    addAll();
+}
+
+void DirtyRects::addAll()
+{
+  m_full = true;
+  m_rects.clear();
+}
+
+void DirtyRects::clear()
+{
+  m_full = false;
+  m_rects.clear();
+}
+
+std::vector<SDL_Rect>& DirtyRects::rects()
+{
+  if (m_full && m_rects.empty()) {
+    SDL_Rect r;
+    r.x = r.y = 0;
+    r.w = m_width;
+    r.h = m_height;
+    m_rects.push_back(r);
+  }
+  return m_rects;
+}
+
+Uint32 DirtyRects::area() const
+{
+  if (m_full)
+    return m_width * m_height;
+  Uint32 total = 0;
+  for (std::vector<SDL_Rect>::const_iterator it = m_rects.begin(); it != m_rects.end(); ++it)
+    total += rectArea(*it);
+  return total;
+}
@@ -0,0 +1,45 @@
+/*
+ * Tracks which parts of the screen changed during a frame, so only
+ * those need to be redrawn and pushed to the display. Rectangles that
+ * overlap, or sit close enough that merging costs little extra area,
+ * are merged as they are added. When there are too many of them, or
+ * they cover most of the screen, the whole screen is marked instead.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_DIRTYRECTS_HH
+#define BNB_DIRTYRECTS_HH
+
+#include <vector>
+#include <SDL.h>
+
+class DirtyRects {
+public:
+  static const Uint32 MAX_RECTS = 32;
+
+  DirtyRects(Uint16 width, Uint16 height);
+
+  void add(const SDL_Rect& rect);
+  void addAll();
+  void clear();
+
+  bool empty() const { return !m_full && m_rects.empty(); }
+  bool full() const { return m_full; }
+  // The dirty rectangles; the whole screen if full()
+  std::vector<SDL_Rect>& rects();
+  // Dirty pixels in total
+  Uint32 area() const;
+
+private:
+  Uint16 m_width;
+  Uint16 m_height;
+  std::vector<SDL_Rect> m_rects;
+  bool m_full;
+};
+
+// Does 'a' overlap 'b'?
+bool intersects(const SDL_Rect& a, const SDL_Rect& b);
+
+#endif
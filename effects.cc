@@ -3,4 +3,215 @@
  * Licensed under the terms of the GNU General Public License (GPL) version 2.
  */
 
+#include <SDL.h>
+#include "except.hh"
+#include "snapshot.hh"
 #include "effects.hh"
+
+namespace {
+  enum STACK_RULE {
+    REFRESH = 0,  // restart the timer if the new duration is longer
+    EXTEND,       // add the new duration to the time remaining
+    STACK         // go up a level (to max_level) and restart the timer
+  };
+
+  struct EffectRule {
+    STACK_RULE rule;
+    Uint16 max_level;
+    bool powerdown;
+  };
+
+  // indexed by EFFECT_KIND
+  const EffectRule RULES[EFFECT_KIND_COUNT] = {
+    { REFRESH, 0, false },  // EFFECT_NONE
+    { STACK,   3, false },  // EFFECT_SWIFTNESS
+    { REFRESH, 1, true },   // EFFECT_SLOW
+    { EXTEND,  1, false },  // EFFECT_FREEZE
+    { STACK,   3, false },  // EFFECT_CROESUS
+    { REFRESH, 1, true },   // EFFECT_POOR
+    { EXTEND,  1, false },  // EFFECT_GHOST
+    { EXTEND,  1, false },  // EFFECT_SHIELD
+    { REFRESH, 1, true }    // EFFECT_BACKWARDS
+  };
+}
+
+ActiveEffects::ActiveEffects()
+  : m_count(0), m_now(0), m_next_deadline(0), m_modifiers()
+{
+}
+
+Uint32 ActiveEffects::find(EFFECT_KIND kind) const
+{
+  for (Uint32 i = 0; i < m_count; ++i) {
+    if (m_slots[i].kind == kind)
+      return i;
+  }
+  return CAPACITY;
+}
+
+Uint16 ActiveEffects::level(EFFECT_KIND kind) const
+{
+  const Uint32 i = find(kind);
+  return i < CAPACITY ? m_slots[i].level : 0;
+}
+
+Uint32 ActiveEffects::remaining(EFFECT_KIND kind) const
+{
+  const Uint32 i = find(kind);
+  return i < CAPACITY ? m_slots[i].deadline - m_now : 0;
+}
+
+void ActiveEffects::add(EFFECT_KIND kind, Uint32 duration)
+{
+  if (kind <= EFFECT_NONE || kind >= EFFECT_KIND_COUNT || !duration)
+    return;
+
+  const EffectRule& rule = RULES[kind];
+  const Uint32 i = find(kind);
+  Slot* slot;
+  if (i < CAPACITY) {
+    slot = &m_slots[i];
+    switch (rule.rule) {
+    case REFRESH:
+      if (m_now + duration > slot->deadline)
+        slot->deadline = m_now + duration;
+      break;
+    case EXTEND:
+      slot->deadline += duration;
+      break;
+    case STACK:
+      if (slot->level < rule.max_level)
+        ++slot->level;
+      slot->deadline = m_now + duration;
+      break;
+    }
+  } else {
+    if (m_count == CAPACITY) {
+      // Table is full, make room by dropping whatever would have
+      // expired first.
+      Uint32 victim = 0;
+      for (Uint32 j = 1; j < m_count; ++j) {
+        if (m_slots[j].deadline < m_slots[victim].deadline)
+          victim = j;
+      }
+      m_slots[victim] = m_slots[--m_count];
+    }
+    slot = &m_slots[m_count++];
+    slot->kind = kind;
+    slot->level = 1;
+    slot->deadline = m_now + duration;
+  }
+
+  recalculate();
+}
+
+void ActiveEffects::update(Uint32 delta_time)
+{
+  m_now += delta_time;
+  if (m_count && m_now >= m_next_deadline)
+    expire();
+}
+
+void ActiveEffects::playerDied()
+{
+  Uint32 i = 0;
+  while (i < m_count) {
+    if (!RULES[m_slots[i].kind].powerdown) {
+      m_slots[i] = m_slots[--m_count];
+      continue;
+    }
+    m_slots[i].deadline = m_now + (m_slots[i].deadline - m_now) / 2;
+    ++i;
+  }
+  recalculate();
+}
+
+void ActiveEffects::clear()
+{
+  m_count = 0;
+  recalculate();
+}
+
+void ActiveEffects::expire()
+{
+  Uint32 i = 0;
+  while (i < m_count) {
+    if (m_slots[i].deadline <= m_now)
+      m_slots[i] = m_slots[--m_count];
+    else
+      ++i;
+  }
+  recalculate();
+}
+
+void ActiveEffects::recalculate()
+{
+  EffectModifiers mods;
+  m_next_deadline = 0;
+  for (Uint32 i = 0; i < m_count; ++i) {
+    const Slot& slot = m_slots[i];
+    if (!m_next_deadline || slot.deadline < m_next_deadline)
+      m_next_deadline = slot.deadline;
+
+    switch (slot.kind) {
+    case EFFECT_SWIFTNESS:
+      // each level takes 20% off the time between moves
+      mods.move_delay_percent = mods.move_delay_percent * (100 - 20 * slot.level) / 100;
+      break;
+    case EFFECT_SLOW:
+      mods.move_delay_percent = mods.move_delay_percent * 250 / 100;
+      break;
+    case EFFECT_FREEZE:
+      mods.freeze = true;
+      break;
+    case EFFECT_CROESUS:
+      // level 1 doubles score, level 2 triples it etc.
+      mods.score_percent = mods.score_percent * (1 + slot.level);
+      break;
+    case EFFECT_POOR:
+      mods.score_percent = mods.score_percent / 2;
+      break;
+    case EFFECT_GHOST:
+      mods.ghost = true;
+      break;
+    case EFFECT_SHIELD:
+      mods.shield = true;
+      break;
+    case EFFECT_BACKWARDS:
+      mods.backwards = true;
+      break;
+    case EFFECT_NONE:
+    case EFFECT_KIND_COUNT:
+      break;
+    }
+  }
+  m_modifiers = mods;
+}
+
+void ActiveEffects::saveState(SnapshotWriter& out) const
+{
+  // Deadlines are stored relative to the clock so it doesn't matter
+  // when the snapshot is restored.
+  out.putByte(m_count);
+  for (Uint32 i = 0; i < m_count; ++i) {
+    out.putByte(m_slots[i].kind | (m_slots[i].level << 4));
+    out.putVarint(m_slots[i].deadline - m_now);
+  }
+}
+
+void ActiveEffects::restoreState(SnapshotReader& in)
+{
+  m_now = 0;
+  m_count = in.getByte();
+  if (m_count > CAPACITY)
+    throw Exception("Snapshot has too many active effects");
+  for (Uint32 i = 0; i < m_count; ++i) {
+    const Uint8 b = in.getByte();
+    m_slots[i].kind = static_cast<EFFECT_KIND>(b & 0x0f);
+    m_slots[i].level = b >> 4;
+    m_slots[i].deadline = in.getVarint();
+    if (m_slots[i].kind <= EFFECT_NONE || m_slots[i].kind >= EFFECT_KIND_COUNT)
+      throw Exception("Snapshot has an unknown effect");
+  }
+  recalculate();
+}
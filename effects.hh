@@ -8,13 +8,105 @@
 
 #include <SDL.h>
 
+class SnapshotWriter;
+class SnapshotReader;
+
+/*
+ * The timed effects (powerups and powerdowns) that can be active on
+ * the player.
+ */
+enum EFFECT_KIND {
+  EFFECT_NONE = 0,
+  EFFECT_SWIFTNESS,  // faster movement, stackable
+  EFFECT_SLOW,       // movement at a crawl
+  EFFECT_FREEZE,     // blocks don't time out and no new blocks appear
+  EFFECT_CROESUS,    // score gained is multiplied, stackable
+  EFFECT_POOR,       // score gained is reduced
+  EFFECT_GHOST,      // player can pass through walls and bombs
+  EFFECT_SHIELD,     // player is unharmed by bombs
+  EFFECT_BACKWARDS,  // controls are inverted
+  EFFECT_KIND_COUNT
+};
+
 /*
  * effects that objects can give to the player
  */
 struct Effect {
-  Effect() : score(0), life(0) { }
+  Effect() : score(0), life(0), timed(EFFECT_NONE), duration(0) { }
   Sint16 score;
   Sint16 life;
+  // timed effect to start (or stack onto an already active one) and
+  // how many ms it should last
+  EFFECT_KIND timed;
+  Uint32 duration;
+};
+
+/*
+ * The combined result of all currently active timed effects. This is
+ * only recalculated when an effect starts or expires, so it's cheap
+ * to consult as often as needed.
+ */
+struct EffectModifiers {
+  EffectModifiers()
+    : move_delay_percent(100), score_percent(100), freeze(false),
+      ghost(false), shield(false), backwards(false) { }
+  Uint32 move_delay_percent;
+  Uint32 score_percent;
+  bool freeze;
+  bool ghost;
+  bool shield;
+  bool backwards;
+};
+
+/*
+ * Small fixed size table of the timed effects active on a player.
+ * Each effect expires at a deadline on the table's own clock, so
+ * update() only does any real work when the nearest deadline has
+ * passed.
+ */
+class ActiveEffects {
+public:
+  static const Uint32 CAPACITY = 8;
+
+  ActiveEffects();
+
+  // Start a timed effect, following the stacking rules for its kind
+  void add(EFFECT_KIND kind, Uint32 duration);
+  // Advance the clock and expire whatever has run out
+  void update(Uint32 delta_time);
+  // Dying takes away all powerups, but powerdowns only get their
+  // remaining time cut in half - otherwise sacrificing a life would
+  // be a cheap way to get rid of them.
+  void playerDied();
+  void clear();
+
+  const EffectModifiers& modifiers() const { return m_modifiers; }
+  Uint32 count() const { return m_count; }
+  // stack level of the given effect, 0 if it's not active
+  Uint16 level(EFFECT_KIND kind) const;
+  // ms left before the given effect runs out, 0 if it's not active
+  Uint32 remaining(EFFECT_KIND kind) const;
+
+  void saveState(SnapshotWriter& out) const;
+  void restoreState(SnapshotReader& in);
+
+private:
+  struct Slot {
+    EFFECT_KIND kind;
+    Uint16 level;
+    Uint32 deadline;
+  };
+
+  // index of the slot holding 'kind', or CAPACITY if it's not active
+  Uint32 find(EFFECT_KIND kind) const;
+  void expire();
+  void recalculate();
+
+  Slot m_slots[CAPACITY];
+  Uint32 m_count;
+  Uint32 m_now;
+  Uint32 m_next_deadline;
+  EffectModifiers m_modifiers;
 };
 
 #endif
@@ -0,0 +1,110 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iterator>
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include "except.hh"
+#include "glyphatlas.hh"
+#include "fontmanager.hh"
+
+FontManager::FontManager()
+  : m_files(), m_fonts(), m_atlases(), m_atlas_count(0), m_clock(0)
+{
+}
+
+FontManager::~FontManager()
+{
+  clear();
+}
+
+TTF_Font* FontManager::font(const std::string& path, int ptsize)
+{
+  const std::pair<std::string, int> key(path, ptsize);
+  std::map<std::pair<std::string, int>, TTF_Font*>::iterator it = m_fonts.find(key);
+  if (it != m_fonts.end())
+    return it->second;
+
+  std::vector<Uint8>& data = m_files[path];
+  if (data.empty()) {
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (data.empty()) {
+      m_files.erase(path);
+      throw Exception("Unable to read font '" + path + "'");
+    }
+  }
+
+  SDL_RWops* rw = SDL_RWFromConstMem(&data[0], data.size());
+  TTF_Font* font = rw ? TTF_OpenFontRW(rw, 1, ptsize) : 0;
+  if (!font)
+    throw Exception("Unable to open font '" + path + "': " + std::string(TTF_GetError()));
+  m_fonts[key] = font;
+  return font;
+}
+
+const GlyphAtlas* FontManager::atlas(TTF_Font* font, const SDL_Color& color)
+{
+  const std::pair<TTF_Font*, Uint32> key(font, (color.r << 16) | (color.g << 8) | color.b);
+  AtlasMap::iterator it = m_atlases.find(key);
+  if (it == m_atlases.end()) {
+    // don't let colours seen once or twice pile up
+    if (m_atlases.size() > 4 * MAX_ATLASES) {
+      for (AtlasMap::iterator victim = m_atlases.begin(); victim != m_atlases.end();) {
+        if (!victim->second.atlas)
+          m_atlases.erase(victim++);
+        else
+          ++victim;
+      }
+    }
+    AtlasEntry entry = { 0, 0, 0 };
+    it = m_atlases.insert(std::make_pair(key, entry)).first;
+  }
+
+  AtlasEntry& entry = it->second;
+  entry.last_used = ++m_clock;
+  if (entry.atlas)
+    return entry.atlas;
+  if (++entry.uses < ATLAS_AFTER)
+    return 0;
+
+  if (m_atlas_count == MAX_ATLASES) {
+    AtlasMap::iterator oldest = m_atlases.end();
+    for (AtlasMap::iterator victim = m_atlases.begin(); victim != m_atlases.end(); ++victim) {
+      if (victim->second.atlas && (oldest == m_atlases.end()
+                                   || victim->second.last_used < oldest->second.last_used))
+        oldest = victim;
+    }
+    delete oldest->second.atlas;
+    m_atlases.erase(oldest);
+    --m_atlas_count;
+  }
+  entry.atlas = new GlyphAtlas(font, color);
+  ++m_atlas_count;
+  return entry.atlas;
+}
+
+void FontManager::clear()
+{
+  for (AtlasMap::iterator it = m_atlases.begin(); it != m_atlases.end(); ++it)
+    delete it->second.atlas;
+  m_atlases.clear();
+  m_atlas_count = 0;
+  for (std::map<std::pair<std::string, int>, TTF_Font*>::iterator it = m_fonts.begin();
+       it != m_fonts.end(); ++it)
+    TTF_CloseFont(it->second);
+  m_fonts.clear();
+  m_files.clear();
+}
+
+FontManager& fonts()
+{
+  static FontManager manager;
+  return manager;
+}
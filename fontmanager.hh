@@ -0,0 +1,70 @@
+/*
+ * Fonts shared by everything that draws text. Each font file is read
+ * into memory once, and opened at each point size asked for once;
+ * after that getting a font is a lookup. Fixed width fonts also get
+ * glyph atlases, one per colour. TTF_Init() must have been
+ * called before asking for one and clear() before TTF_Quit().
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_FONTMANAGER_HH
+#define BNB_FONTMANAGER_HH
+
+#include <string>
+#include <vector>
+#include <map>
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+class GlyphAtlas;
+
+class FontManager {
+public:
+  FontManager();
+  ~FontManager();
+
+  // 'path' at 'ptsize'. The font stays open until clear(), so don't
+  // close it or change its style. Throws if it can't be opened.
+  TTF_Font* font(const std::string& path, int ptsize);
+
+  static const Uint32 MAX_ATLASES = 16;
+  // atlas() calls, not frames, for a font and colour before they get
+  // an atlas
+  static const Uint32 ATLAS_AFTER = 3;
+
+  // The glyph atlas of 'font', which must be fixed width and come
+  // from font(), in 'color'. Returns 0 for colours that haven't been
+  // asked for ATLAS_AFTER times - colours being faded through aren't
+  // worth rendering every glyph for. The least recently used atlas
+  // goes when there are too many.
+  const GlyphAtlas* atlas(TTF_Font* font, const SDL_Color& color);
+
+  // Closes all fonts, frees the atlases and forgets the files
+  void clear();
+
+private:
+  FontManager(const FontManager&);
+  FontManager& operator=(const FontManager&);
+
+  // SDL_ttf reads glyphs from the file data as it needs them, so it
+  // has to stay around as long as any size of the font is open
+  std::map<std::string, std::vector<Uint8> > m_files;
+  std::map<std::pair<std::string, int>, TTF_Font*> m_fonts;
+  struct AtlasEntry {
+    GlyphAtlas* atlas;
+    Uint32 uses;
+    Uint64 last_used;
+  };
+  typedef std::map<std::pair<TTF_Font*, Uint32>, AtlasEntry> AtlasMap;
+  // by font and RGB colour, including colours without an atlas yet
+  AtlasMap m_atlases;
+  Uint32 m_atlas_count;
+  Uint64 m_clock;
+};
+
+// The fonts the whole game shares
+FontManager& fonts();
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <SDL.h>
+#include "util.hh"
+#include "framescheduler.hh"
+
+FrameScheduler::FrameScheduler(Uint32 interval)
+  : m_interval(std::max<Uint32>(interval, 1)), m_next(0), m_last(0), m_frames(0),
+    m_coalesced(0), m_late_micros(0), m_max_late(0), m_histogram(BUCKETS)
+{
+}
+
+void FrameScheduler::setInterval(Uint32 interval)
+{
+  interval = std::max<Uint32>(interval, 1);
+  if (interval == m_interval)
+    return;
+  m_interval = interval;
+  // Coming out of a slow stretch the new deadline is usually already
+  // behind us; that frame isn't late, it's the first one at the new rate.
+  m_next = std::max(m_last + interval, util::timeMicros());
+}
+
+void FrameScheduler::start()
+{
+  m_last = util::timeMicros();
+  m_next = m_last;
+}
+
+bool FrameScheduler::wait()
+{
+  const uint64_t now = util::timeMicros();
+  if (now >= m_next)
+    return true;
+  const uint64_t left = m_next - now;
+  const Uint32 spin = m_interval <= MAX_SPIN_INTERVAL ? SPIN_MICROS : 0;
+  if (left > spin) {
+    // Rounded up, so we never go around doing zero length sleeps;
+    // at worst that eats into the time left for spinning.
+    SDL_Delay((std::min<uint64_t>(left - spin, MAX_SLEEP_MICROS) + 999) / 1000);
+    return false;
+  }
+  while (util::timeMicros() < m_next)
+    ;
+  return true;
+}
+
+Uint32 FrameScheduler::beginFrame()
+{
+  const uint64_t now = util::timeMicros();
+  const uint64_t late = now > m_next ? now - m_next : 0;
+  const Uint32 missed = late / m_interval;
+  m_next += static_cast<uint64_t>(missed + 1) * m_interval;
+  m_last = now;
+
+  ++m_frames;
+  m_coalesced += missed;
+  m_late_micros += late;
+  m_max_late = std::max(m_max_late, late);
+  ++m_histogram[std::min<uint64_t>(late / BUCKET_MICROS, BUCKETS - 1)];
+  return missed;
+}
+
+uint64_t FrameScheduler::percentile(Uint32 percent) const
+{
+  const uint64_t wanted = (static_cast<uint64_t>(m_frames) * percent + 99) / 100;
+  uint64_t seen = 0;
+  for (Uint32 i = 0; i < BUCKETS - 1; ++i) {
+    seen += m_histogram[i];
+    if (seen >= wanted)
+      return std::min<uint64_t>((i + 1) * BUCKET_MICROS, m_max_late);
+  }
+  return m_max_late;
+}
+
+void FrameScheduler::report() const
+{
+  if (m_frames)
+    std::cout << "pacing: ran " << m_frames << " frames, " << m_coalesced
+              << " ticks skipped, frames started late by " << m_late_micros / m_frames
+              << "us on average, p50 " << percentile(50) << "us, p99 " << percentile(99)
+              << "us, max " << m_max_late << "us" << std::endl;
+}
@@ -0,0 +1,73 @@
+/*
+ * Decides when the next frame is due. Frames start on a fixed grid of
+ * deadlines measured on the monotonic clock; waiting for one sleeps
+ * most of the way and, at the usual frame rates, spins the last
+ * stretch, since sleeps tend to overshoot by up to a millisecond. A
+ * frame that runs long doesn't leave a backlog of ticks behind it -
+ * the ticks it overran are skipped and counted. How late each frame
+ * started is recorded for the benchmarks.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_FRAMESCHEDULER_HH
+#define BNB_FRAMESCHEDULER_HH
+
+#include <vector>
+#include <SDL.h>
+#include "util.hh"
+
+class FrameScheduler {
+public:
+  // how close to a deadline we stop sleeping and start spinning
+  static const Uint32 SPIN_MICROS = 1000;
+  // Slower frame rates are there to save power; they don't spin at
+  // all and put up with sleeping a little past the deadline.
+  static const Uint32 MAX_SPIN_INTERVAL = 50000;
+  // longest single sleep, so the caller gets to look at input often
+  static const Uint32 MAX_SLEEP_MICROS = 10000;
+  // resolution and range of the lateness histogram
+  static const Uint32 BUCKET_MICROS = 250;
+  static const Uint32 BUCKETS = 80;
+
+  // A frame every 'interval' microseconds
+  explicit FrameScheduler(Uint32 interval);
+
+  // Changing it moves the next deadline to 'interval' after the
+  // start of the last frame, or now if that has already gone by.
+  void setInterval(Uint32 interval);
+  Uint32 interval() const { return m_interval; }
+
+  // Makes the first frame due right away
+  void start();
+  // Waits towards the next deadline. Returns true once it's reached,
+  // false if it gave up after a sleep so the caller can handle input
+  // and call again.
+  bool wait();
+  // Call as each frame starts. Returns how many ticks went by unused
+  // since the last frame.
+  Uint32 beginFrame();
+
+  Uint32 frames() const { return m_frames; }
+  Uint32 coalesced() const { return m_coalesced; }
+  // Prints how late frames started, if any were run
+  void report() const;
+
+private:
+  FrameScheduler(const FrameScheduler&);
+  FrameScheduler& operator=(const FrameScheduler&);
+  // lateness below which 'percent' percent of frames started
+  uint64_t percentile(Uint32 percent) const;
+
+  Uint32 m_interval;
+  uint64_t m_next;
+  uint64_t m_last;
+  Uint32 m_frames;
+  Uint32 m_coalesced;
+  uint64_t m_late_micros;
+  uint64_t m_max_late;
+  std::vector<Uint32> m_histogram;
+};
+
+#endif
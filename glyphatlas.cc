@@ -0,0 +1,87 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <string>
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include "except.hh"
+#include "blit.hh"
+#include "glyphatlas.hh"
+
+GlyphAtlas::GlyphAtlas(TTF_Font* font, const SDL_Color& color)
+  : m_surface(0), m_advance(0), m_height(TTF_FontHeight(font))
+{
+  int minx, maxx, miny, maxy, advance;
+  if (TTF_GlyphMetrics(font, 'M', &minx, &maxx, &miny, &maxy, &advance) == -1 || advance <= 0)
+    throw Exception("Unable to get glyph metrics: " + std::string(TTF_GetError()));
+  m_advance = advance;
+
+  const int count = LAST - FIRST + 1;
+  for (int i = 0; i < count; ++i) {
+    // Each glyph rendered on its own lands in its cell just where it
+    // would in a string, as long as the font is fixed width.
+    const char text[2] = { static_cast<char>(FIRST + i), 0 };
+    SDL_Surface* glyph = TTF_RenderText_Blended(font, text, color);
+    if (!glyph) {
+      if (text[0] == ' ')
+        continue;  // some SDL_ttf versions won't render blank text
+      if (m_surface)
+        SDL_FreeSurface(m_surface);
+      throw Exception("Unable to render glyph: " + std::string(TTF_GetError()));
+    }
+
+    if (!m_surface) {
+      const SDL_PixelFormat* fmt = glyph->format;
+      m_surface = SDL_CreateRGBSurface(SDL_SWSURFACE, count * m_advance, m_height,
+                                       fmt->BitsPerPixel, fmt->Rmask, fmt->Gmask,
+                                       fmt->Bmask, fmt->Amask);
+      if (!m_surface) {
+        SDL_FreeSurface(glyph);
+        throw Exception("Unable to create glyph atlas: " + std::string(SDL_GetError()));
+      }
+      SDL_FillRect(m_surface, 0, 0);
+    }
+
+    // copy, alpha and all, rather than blend
+    SDL_SetAlpha(glyph, 0, SDL_ALPHA_OPAQUE);
+    SDL_Rect src = { 0, 0, m_advance, m_height };
+    SDL_Rect dst = { static_cast<Sint16>(i * m_advance), 0, 0, 0 };
+    SDL_BlitSurface(glyph, &src, m_surface, &dst);
+    SDL_FreeSurface(glyph);
+  }
+  if (!m_surface)
+    throw Exception("Unable to render glyphs: " + std::string(TTF_GetError()));
+  SDL_SetAlpha(m_surface, SDL_SRCALPHA, SDL_ALPHA_OPAQUE);
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+  SDL_FreeSurface(m_surface);
+}
+
+bool GlyphAtlas::covers(const std::string& text)
+{
+  for (std::string::const_iterator it = text.begin(); it != text.end(); ++it) {
+    if (*it < FIRST || *it > LAST)
+      return false;
+  }
+  return true;
+}
+
+void GlyphAtlas::render(SDL_Surface* dest, SDL_Rect* dst, const std::string& text) const
+{
+  const Sint16 x = dst->x;
+  const Sint16 y = dst->y;
+  SDL_Rect src = { 0, 0, m_advance, m_height };
+  for (std::string::size_type i = 0; i < text.size(); ++i) {
+    if (text[i] == ' ')
+      continue;
+    src.x = (text[i] - FIRST) * m_advance;
+    SDL_Rect pos = { static_cast<Sint16>(x + i * m_advance), y, 0, 0 };
+    blit::blitSurface(m_surface, &src, dest, &pos);
+  }
+  dst->w = text.size() * m_advance;
+  dst->h = m_height;
+}
@@ -0,0 +1,47 @@
+/*
+ * All printable ASCII characters of a fixed width font, rendered once
+ * in one colour side by side on a single surface. Text in that font
+ * and colour is then laid out at a constant advance and drawn a glyph
+ * at a time straight from the atlas, instead of being rasterized and
+ * blended by SDL_ttf into a new surface every time it is drawn.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_GLYPHATLAS_HH
+#define BNB_GLYPHATLAS_HH
+
+#include <string>
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+class GlyphAtlas {
+public:
+  static const char FIRST = ' ';
+  static const char LAST = '~';
+
+  // 'font' must be fixed width. Throws if it can't be rendered.
+  GlyphAtlas(TTF_Font* font, const SDL_Color& color);
+  ~GlyphAtlas();
+
+  // Is every character of 'text' in the atlas?
+  static bool covers(const std::string& text);
+
+  // Draws 'text' with its top left corner at dst's x and y and sets
+  // dst's w and h to the size of the text - the same as blitting what
+  // TTF_RenderText_Blended() would have made. Allocates nothing.
+  void render(SDL_Surface* dest, SDL_Rect* dst, const std::string& text) const;
+
+  Uint16 advance() const { return m_advance; }
+  Uint16 height() const { return m_height; }
+
+private:
+  GlyphAtlas(const GlyphAtlas&);
+  GlyphAtlas& operator=(const GlyphAtlas&);
+  SDL_Surface* m_surface;
+  Uint16 m_advance;
+  Uint16 m_height;
+};
+
+#endif
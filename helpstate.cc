@@ -24,6 +24,6 @@ STATE_CHANGE HelpState::update(Uint32)
   return NO_CHANGE;
 }
 
-void HelpState::draw(SDL_Surface*)
+void HelpState::draw(SDL_Surface*, DirtyRects&)
 {
 }
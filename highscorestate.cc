@@ -24,6 +24,6 @@ STATE_CHANGE  HighscoreState::update(Uint32)
   return NO_CHANGE;
 }
 
-void HighscoreState::draw(SDL_Surface*)
+void HighscoreState::draw(SDL_Surface*, DirtyRects&)
 {
 }
@@ -15,7 +15,7 @@ public:
   ~HighscoreState();
   STATE_CHANGE handleKey(const SDL_KeyboardEvent& key);
   STATE_CHANGE update(Uint32 delta_time);
-  void draw(SDL_Surface* screen);
+  void draw(SDL_Surface* screen, DirtyRects& dirty);
 };
 
 #endif
@@ -0,0 +1,157 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <SDL.h>
+#include "util.hh"
+#include "effects.hh"
+#include "resources.hh"
+#include "playstate.hh"
+#include "hud.hh"
+
+namespace {
+  const Uint16 MARGIN = 8;
+
+  const SDL_Color TEXT_COLOR = { 50, 250, 50, 0 };
+  // indexed by BLOCK_COLOR, then blocks of any colour
+  const SDL_Color BLOCK_COLORS[] = {
+    { 250, 60, 60, 0 },
+    { 50, 250, 50, 0 },
+    { 90, 130, 250, 0 },
+    { 250, 250, 60, 0 },
+    { 210, 80, 250, 0 },
+    { 60, 230, 230, 0 },
+    { 220, 220, 220, 0 }
+  };
+  const char* const BLOCK_NAMES[] = {
+    "Red", "Green", "Blue", "Yellow", "Purple", "Cyan", "Any"
+  };
+  const Uint32 BLOCK_LINES = sizeof(BLOCK_NAMES) / sizeof(BLOCK_NAMES[0]);
+
+  // indexed by EFFECT_KIND
+  const char* const EFFECT_NAMES[] = {
+    "", "Swift", "Slow", "Freeze", "Croesus", "Poor", "Ghost", "Shield", "Backwards"
+  };
+}
+
+Hud::Hud(const SDL_Rect& area)
+  : m_writer("whitrabt.ttf", 20), m_area(area), m_lines(), m_score_line(0),
+    m_lives_line(0), m_blocks_line(0), m_effects_line(0), m_practice_line(0),
+    m_practice(false), m_score(0), m_shown_score(0),
+    m_advance(0), m_line_height(0)
+{
+  m_advance = m_writer.sizeText("0").w;
+  m_line_height = m_writer.lineSkip();
+
+  m_score_line = addLine(TEXT_COLOR, MARGIN);
+  m_lives_line = addLine(TEXT_COLOR);
+  addLine(TEXT_COLOR, m_line_height / 2, "Blocks left");
+  m_blocks_line = m_lines.size();
+  for (Uint32 i = 0; i < BLOCK_LINES; ++i)
+    addLine(BLOCK_COLORS[i]);
+  addLine(TEXT_COLOR, m_line_height / 2, "Effects");
+  m_effects_line = m_lines.size();
+  for (Uint32 i = 0; i < ActiveEffects::CAPACITY; ++i)
+    addLine(TEXT_COLOR);
+  m_practice_line = addLine(TEXT_COLOR, m_line_height / 2);
+}
+
+Uint32 Hud::addLine(const SDL_Color& color, Uint16 gap, const std::string& text)
+{
+  Line line(text, color);
+  line.rect.x = m_area.x + MARGIN;
+  line.rect.y = m_lines.empty() ? m_area.y : m_lines.back().rect.y + m_line_height;
+  line.rect.y += gap;
+  line.rect.w = text.size() * m_advance;
+  line.rect.h = m_line_height;
+  m_lines.push_back(line);
+  return m_lines.size() - 1;
+}
+
+void Hud::update(Uint32 delta_time)
+{
+  if (m_shown_score == m_score)
+    return;
+  // Close the same share of the gap every frame, so the roll takes
+  // about ROLL_TIME however far it goes, but always move a point.
+  const Uint32 distance = m_score > m_shown_score ? m_score - m_shown_score
+                                                  : m_shown_score - m_score;
+  const Uint32 step = std::min(distance, std::max(1u, static_cast<Uint32>(
+    static_cast<Uint64>(distance) * delta_time * 4 / ROLL_TIME)));
+  if (m_score > m_shown_score)
+    m_shown_score += step;
+  else
+    m_shown_score -= step;
+}
+
+void Hud::markDirty(const Player& player, const LevelResource& level, DirtyRects& dirty)
+{
+  m_score = player.score();
+  setText(m_score_line, "Score: " + util::uint2str(m_shown_score, SCORE_DIGITS), dirty);
+  setText(m_lives_line, "Lives: " + util::uint2str(player.livesLeft()), dirty);
+
+  const Uint32 remaining[] = {
+    level.remainingRed(), level.remainingGreen(), level.remainingBlue(),
+    level.remainingYellow(), level.remainingPurple(), level.remainingCyan(),
+    level.remainingArbitrary()
+  };
+  for (Uint32 i = 0; i < BLOCK_LINES; ++i)
+    setText(m_blocks_line + i, util::fmt2str("%-8s%3u", BLOCK_NAMES[i], remaining[i]), dirty);
+
+  const ActiveEffects& effects = player.effects();
+  Uint32 line = m_effects_line;
+  for (int kind = EFFECT_NONE + 1; kind < EFFECT_KIND_COUNT; ++kind) {
+    const EFFECT_KIND k = static_cast<EFFECT_KIND>(kind);
+    const Uint16 level = effects.level(k);
+    if (!level)
+      continue;
+    std::string name(EFFECT_NAMES[kind]);
+    if (level > 1)
+      name += " x" + util::uint2str(level);
+    // whole seconds left, rounded up
+    const Uint32 seconds = (effects.remaining(k) + 999) / 1000;
+    setText(line++, util::fmt2str("%-10s%3us", name.c_str(), seconds), dirty);
+  }
+  for (; line < m_effects_line + ActiveEffects::CAPACITY; ++line)
+    setText(line, "", dirty);
+
+  setText(m_practice_line, m_practice ? "Practice mode" : "", dirty);
+}
+
+void Hud::setText(Uint32 index, const std::string& text, DirtyRects& dirty)
+{
+  Line& line = m_lines[index];
+  if (line.text == text)
+    return;
+
+  SDL_Rect changed = line.rect;
+  changed.w = std::max(line.text.size(), text.size()) * m_advance;
+  if (line.text.size() == text.size()) {
+    std::string::size_type first = 0;
+    while (line.text[first] == text[first])
+      ++first;
+    std::string::size_type last = text.size() - 1;
+    while (line.text[last] == text[last])
+      --last;
+    changed.x += first * m_advance;
+    changed.w = (last - first + 1) * m_advance;
+  }
+  line.text = text;
+  line.rect.w = text.size() * m_advance;
+  dirty.add(changed);
+}
+
+void Hud::draw(SDL_Surface* screen, const SDL_Rect* area)
+{
+  for (std::vector<Line>::iterator it = m_lines.begin(); it != m_lines.end(); ++it) {
+    if (it->text.empty() || (area && !intersects(*area, it->rect)))
+      continue;
+    SDL_Rect r = it->rect;
+    m_writer.setFontColor(it->color);
+    m_writer.render(screen, &r, it->text);
+  }
+}
@@ -0,0 +1,86 @@
+/*
+ * The status panel next to the board: score, lives, blocks left of
+ * each colour, the active effects and whether practice mode is on.
+ * Each line is a widget that remembers what it last drew, and only the
+ * lines whose text changed are marked dirty. The score rolls toward
+ * the player's actual score rather than jumping, redrawing just the
+ * digits that changed, which come straight from the font's glyph
+ * atlas.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_HUD_HH
+#define BNB_HUD_HH
+
+#include <string>
+#include <vector>
+#include <SDL.h>
+#include "textwriter.hh"
+#include "dirtyrects.hh"
+
+class Player;
+class LevelResource;
+
+class Hud {
+public:
+  // Time for the score to roll to a new value
+  static const Uint32 ROLL_TIME = 400;
+  static const Uint32 SCORE_DIGITS = 8;
+
+  // Lays the panel out within 'area'
+  Hud(const SDL_Rect& area);
+
+  // Rolls the score along
+  void update(Uint32 delta_time);
+  // Stop rolling and show 'score' as it is, for when the game jumps
+  // (rewinding, loading)
+  void snap(Uint32 score) { m_score = m_shown_score = score; }
+  // Shown from the next markDirty() on
+  void setPractice(bool on) { m_practice = on; }
+  // Catches up with the player and level, adding the lines that
+  // changed since they were last drawn to 'dirty'.
+  void markDirty(const Player& player, const LevelResource& level, DirtyRects& dirty);
+  // Draws the lines overlapping 'area', everything if 0. The screen's
+  // clip rectangle is left alone, so only what it allows is touched.
+  void draw(SDL_Surface* screen, const SDL_Rect* area);
+
+private:
+  Hud(const Hud&);
+  Hud& operator=(const Hud&);
+
+  struct Line {
+    Line(const std::string& t, const SDL_Color& c) : text(t), color(c), rect() { }
+    std::string text;
+    SDL_Color color;
+    // where the text is
+    SDL_Rect rect;
+  };
+  // Adds a line 'gap' pixels below the last one. Lines that never
+  // change get their text right away.
+  Uint32 addLine(const SDL_Color& color, Uint16 gap = 0, const std::string& text = "");
+  // Marks what changes between the line's text and 'text'. The font
+  // is fixed width, so when the length stays the same that's just
+  // the characters that differ.
+  void setText(Uint32 line, const std::string& text, DirtyRects& dirty);
+
+  TextWriter m_writer;
+  SDL_Rect m_area;
+  std::vector<Line> m_lines;
+  // indexes into m_lines
+  Uint32 m_score_line;
+  Uint32 m_lives_line;
+  Uint32 m_blocks_line;
+  Uint32 m_effects_line;
+  Uint32 m_practice_line;
+
+  bool m_practice;
+  // the score being rolled to and where the roll has got to
+  Uint32 m_score;
+  Uint32 m_shown_score;
+  Uint16 m_advance;
+  Uint16 m_line_height;
+};
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <string>
+#include <SDL.h>
+#include "except.hh"
+#include "layercache.hh"
+
+LayerCache::LayerCache()
+  : m_cache(0), m_valid(false)
+{
+}
+
+LayerCache::~LayerCache()
+{
+  SDL_FreeSurface(m_cache);
+}
+
+bool LayerCache::stale(Uint16 width, Uint16 height) const
+{
+  return !m_valid || !m_cache || m_cache->w != width || m_cache->h != height;
+}
+
+SDL_Surface* LayerCache::begin(Uint16 width, Uint16 height)
+{
+  m_valid = false;
+  if (m_cache && (m_cache->w != width || m_cache->h != height)) {
+    SDL_FreeSurface(m_cache);
+    m_cache = 0;
+  }
+  if (!m_cache) {
+    const SDL_PixelFormat* fmt = SDL_GetVideoSurface()->format;
+    m_cache = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, fmt->BitsPerPixel,
+                                   fmt->Rmask, fmt->Gmask, fmt->Bmask, 0);
+    if (!m_cache)
+      throw Exception("Unable to create layer cache surface: " + std::string(SDL_GetError()));
+  }
+  return m_cache;
+}
+
+void LayerCache::submit(RenderQueue& queue) const
+{
+  SDL_Rect all;
+  all.x = all.y = 0;
+  all.w = m_cache->w;
+  all.h = m_cache->h;
+  queue.submit(m_cache, all, 0, 0, RenderQueue::LAYER_BACKGROUND);
+}
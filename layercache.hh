@@ -0,0 +1,48 @@
+/*
+ * Cache for the static layers of a screen - backgrounds, grids,
+ * panel backdrops - that would otherwise be composed again every
+ * frame to produce the same pixels. The owner draws the layers once
+ * onto the surface begin() hands out, and after that each frame
+ * starts from a single opaque copy of the cache. The cache is rebuilt
+ * when the screen size changes or when the owner invalidates it (new
+ * level, new theme).
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_LAYERCACHE_HH
+#define BNB_LAYERCACHE_HH
+
+#include <SDL.h>
+#include "renderqueue.hh"
+
+class LayerCache {
+public:
+  LayerCache();
+  ~LayerCache();
+
+  // Does the cache need (re)building for a screen this size?
+  bool stale(Uint16 width, Uint16 height) const;
+  void invalidate() { m_valid = false; }
+
+  // Returns the surface to compose the layers on, in the display
+  // format without alpha so copying it out is a plain copy. Call
+  // done() once everything is drawn.
+  SDL_Surface* begin(Uint16 width, Uint16 height);
+  void done() { m_valid = true; }
+
+  // Queues the cache to be copied to the screen, as the bottom layer
+  void submit(RenderQueue& queue) const;
+
+  // memory held by the cache
+  Uint32 bytes() const { return m_cache ? m_cache->h * m_cache->pitch : 0; }
+
+private:
+  LayerCache(const LayerCache&);
+  LayerCache& operator=(const LayerCache&);
+  SDL_Surface* m_cache;
+  bool m_valid;
+};
+
+#endif
@@ -0,0 +1,367 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <string>
+#include <sstream>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <SDL.h>
+#include <SDL_thread.h>
+#include "except.hh"
+#include "util.hh"
+#include "cube.hh"
+#include "resources.hh"
+#include "simulation.hh"
+#include "threadpool.hh"
+#include "levelgen.hh"
+
+namespace {
+  // Candidates made per CPU in each round, and how many rounds we try
+  // before giving up and handing out an empty board.
+  const Uint32 CANDIDATES_PER_THREAD = 4;
+  const Uint32 MAX_ROUNDS = 8;
+  // Quick playthroughs per candidate and how long each may last
+  const Uint32 PLAYTESTS = 8;
+  const Uint32 MAX_PLAYTEST_TIME = 180000;
+
+  void setProperty(std::map<std::string, std::string>& properties,
+                   const std::string& key, Uint32 value)
+  {
+    properties[key] = util::fmt2str("%u", value);
+  }
+
+  Uint32 property(const std::map<std::string, std::string>& properties,
+                  const std::string& key)
+  {
+    std::map<std::string, std::string>::const_iterator it = properties.find(key);
+    return it == properties.end() ? 0 : strtoul(it->second.c_str(), 0, 10);
+  }
+
+  // How long (ms) a random player should survive on 'level'. Later
+  // levels get harder until they level out.
+  Uint32 targetSurvival(Uint32 level)
+  {
+    return std::max<Sint32>(150000 - 6000 * static_cast<Sint32>(level), 20000);
+  }
+
+  // Level properties scale with the level number, walls are a mix of
+  // short straight runs, sometimes mirrored to look less random.
+  LevelDescription makeLevel(Uint32 level, Uint32 seed)
+  {
+    util::Random random(seed);
+    LevelDescription desc;
+    std::map<std::string, std::string>& p = desc.properties;
+    const Sint32 n = level;
+    setProperty(p, "player_move_delay", 120);
+    setProperty(p, "block_to_wall_delay", std::max<Sint32>(12000 - 300 * n, 5000));
+    setProperty(p, "delay_between_blocks", std::max<Sint32>(11000 - 400 * n, 3000));
+    setProperty(p, "successful_pickup_delay_reduction", 10 + n);
+    setProperty(p, "failed_pickup_delay_reduction", 100 + 5 * n);
+    setProperty(p, "bomb_chance", std::min<Sint32>(20 + 2 * n, 50));
+    setProperty(p, "bomb_fuse", std::max<Sint32>(4000 - 100 * n, 2000));
+    setProperty(p, "bomb_radius", std::min<Sint32>(1 + n / 10, 3));
+    const char* colors[] = { "red", "green", "blue", "purple", "yellow", "cyan" };
+    for (int i = 0; i < 6; ++i)
+      setProperty(p, std::string("to_win_") + colors[i], 3 + n / 4);
+    setProperty(p, "to_win_arbitrary", 5 + n / 2);
+    setProperty(p, "random_seed", seed);
+    p["background_image"] = "default-background.png";
+
+    desc.map.assign(LEVEL_WIDTH * LEVEL_HEIGHT, LEVEL_EMPTY);
+    const Uint32 runs = std::min<Uint32>(3 + level / 2, 20);
+    const bool mirror = random.next(2);
+    for (Uint32 i = 0; i < runs; ++i) {
+      const bool horizontal = random.next(2);
+      const Uint32 length = 2 + random.next(4);
+      Uint32 x = random.next(LEVEL_WIDTH);
+      Uint32 y = random.next(LEVEL_HEIGHT);
+      for (Uint32 j = 0; j < length && x < LEVEL_WIDTH && y < LEVEL_HEIGHT; ++j) {
+        desc.map[y * LEVEL_WIDTH + x] = LEVEL_WALL;
+        if (mirror)
+          desc.map[y * LEVEL_WIDTH + LEVEL_WIDTH - 1 - x] = LEVEL_WALL;
+        if (horizontal)
+          ++x;
+        else
+          ++y;
+      }
+    }
+
+    // start on a random free tile
+    for (;;) {
+      const Uint32 start = random.next(LEVEL_WIDTH * LEVEL_HEIGHT);
+      if (desc.map[start] == LEVEL_EMPTY) {
+        desc.map[start] = LEVEL_PLAYER;
+        break;
+      }
+    }
+    return desc;
+  }
+
+  // Every free tile must be reachable from the start, with every
+  // colour on top - blocks can turn up anywhere.
+  bool playable(const LevelDescription& desc)
+  {
+    const Uint32 tiles = LEVEL_WIDTH * LEVEL_HEIGHT;
+    const Uint32 start = std::find(desc.map.begin(), desc.map.end(), LEVEL_PLAYER)
+      - desc.map.begin();
+
+    std::vector<Uint8> colors(tiles, 0);
+    std::vector<bool> seen(tiles * cube::ORIENTATIONS, false);
+    std::vector<Uint32> queue;
+    queue.reserve(tiles * cube::ORIENTATIONS);
+    const Uint8 initial = cube::initialOrientation();
+    queue.push_back(start * cube::ORIENTATIONS + initial);
+    seen[queue.back()] = true;
+
+    for (Uint32 head = 0; head < queue.size(); ++head) {
+      const Uint32 tile = queue[head] / cube::ORIENTATIONS;
+      const Uint8 o = queue[head] % cube::ORIENTATIONS;
+      colors[tile] |= 1 << cube::top(o);
+
+      const Uint32 x = tile % LEVEL_WIDTH;
+      const Uint32 y = tile / LEVEL_WIDTH;
+      for (int d = 0; d < 4; ++d) {
+        Uint32 next;
+        switch (d) {
+        case cube::ROLL_UP:
+          if (y == 0) continue;
+          next = tile - LEVEL_WIDTH;
+          break;
+        case cube::ROLL_DOWN:
+          if (y == LEVEL_HEIGHT - 1) continue;
+          next = tile + LEVEL_WIDTH;
+          break;
+        case cube::ROLL_LEFT:
+          if (x == 0) continue;
+          next = tile - 1;
+          break;
+        default:
+          if (x == LEVEL_WIDTH - 1) continue;
+          next = tile + 1;
+          break;
+        }
+        if (desc.map[next] == LEVEL_WALL)
+          continue;
+        const Uint32 state = next * cube::ORIENTATIONS
+          + cube::roll(o, static_cast<cube::ROLL_DIRECTION>(d));
+        if (!seen[state]) {
+          seen[state] = true;
+          queue.push_back(state);
+        }
+      }
+    }
+
+    for (Uint32 i = 0; i < tiles; ++i) {
+      if (desc.map[i] != LEVEL_WALL && colors[i] != 0x3f)
+        return false;
+    }
+    return true;
+  }
+
+  // Average time a player making random moves survives the level
+  Uint32 survival(const LevelDescription& desc, Uint32 seed)
+  {
+    const std::map<std::string, std::string>& p = desc.properties;
+    SimBoard::Params params;
+    params.move_delay = property(p, "player_move_delay");
+    params.block_to_wall_delay = property(p, "block_to_wall_delay");
+    params.delay_between_blocks = property(p, "delay_between_blocks");
+    params.successful_pickup_delay_reduction = property(p, "successful_pickup_delay_reduction");
+    params.failed_pickup_delay_reduction = property(p, "failed_pickup_delay_reduction");
+    params.bomb_chance = property(p, "bomb_chance");
+    params.bomb_fuse = property(p, "bomb_fuse");
+    params.bomb_radius = property(p, "bomb_radius");
+
+    const Uint32 start = std::find(desc.map.begin(), desc.map.end(), LEVEL_PLAYER)
+      - desc.map.begin();
+    SimBoard initial(LEVEL_WIDTH, LEVEL_HEIGHT, params,
+                     start % LEVEL_WIDTH, start / LEVEL_WIDTH, seed);
+    for (Uint32 i = 0; i < desc.map.size(); ++i) {
+      if (desc.map[i] == LEVEL_WALL)
+        initial.setWall(i % LEVEL_WIDTH, i / LEVEL_WIDTH);
+    }
+
+    util::Random random(seed);
+    Uint32 total = 0;
+    SimBoard sim(initial);
+    for (Uint32 i = 0; i < PLAYTESTS; ++i) {
+      sim = initial;
+      sim.random().setState(random.next() | 1);
+      while (!sim.livesLost() && sim.time() < MAX_PLAYTEST_TIME)
+        sim.roll(static_cast<cube::ROLL_DIRECTION>(random.next(4)));
+      total += sim.time();
+    }
+    return total / PLAYTESTS;
+  }
+}
+
+LevelDescription::LevelDescription()
+  : properties(), map()
+{
+}
+
+std::string LevelDescription::text() const
+{
+  std::ostringstream out;
+  out << "# generated level, all times are in milliseconds\n";
+  for (std::map<std::string, std::string>::const_iterator it = properties.begin();
+       it != properties.end(); ++it)
+    out << it->first << '=' << it->second << '\n';
+  out << LEVEL_MAP_START << '\n';
+  for (Uint32 i = 0; i < map.size(); i += LEVEL_WIDTH)
+    out << std::string(map.begin() + i, map.begin() + std::min<Uint32>(i + LEVEL_WIDTH, map.size()))
+        << '\n';
+  return out.str();
+}
+
+LevelGenerator::Candidate::Candidate()
+  : level(), valid(false), survival(0)
+{
+}
+
+LevelGenerator::Candidates::Candidates(LevelGenerator& generator, Uint32 level,
+                                       Uint32 round)
+  : m_generator(generator), m_level(level), m_round(round)
+{
+}
+
+void LevelGenerator::Candidates::execute(Uint32 index)
+{
+  Candidate& c = m_generator.m_candidates[index];
+  if (m_generator.quitting()) {
+    c.valid = false;
+    return;
+  }
+  // Same level number, same levels
+  const Uint32 seed = ((m_level * 7919 + m_round) * 104729 + index) | 1;
+  c.level = makeLevel(m_level, seed);
+  c.valid = playable(c.level);
+  if (c.valid)
+    c.survival = survival(c.level, seed);
+}
+
+LevelGenerator::LevelGenerator(ThreadPool& pool)
+  : m_pool(pool), m_candidates(pool.threads() * CANDIDATES_PER_THREAD),
+    m_thread(0), m_lock(SDL_CreateMutex()), m_wake(SDL_CreateCond()),
+    m_ready(SDL_CreateCond()), m_wanted(0), m_building(0), m_prepared_level(0),
+    m_prepared(), m_quit(false)
+{
+  if (!m_lock || !m_wake || !m_ready)
+    throw Exception("Unable to create level generator synchronization primitives: "
+                    + std::string(SDL_GetError()));
+  m_thread = SDL_CreateThread(backgroundMain, this);
+  if (!m_thread)
+    throw Exception("Unable to start level generator thread: " + std::string(SDL_GetError()));
+}
+
+LevelGenerator::~LevelGenerator()
+{
+  SDL_LockMutex(m_lock);
+  m_quit = true;
+  SDL_CondSignal(m_wake);
+  SDL_UnlockMutex(m_lock);
+  SDL_WaitThread(m_thread, 0);
+  SDL_DestroyCond(m_ready);
+  SDL_DestroyCond(m_wake);
+  SDL_DestroyMutex(m_lock);
+}
+
+void LevelGenerator::prepare(Uint32 level)
+{
+  SDL_LockMutex(m_lock);
+  if (m_prepared_level != level && m_building != level) {
+    m_wanted = level;
+    SDL_CondSignal(m_wake);
+  }
+  SDL_UnlockMutex(m_lock);
+}
+
+LevelDescription LevelGenerator::generate(Uint32 level)
+{
+  SDL_LockMutex(m_lock);
+  if (m_prepared_level != level && m_building != level) {
+    m_wanted = level;
+    SDL_CondSignal(m_wake);
+  }
+  while (m_prepared_level != level)
+    SDL_CondWait(m_ready, m_lock);
+  LevelDescription desc = m_prepared;
+  m_prepared_level = 0;
+  SDL_UnlockMutex(m_lock);
+  return desc;
+}
+
+int LevelGenerator::backgroundMain(void* param)
+{
+  LevelGenerator* self = static_cast<LevelGenerator*>(param);
+  util::lowerThreadPriority();
+  SDL_LockMutex(self->m_lock);
+  for (;;) {
+    while (!self->m_wanted && !self->m_quit)
+      SDL_CondWait(self->m_wake, self->m_lock);
+    if (self->m_quit)
+      break;
+    self->m_building = self->m_wanted;
+    self->m_wanted = 0;
+    SDL_UnlockMutex(self->m_lock);
+
+    LevelDescription desc;
+    const bool built = self->build(self->m_building, desc);
+
+    SDL_LockMutex(self->m_lock);
+    if (!built)
+      break;
+    self->m_prepared = desc;
+    self->m_prepared_level = self->m_building;
+    self->m_building = 0;
+    SDL_CondBroadcast(self->m_ready);
+  }
+  SDL_UnlockMutex(self->m_lock);
+  return 0;
+}
+
+bool LevelGenerator::quitting()
+{
+  SDL_LockMutex(m_lock);
+  const bool quit = m_quit;
+  SDL_UnlockMutex(m_lock);
+  return quit;
+}
+
+bool LevelGenerator::build(Uint32 level, LevelDescription& desc)
+{
+  const Uint32 target = targetSurvival(level);
+  const Candidate* best = 0;
+  Uint32 best_error = 0;
+  for (Uint32 round = 0; round < MAX_ROUNDS && !best; ++round) {
+    Candidates job(*this, level, round);
+    m_pool.run(job, m_candidates.size());
+    // A round cut short has nothing worth picking from
+    if (quitting())
+      return false;
+    for (std::vector<Candidate>::const_iterator it = m_candidates.begin();
+         it != m_candidates.end(); ++it) {
+      if (!it->valid)
+        continue;
+      const Uint32 error = it->survival > target ? it->survival - target : target - it->survival;
+      if (!best || error < best_error) {
+        best = &*it;
+        best_error = error;
+      }
+    }
+  }
+
+  if (best) {
+    desc = best->level;
+    return true;
+  }
+
+  // Nothing usable; an empty board always is
+  desc = makeLevel(level, level);
+  std::replace(desc.map.begin(), desc.map.end(), LEVEL_WALL, LEVEL_EMPTY);
+  return true;
+}
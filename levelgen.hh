@@ -0,0 +1,91 @@
+/*
+ * Random level generator, for when we run out of hand made levels.
+ * Candidate levels are made in parallel, the ones that are obviously
+ * broken (unreachable parts of the board, tiles where the player can't
+ * get every colour on top) are thrown out and the rest are played
+ * through quickly on a SimBoard to pick the one closest to the
+ * difficulty we want for the level number.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_LEVELGEN_HH
+#define BNB_LEVELGEN_HH
+
+#include <string>
+#include <map>
+#include <vector>
+#include <SDL.h>
+#include <SDL_thread.h>
+#include "threadpool.hh"
+
+// A level as it is stored in a level file
+struct LevelDescription {
+  LevelDescription();
+  std::map<std::string, std::string> properties;
+  // LEVEL_WIDTH * LEVEL_HEIGHT map characters, row by row
+  std::vector<unsigned char> map;
+
+  // The level in level file format
+  std::string text() const;
+};
+
+class LevelGenerator {
+public:
+  LevelGenerator(ThreadPool& pool);
+  ~LevelGenerator();
+
+  // Start generating 'level' in the background. This runs at low
+  // priority and on however many threads the pool has, so give it a
+  // small pool if the game is running at the same time.
+  void prepare(Uint32 level);
+  // Returns 'level', waiting for it to be generated if it isn't ready
+  LevelDescription generate(Uint32 level);
+
+private:
+  LevelGenerator(const LevelGenerator&);
+  LevelGenerator& operator=(const LevelGenerator&);
+
+  struct Candidate {
+    Candidate();
+    LevelDescription level;
+    bool valid;
+    // average game time in ms a random player survives the level
+    Uint32 survival;
+  };
+
+  class Candidates : public ThreadPool::Job {
+  public:
+    Candidates(LevelGenerator& generator, Uint32 level, Uint32 round);
+    void execute(Uint32 index);
+  private:
+    Candidates(const Candidates&);
+    Candidates& operator=(const Candidates&);
+    LevelGenerator& m_generator;
+    Uint32 m_level;
+    Uint32 m_round;
+  };
+
+  static int backgroundMain(void* param);
+  // Returns false, leaving 'desc' alone, if told to quit part way
+  bool build(Uint32 level, LevelDescription& desc);
+  bool quitting();
+
+  ThreadPool& m_pool;
+  std::vector<Candidate> m_candidates;
+
+  // All generating happens on the background thread; generate() and
+  // prepare() just tell it what to do next.
+  SDL_Thread* m_thread;
+  SDL_mutex* m_lock;
+  SDL_cond* m_wake;
+  SDL_cond* m_ready;
+  Uint32 m_wanted;
+  Uint32 m_building;
+  Uint32 m_prepared_level;
+  LevelDescription m_prepared;
+  bool m_quit;
+};
+
+#endif
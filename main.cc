@@ -10,6 +10,11 @@
 #include "bbengine.hh"
 #include "config.h"
 #include "except.hh"
+#include "options.hh"
+#include "bench.hh"
+#include "threadpool.hh"
+#include "levelgen.hh"
+#include "tuner.hh"
 
 // ensure that SDL is always shut down properly, no matter how we terminate
 class SDLWrap {
@@ -25,7 +30,35 @@ public:
 
 int main(int argc, char* argv[])
 {
-  SDLWrap sdl(SDL_INIT_TIMER|SDL_INIT_VIDEO);
+  parseOptions(argc, argv);
+  if (options().bench_bot) {
+    SDLWrap sdl(0);
+    return benchBot();
+  }
+  if (options().bench_render || options().bench_text) {
+    // Draw offscreen, through SDL's dummy video driver, unless told
+    // which driver to use. SDL 1.2 may keep the pointer.
+    static char dummy_driver[] = "SDL_VIDEODRIVER=dummy";
+    if (!SDL_getenv("SDL_VIDEODRIVER"))
+      SDL_putenv(dummy_driver);
+    SDLWrap sdl(SDL_INIT_VIDEO);
+    if (options().bench_text)
+      return benchText();
+    return benchRender(options().bench_render);
+  }
+  if (options().tune_games) {
+    SDLWrap sdl(0);
+    return tuneDifficulty(options().tune_games);
+  }
+  if (options().generate_level) {
+    SDLWrap sdl(0);
+    ThreadPool pool;
+    LevelGenerator generator(pool);
+    std::cout << generator.generate(options().generate_level).text();
+    return 0;
+  }
+
+  SDLWrap sdl(SDL_INIT_VIDEO);
 
   SDL_WM_SetCaption("Blocks and Bombs", "Blocks and Bombs");
   // Setting the icon must happen before SDL_SetVideoMode
@@ -35,6 +68,6 @@ int main(int argc, char* argv[])
     SDL_FreeSurface(icon);
   }
 
-  BBEngine app(800, 600, 32);
+  BBEngine app(options().width, options().height, 32, options().fullscreen);
   return app.exec();
 }
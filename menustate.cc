@@ -10,12 +10,14 @@
 #include "except.hh"
 #include "textwriter.hh"
 #include "resources.hh"
+#include "blit.hh"
 #include "menustate.hh"
 #include "config.h"
 
 MenuState::MenuState()
   : m_background(IMG_LoadDisplayFormat("menu-background.png")),
-    m_textWriter(new TextWriter("whitrabt.ttf", 40)), m_items()
+    m_textWriter(new TextWriter("whitrabt.ttf", 40)), m_items(), m_resumable(false),
+    m_redraw(true)
 {
   if (!m_background)
     throw Exception("Failed to load menu background: " + std::string(IMG_GetError()));
@@ -43,6 +45,8 @@ STATE_CHANGE MenuState::handleKey(const SDL_KeyboardEvent& key)
 
   switch (key.keysym.sym) {
   case SDLK_ESCAPE: {
+    if (m_resumable)
+      return RESUME_PLAY;
     SDL_Event event;
     event.type = SDL_QUIT;
     SDL_PushEvent(&event);
@@ -89,6 +93,8 @@ STATE_CHANGE MenuState::handleKey(const SDL_KeyboardEvent& key)
           SDL_PushEvent(&event);
           break;
         }
+        case RESUME_GAME:
+          return RESUME_PLAY;
         case NEW_GAME:
           return GOTO_PLAY;
         case SHOW_HIGHSCORE:
@@ -110,6 +116,37 @@ STATE_CHANGE MenuState::handleKey(const SDL_KeyboardEvent& key)
   return NO_CHANGE;
 }
 
+Uint32 MenuState::memoryUsage() const
+{
+  // The rendered items are held by the text cache and glyph atlases
+  // rather than by us, but they're kept there for the menu, at 32
+  // bits per pixel.
+  Uint32 bytes = surfaceBytes(m_background);
+  for (std::list<MenuItem>::const_iterator it = m_items.begin(); it != m_items.end(); ++it)
+    bytes += it->rect.w * it->rect.h * 4;
+  return bytes;
+}
+
+void MenuState::setResumable(bool resumable)
+{
+  if (resumable == m_resumable)
+    return;
+  m_resumable = resumable;
+
+  for (std::list<MenuItem>::iterator it = m_items.begin(); it != m_items.end(); ++it) {
+    it->cur = false;
+    it->col = COLOR_OF_INACTIVE;
+  }
+  if (resumable)
+    m_items.push_front(MenuItem("Resume Game", COLOR_OF_INACTIVE, false, RESUME_GAME));
+  else
+    m_items.pop_front();
+  m_items.front().cur = true;
+  m_items.front().col = COLOR_OF_ACTIVE;
+  // everything moved
+  m_redraw = true;
+}
+
 STATE_CHANGE MenuState::update(Uint32 delta_time)
 {
   // Update the color of all menu items relative to time passed
@@ -158,11 +195,15 @@ STATE_CHANGE MenuState::update(Uint32 delta_time)
   return NO_CHANGE;
 }
 
-void MenuState::draw(SDL_Surface* screen)
+void MenuState::draw(SDL_Surface* screen, DirtyRects& dirty)
 {
-  SDL_BlitSurface(m_background, 0, screen, 0);
+  if (m_redraw) {
+    blit::blitSurface(m_background, 0, screen, 0);
+    dirty.addAll();
+  }
 
-  // Draw the menu text
+  // Draw the menu text. Once the screen is up only the items that
+  // look different from last time - the ones fading - are redrawn.
   int y_off = 222;
   std::list<MenuItem>::iterator it = m_items.begin();
   for (; it != m_items.end(); ++it) {
@@ -172,9 +213,24 @@ void MenuState::draw(SDL_Surface* screen)
     SDL_Rect r = m_textWriter->sizeText(render_text);
     r.y = y_off;
     r.x = (screen->w - r.w) / 2;
-    m_textWriter->setFontColor(it->col);
-    m_textWriter->render(screen, &r, render_text);
     y_off += r.h;
     y_off += m_textWriter->lineSkip();
+
+    if (!m_redraw) {
+      if (render_text == it->drawn && it->col.r == it->drawn_col.r
+          && it->col.g == it->drawn_col.g && it->col.b == it->drawn_col.b)
+        continue;
+      // put the background back where the item was
+      SDL_Rect old = it->rect;
+      blit::blitSurface(m_background, &it->rect, screen, &old);
+      dirty.add(it->rect);
+      dirty.add(r);
+    }
+    it->drawn = render_text;
+    it->drawn_col = it->col;
+    it->rect = r;
+    m_textWriter->setFontColor(it->col);
+    m_textWriter->render(screen, &r, render_text);
   }
+  m_redraw = false;
 }
@@ -21,7 +21,11 @@ public:
   ~MenuState();
   STATE_CHANGE handleKey(const SDL_KeyboardEvent& key);
   STATE_CHANGE update(Uint32 delta_time);
-  void draw(SDL_Surface* screen);
+  void draw(SDL_Surface* screen, DirtyRects& dirty);
+  virtual void resume() { m_redraw = true; }
+  virtual Uint32 memoryUsage() const;
+  // Offer to go back to a game in progress, first thing
+  void setResumable(bool resumable);
 private:
   MenuState(const MenuState&);
   MenuState& operator=(const MenuState&);
@@ -29,7 +33,8 @@ private:
   TextWriter* m_textWriter;
 
   enum MENU_ACTION {
-    NEW_GAME = 0,
+    RESUME_GAME = 0,
+    NEW_GAME,
     SHOW_HIGHSCORE,
     SHOW_HELP,
     SHOW_ABOUT,
@@ -40,14 +45,23 @@ private:
   public:
     MenuItem(const std::string& text, const SDL_Color& color,
              bool current, enum MENU_ACTION action)
-      : txt(text), col(color), cur(current), act(action) { }
+      : txt(text), col(color), cur(current), act(action), drawn(), drawn_col(), rect()
+    { }
     const std::string txt;
     SDL_Color col;
     bool cur;
     MENU_ACTION act;
+    // what was last drawn for the item, and where
+    std::string drawn;
+    SDL_Color drawn_col;
+    SDL_Rect rect;
   };
 
   std::list<MenuItem> m_items;
+  bool m_resumable;
+  // set when the whole screen needs drawing, not just the items that
+  // changed
+  bool m_redraw;
 };
 
 #endif
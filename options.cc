@@ -0,0 +1,62 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <string>
+#include <cstdlib>
+#include "except.hh"
+#include "options.hh"
+
+Options::Options()
+  : autoplay(false), bench_bot(false), generate_level(0), tune_games(0), bench_render(0),
+    bench_text(false), width(0), height(0), fullscreen(false), fps(0), text_cache_kb(4096),
+    state_cache_kb(32768), capture_dir()
+{
+}
+
+Options& options()
+{
+  static Options opts;
+  return opts;
+}
+
+void parseOptions(int argc, char* argv[])
+{
+  Options& opts = options();
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg(argv[i]);
+    if (arg == "--autoplay")
+      opts.autoplay = true;
+    else if (arg == "--bench-bot")
+      opts.bench_bot = true;
+    else if (arg == "--generate-level" && i + 1 < argc)
+      opts.generate_level = strtoul(argv[++i], 0, 10);
+    else if (arg == "--tune")
+      opts.tune_games = 1000;
+    else if (arg == "--tune-games" && i + 1 < argc)
+      opts.tune_games = strtoul(argv[++i], 0, 10);
+    else if (arg == "--bench-render")
+      opts.bench_render = 300;
+    else if (arg == "--bench-render-frames" && i + 1 < argc)
+      opts.bench_render = strtoul(argv[++i], 0, 10);
+    else if (arg == "--bench-text")
+      opts.bench_text = true;
+    else if (arg == "--width" && i + 1 < argc)
+      opts.width = strtoul(argv[++i], 0, 10);
+    else if (arg == "--height" && i + 1 < argc)
+      opts.height = strtoul(argv[++i], 0, 10);
+    else if (arg == "--fullscreen")
+      opts.fullscreen = true;
+    else if (arg == "--fps" && i + 1 < argc)
+      opts.fps = strtoul(argv[++i], 0, 10);
+    else if (arg == "--text-cache" && i + 1 < argc)
+      opts.text_cache_kb = strtoul(argv[++i], 0, 10);
+    else if (arg == "--state-cache" && i + 1 < argc)
+      opts.state_cache_kb = strtoul(argv[++i], 0, 10);
+    else if (arg == "--capture" && i + 1 < argc)
+      opts.capture_dir = argv[++i];
+    else
+      throw Exception("Unknown option: " + arg);
+  }
+}
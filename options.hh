@@ -0,0 +1,52 @@
+/*
+ * Command line options.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_OPTIONS_HH
+#define BNB_OPTIONS_HH
+
+#include <string>
+
+struct Options {
+  Options();
+  // start games with the computer playing
+  bool autoplay;
+  // run the autoplayer benchmark instead of the game
+  bool bench_bot;
+  // print a generated level in level file format instead of playing
+  // (0 for none)
+  unsigned int generate_level;
+  // run the difficulty tuner with this many games per parameter set
+  // instead of playing (0 for not at all)
+  unsigned int tune_games;
+  // draw each render benchmark scene this many frames instead of
+  // playing (0 for not at all)
+  unsigned int bench_render;
+  // run the text drawing benchmark instead of the game
+  bool bench_text;
+  // display size (0 for the game's own 800x600, or the desktop size
+  // when fullscreen) and whether to go fullscreen
+  unsigned int width;
+  unsigned int height;
+  bool fullscreen;
+  // frames per second to aim for (0 for the game's usual one every
+  // 30ms)
+  unsigned int fps;
+  // memory for keeping rendered text around, in kilobytes
+  unsigned int text_cache_kb;
+  // memory for keeping screens not in use around, in kilobytes
+  unsigned int state_cache_kb;
+  // directory to record the presented frames to (empty for none)
+  std::string capture_dir;
+};
+
+// The options the game was started with
+Options& options();
+
+// Fills in options() from the command line. Throws on unknown options.
+void parseOptions(int argc, char* argv[]);
+
+#endif
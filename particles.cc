@@ -0,0 +1,163 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <time.h>
+#include <SDL.h>
+#include "resources.hh"
+#include "util.hh"
+#include "particles.hh"
+
+namespace {
+  const Uint32 DIRECTIONS = 64;
+  // pixels per second per second, pulling particles down the screen
+  const float GRAVITY = 400.0f;
+}
+
+ParticleSystem::ParticleSystem()
+  : m_sheet(IMG_LoadDisplayFormat("particles.png")), m_sprite_size(m_sheet->h),
+    m_x(CAPACITY), m_y(CAPACITY), m_vx(CAPACITY), m_vy(CAPACITY), m_life(CAPACITY),
+    m_sprite(CAPACITY), m_count(0), m_dropped(0), m_dir_x(DIRECTIONS),
+    m_dir_y(DIRECTIONS), m_random(time(0))
+{
+  for (Uint32 i = 0; i < DIRECTIONS; ++i) {
+    const double angle = 2 * M_PI * i / DIRECTIONS;
+    m_dir_x[i] = cos(angle);
+    m_dir_y[i] = sin(angle);
+  }
+}
+
+ParticleSystem::~ParticleSystem()
+{
+  SDL_FreeSurface(m_sheet);
+}
+
+void ParticleSystem::emit(Sint16 x, Sint16 y, Uint32 count, Uint8 sprite, float speed,
+                          Uint32 life)
+{
+  if (m_count + count > CAPACITY) {
+    m_dropped += m_count + count - CAPACITY;
+    count = CAPACITY - m_count;
+  }
+
+  for (Uint32 i = m_count; i < m_count + count; ++i) {
+    const Uint32 dir = m_random.next(DIRECTIONS);
+    // between a third and all of the full speed
+    const float v = speed * (1 + 2 * m_random.next(256) / 255.0f) / 3;
+    m_x[i] = x;
+    m_y[i] = y;
+    m_vx[i] = m_dir_x[dir] * v;
+    m_vy[i] = m_dir_y[dir] * v;
+    // some variation in life time too, so bursts fade out gradually
+    m_life[i] = life / 2 + m_random.next(life / 2 + 1);
+    m_sprite[i] = sprite;
+  }
+  m_count += count;
+}
+
+void ParticleSystem::pickup(Sint16 x, Sint16 y, BLOCK_COLOR col)
+{
+  emit(x, y, 48, col, 160.0f, 600);
+  emit(x, y, 16, SPARK, 80.0f, 400);
+}
+
+void ParticleSystem::death(Sint16 x, Sint16 y)
+{
+  emit(x, y, 200, SPARK, 260.0f, 1200);
+}
+
+void ParticleSystem::explosion(Sint16 x, Sint16 y)
+{
+  emit(x, y, 160, FIRE, 320.0f, 800);
+  emit(x, y, 40, SPARK, 120.0f, 500);
+}
+
+void ParticleSystem::update(Uint32 delta_time)
+{
+  const float dt = delta_time / 1000.0f;
+  const float dv = GRAVITY * dt;
+  const float dlife = delta_time;
+  const Uint32 n = m_count;
+  float* x = &m_x[0];
+  float* y = &m_y[0];
+  float* vx = &m_vx[0];
+  float* vy = &m_vy[0];
+  float* life = &m_life[0];
+
+  // Plain independent passes over the arrays
+  for (Uint32 i = 0; i < n; ++i)
+    vy[i] += dv;
+  for (Uint32 i = 0; i < n; ++i)
+    x[i] += vx[i] * dt;
+  for (Uint32 i = 0; i < n; ++i)
+    y[i] += vy[i] * dt;
+  for (Uint32 i = 0; i < n; ++i)
+    life[i] -= dlife;
+
+  // Retire the dead by moving the last live particle into their slot
+  Uint32 count = n;
+  for (Uint32 i = 0; i < count; ) {
+    if (life[i] > 0) {
+      ++i;
+      continue;
+    }
+    --count;
+    x[i] = x[count];
+    y[i] = y[count];
+    vx[i] = vx[count];
+    vy[i] = vy[count];
+    life[i] = life[count];
+    m_sprite[i] = m_sprite[count];
+  }
+  m_count = count;
+}
+
+void ParticleSystem::draw(RenderQueue& queue)
+{
+  const Sint16 half = m_sprite_size / 2;
+  SDL_Rect src;
+  src.y = 0;
+  src.w = src.h = m_sprite_size;
+  for (Uint32 i = 0; i < m_count; ++i) {
+    src.x = m_sprite[i] * m_sprite_size;
+    queue.submit(m_sheet, src, static_cast<Sint16>(m_x[i]) - half,
+                 static_cast<Sint16>(m_y[i]) - half, RenderQueue::LAYER_EFFECTS);
+  }
+}
+
+SDL_Rect ParticleSystem::bounds() const
+{
+  SDL_Rect r;
+  r.x = r.y = 0;
+  r.w = r.h = 0;
+  if (!m_count)
+    return r;
+
+  float x1 = m_x[0];
+  float x2 = m_x[0];
+  float y1 = m_y[0];
+  float y2 = m_y[0];
+  for (Uint32 i = 1; i < m_count; ++i) {
+    x1 = std::min(x1, m_x[i]);
+    x2 = std::max(x2, m_x[i]);
+    y1 = std::min(y1, m_y[i]);
+    y2 = std::max(y2, m_y[i]);
+  }
+  // keep within what fits in an SDL_Rect; the screen clips the rest
+  const float lo = -1000.0f;
+  const float hi = 8000.0f;
+  x1 = std::max(x1, lo);
+  y1 = std::max(y1, lo);
+  x2 = std::min(x2, hi);
+  y2 = std::min(y2, hi);
+  const Sint16 half = m_sprite_size / 2;
+  r.x = static_cast<Sint16>(x1) - half;
+  r.y = static_cast<Sint16>(y1) - half;
+  r.w = static_cast<Uint16>(x2 - x1) + m_sprite_size + 1;
+  r.h = static_cast<Uint16>(y2 - y1) + m_sprite_size + 1;
+  return r;
+}
@@ -0,0 +1,74 @@
+/*
+ * Particle effects. A fixed pool of particles kept as a structure of
+ * arrays, so the update loop is a handful of straight passes over
+ * floats the compiler can vectorize, and all particles are drawn
+ * from one small sprite sheet. Emitting never allocates; when the
+ * pool is full new particles are simply dropped.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_PARTICLES_HH
+#define BNB_PARTICLES_HH
+
+#include <vector>
+#include <SDL.h>
+#include "resources.hh"
+#include "dirtyrects.hh"
+#include "renderqueue.hh"
+#include "util.hh"
+
+class ParticleSystem {
+public:
+  // Sprites in particles.png. The first six are the BLOCK_COLORs.
+  enum SPRITE { SPARK = 6, FIRE = 7 };
+  static const Uint32 CAPACITY = 4096;
+
+  ParticleSystem();
+  ~ParticleSystem();
+
+  // Emit 'count' particles from (x, y) on screen, flying off in random
+  // directions at up to 'speed' pixels per second and living for
+  // 'life' ms.
+  void emit(Sint16 x, Sint16 y, Uint32 count, Uint8 sprite, float speed, Uint32 life);
+
+  // Effects for game events
+  void pickup(Sint16 x, Sint16 y, BLOCK_COLOR col);
+  void death(Sint16 x, Sint16 y);
+  void explosion(Sint16 x, Sint16 y);
+
+  void update(Uint32 delta_time);
+  // Queues all particles for drawing
+  void draw(RenderQueue& queue);
+  void clear() { m_count = 0; }
+
+  // Screen area covered by live particles (w == 0 when there are none)
+  SDL_Rect bounds() const;
+
+  Uint32 count() const { return m_count; }
+  // Particles that didn't fit in the pool
+  Uint32 dropped() const { return m_dropped; }
+
+private:
+  ParticleSystem(const ParticleSystem&);
+  ParticleSystem& operator=(const ParticleSystem&);
+
+  SDL_Surface* m_sheet;
+  Uint16 m_sprite_size;
+  std::vector<float> m_x;
+  std::vector<float> m_y;
+  std::vector<float> m_vx;
+  std::vector<float> m_vy;
+  // ms left to live
+  std::vector<float> m_life;
+  std::vector<Uint8> m_sprite;
+  Uint32 m_count;
+  Uint32 m_dropped;
+  // unit vectors to pick directions from, so emit() needs no trig
+  std::vector<float> m_dir_x;
+  std::vector<float> m_dir_y;
+  util::Random m_random;
+};
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <map>
+#include <vector>
+#include <SDL.h>
+#include "resources.hh"
+#include "tilemask.hh"
+#include "cube.hh"
+#include "pickup.hh"
+
+const Uint16 PickupOracle::UNREACHABLE;
+
+PickupOracle::PickupOracle(Uint16 width, Uint16 height)
+  : m_width(width), m_height(height), m_blocked(width, height), m_targets(),
+    m_player_tile(0), m_player_orientation(cube::initialOrientation()),
+    m_player_rolls(0), m_buckets(), m_invalid()
+{
+  for (Uint8 o = 0; o < cube::ORIENTATIONS; ++o) {
+    for (int d = cube::ROLL_UP; d <= cube::ROLL_RIGHT; ++d)
+      m_roll[o][d] = cube::roll(o, static_cast<cube::ROLL_DIRECTION>(d));
+  }
+}
+
+void PickupOracle::reset()
+{
+  m_blocked.clear();
+  m_targets.clear();
+}
+
+void PickupOracle::trackPlayer(Uint16 x, Uint16 y, Uint8 orientation, Uint32 rolls)
+{
+  m_player_tile = y * m_width + x;
+  m_player_orientation = orientation;
+  m_player_rolls = rolls;
+}
+
+inline int PickupOracle::neighbours(Uint32 s, Uint32 out[4]) const
+{
+  // Rolls are reversible (rolling up undoes rolling down etc.), so
+  // the states we can reach from 's' in one roll are exactly the
+  // states that can reach 's' in one roll.
+  const Uint32 tile = s / cube::ORIENTATIONS;
+  const Uint8 o = s % cube::ORIENTATIONS;
+  const Uint16 x = tile % m_width;
+  const Uint16 y = tile / m_width;
+  int n = 0;
+
+  if (y > 0 && !m_blocked.testIndex(tile - m_width))
+    out[n++] = state(tile - m_width, m_roll[o][cube::ROLL_UP]);
+  if (y < m_height - 1 && !m_blocked.testIndex(tile + m_width))
+    out[n++] = state(tile + m_width, m_roll[o][cube::ROLL_DOWN]);
+  if (x > 0 && !m_blocked.testIndex(tile - 1))
+    out[n++] = state(tile - 1, m_roll[o][cube::ROLL_LEFT]);
+  if (x < m_width - 1 && !m_blocked.testIndex(tile + 1))
+    out[n++] = state(tile + 1, m_roll[o][cube::ROLL_RIGHT]);
+
+  return n;
+}
+
+Uint16 PickupOracle::bestNeighbour(const std::vector<Uint16>& dist, Uint32 s) const
+{
+  Uint32 n[4];
+  const int count = neighbours(s, n);
+  Uint16 best = UNREACHABLE;
+  for (int i = 0; i < count; ++i) {
+    if (dist[n[i]] < best)
+      best = dist[n[i]];
+  }
+  return best;
+}
+
+inline void PickupOracle::push(Uint32 s, Uint16 d)
+{
+  if (m_buckets.size() <= d)
+    m_buckets.resize(d + 1);
+  m_buckets[d].push_back(s);
+}
+
+void PickupOracle::propagate(std::vector<Uint16>& dist)
+{
+  // Breadth first search from whatever has been pushed, processing
+  // states in order of distance. Entries whose distance has since
+  // improved are stale and just skipped.
+  for (Uint32 d = 0; d < m_buckets.size(); ++d) {
+    for (Uint32 i = 0; i < m_buckets[d].size(); ++i) {
+      const Uint32 s = m_buckets[d][i];
+      if (dist[s] != d)
+        continue;
+      Uint32 n[4];
+      const int count = neighbours(s, n);
+      for (int j = 0; j < count; ++j) {
+        if (dist[n[j]] > d + 1) {
+          dist[n[j]] = d + 1;
+          push(n[j], d + 1);
+        }
+      }
+    }
+    m_buckets[d].clear();
+  }
+}
+
+void PickupOracle::buildField(Uint32 tile, Target& t)
+{
+  t.dist.assign(static_cast<Uint32>(m_width) * m_height * cube::ORIENTATIONS, UNREACHABLE);
+  if (m_blocked.testIndex(tile))
+    return;
+
+  // Plain breadth first search from the goal states. With everything
+  // starting at the same distance a simple FIFO does the job.
+  std::vector<Uint32>& queue = m_invalid;
+  queue.clear();
+  for (Uint8 o = 0; o < cube::ORIENTATIONS; ++o) {
+    if (cube::top(o) == t.col) {
+      t.dist[state(tile, o)] = 0;
+      queue.push_back(state(tile, o));
+    }
+  }
+  for (Uint32 i = 0; i < queue.size(); ++i) {
+    const Uint32 s = queue[i];
+    const Uint16 d = t.dist[s] + 1;
+    Uint32 n[4];
+    const int count = neighbours(s, n);
+    for (int j = 0; j < count; ++j) {
+      if (t.dist[n[j]] == UNREACHABLE) {
+        t.dist[n[j]] = d;
+        queue.push_back(n[j]);
+      }
+    }
+  }
+}
+
+void PickupOracle::tileBlocked(Uint32 tile, std::vector<Uint16>& dist)
+{
+  // Distances can only grow when a tile gets blocked, and only for
+  // states whose shortest paths all went through it. First find those
+  // states: walking outwards in order of distance, a state is still
+  // fine if it has a neighbour exactly one roll closer that is still
+  // fine. Everything else loses its distance.
+  m_invalid.clear();
+  for (Uint8 o = 0; o < cube::ORIENTATIONS; ++o) {
+    const Uint32 s = state(tile, o);
+    const Uint16 old = dist[s];
+    if (old == UNREACHABLE)
+      continue;
+    dist[s] = UNREACHABLE;
+    Uint32 n[4];
+    const int count = neighbours(s, n);
+    for (int j = 0; j < count; ++j) {
+      if (dist[n[j]] == old + 1)
+        push(n[j], old + 1);
+    }
+  }
+
+  for (Uint32 d = 0; d < m_buckets.size(); ++d) {
+    for (Uint32 i = 0; i < m_buckets[d].size(); ++i) {
+      const Uint32 s = m_buckets[d][i];
+      if (dist[s] != d || bestNeighbour(dist, s) == d - 1)
+        continue;
+      dist[s] = UNREACHABLE;
+      m_invalid.push_back(s);
+      Uint32 n[4];
+      const int count = neighbours(s, n);
+      for (int j = 0; j < count; ++j) {
+        if (dist[n[j]] == d + 1)
+          push(n[j], d + 1);
+      }
+    }
+    m_buckets[d].clear();
+  }
+
+  // Now give the invalidated states new distances, starting from the
+  // surrounding states whose distances are still good.
+  for (std::vector<Uint32>::const_iterator it = m_invalid.begin();
+       it != m_invalid.end(); ++it) {
+    const Uint16 best = bestNeighbour(dist, *it);
+    if (best != UNREACHABLE) {
+      dist[*it] = best + 1;
+      push(*it, best + 1);
+    }
+  }
+  propagate(dist);
+}
+
+void PickupOracle::tileCleared(Uint32 tile, Target& t, Uint32 target_tile)
+{
+  // Distances can only shrink when a tile opens up. Give the tile's
+  // states their distances and spread any improvements outwards.
+  for (Uint8 o = 0; o < cube::ORIENTATIONS; ++o) {
+    const Uint32 s = state(tile, o);
+    Uint16 d;
+    if (tile == target_tile && cube::top(o) == t.col) {
+      d = 0;
+    } else {
+      d = bestNeighbour(t.dist, s);
+      if (d == UNREACHABLE)
+        continue;
+      ++d;
+    }
+    t.dist[s] = d;
+    push(s, d);
+  }
+  propagate(t.dist);
+}
+
+void PickupOracle::setBlocked(Uint16 x, Uint16 y, bool blocked)
+{
+  if (m_blocked.test(x, y) == blocked)
+    return;
+
+  if (blocked)
+    m_blocked.set(x, y);
+  else
+    m_blocked.reset(x, y);
+
+  const Uint32 tile = y * m_width + x;
+  for (std::map<Uint32, Target>::iterator it = m_targets.begin();
+       it != m_targets.end(); ++it) {
+    Target& t = it->second;
+    const Uint32 taken = m_player_rolls - t.spawn_rolls;
+    const Uint16 before = t.dist[playerState()];
+    const bool on_track = before != UNREACHABLE && taken + before <= t.optimum;
+
+    if (blocked)
+      tileBlocked(tile, t.dist);
+    else
+      tileCleared(tile, t, it->first);
+
+    const Uint16 after = t.dist[playerState()];
+    if (on_track && after != UNREACHABLE && taken + after > t.optimum)
+      t.optimum = taken + after;
+  }
+}
+
+void PickupOracle::addBlock(Uint16 x, Uint16 y, BLOCK_COLOR col)
+{
+  const Uint32 tile = y * m_width + x;
+  Target& t = m_targets[tile];
+  t.col = col;
+  buildField(tile, t);
+  t.optimum = t.dist[playerState()];
+  t.spawn_rolls = m_player_rolls;
+}
+
+void PickupOracle::removeBlock(Uint16 x, Uint16 y)
+{
+  m_targets.erase(y * m_width + x);
+}
+
+Uint16 PickupOracle::minimumRolls(Uint16 bx, Uint16 by, Uint16 px, Uint16 py,
+                                  Uint8 orientation) const
+{
+  std::map<Uint32, Target>::const_iterator it = m_targets.find(by * m_width + bx);
+  if (it == m_targets.end())
+    return UNREACHABLE;
+  return it->second.dist[state(py * m_width + px, orientation)];
+}
+
+Uint16 PickupOracle::minimumRolls(Uint16 bx, Uint16 by) const
+{
+  std::map<Uint32, Target>::const_iterator it = m_targets.find(by * m_width + bx);
+  if (it == m_targets.end())
+    return UNREACHABLE;
+  return it->second.dist[playerState()];
+}
+
+bool PickupOracle::isOptimalPickup(Uint16 x, Uint16 y) const
+{
+  std::map<Uint32, Target>::const_iterator it = m_targets.find(y * m_width + x);
+  if (it == m_targets.end() || it->second.optimum == UNREACHABLE)
+    return false;
+  return m_player_rolls - it->second.spawn_rolls <= it->second.optimum;
+}
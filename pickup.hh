@@ -0,0 +1,95 @@
+/*
+ * Works out the least number of rolls needed to collect each block
+ * on the board, so the player can be rewarded for an optimum pickup.
+ *
+ * Collecting a block means arriving on its tile with the matching
+ * colour on top, so this is a shortest path problem over every
+ * combination of tile and cube orientation. For each live block we
+ * keep the distance from every such state to the block, and repair
+ * those distance fields incrementally as walls come and go rather
+ * than recomputing them.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_PICKUP_HH
+#define BNB_PICKUP_HH
+
+#include <map>
+#include <vector>
+#include <SDL.h>
+#include "resources.hh"
+#include "tilemask.hh"
+#include "cube.hh"
+
+class PickupOracle {
+public:
+  static const Uint16 UNREACHABLE = 0xffff;
+
+  PickupOracle(Uint16 width, Uint16 height);
+
+  // Forget all blocks and walls
+  void reset();
+
+  // Tell the oracle where the player is and how many times the cube
+  // has been rolled in total.
+  void trackPlayer(Uint16 x, Uint16 y, Uint8 orientation, Uint32 rolls);
+
+  // A tile became blocked (a wall or bomb appeared) or was cleared
+  void setBlocked(Uint16 x, Uint16 y, bool blocked);
+
+  // Start/stop tracking a block
+  void addBlock(Uint16 x, Uint16 y, BLOCK_COLOR col);
+  void removeBlock(Uint16 x, Uint16 y);
+
+  // Least number of rolls needed to collect the block at (x, y) from
+  // the given player position and orientation.
+  Uint16 minimumRolls(Uint16 bx, Uint16 by, Uint16 px, Uint16 py, Uint8 orientation) const;
+  // ... and from where the player is right now
+  Uint16 minimumRolls(Uint16 bx, Uint16 by) const;
+
+  // Did the player collect the block at (x, y) in the least possible
+  // number of rolls since it appeared? If walls appeared that forced
+  // a detour while the player was on an optimal route, the detour
+  // doesn't count against the player.
+  bool isOptimalPickup(Uint16 x, Uint16 y) const;
+
+private:
+  struct Target {
+    Target() : col(RED), optimum(0), spawn_rolls(0), dist() { }
+    BLOCK_COLOR col;
+    Uint16 optimum;
+    Uint32 spawn_rolls;
+    std::vector<Uint16> dist;
+  };
+
+  Uint32 state(Uint32 tile, Uint8 orientation) const { return tile * cube::ORIENTATIONS + orientation; }
+  Uint32 playerState() const { return state(m_player_tile, m_player_orientation); }
+  // neighbouring states of 's', returns how many were stored in 'out'
+  int neighbours(Uint32 s, Uint32 out[4]) const;
+  Uint16 bestNeighbour(const std::vector<Uint16>& dist, Uint32 s) const;
+
+  void buildField(Uint32 tile, Target& t);
+  void propagate(std::vector<Uint16>& dist);
+  void tileBlocked(Uint32 tile, std::vector<Uint16>& dist);
+  void tileCleared(Uint32 tile, Target& t, Uint32 target_tile);
+  void push(Uint32 s, Uint16 d);
+
+  const Uint16 m_width;
+  const Uint16 m_height;
+  TileMask m_blocked;
+  std::map<Uint32, Target> m_targets;
+  Uint32 m_player_tile;
+  Uint8 m_player_orientation;
+  Uint32 m_player_rolls;
+
+  // local copy of the roll table, this is the innermost loop
+  Uint8 m_roll[cube::ORIENTATIONS][4];
+
+  // scratch space reused between updates: states bucketed by distance
+  std::vector<std::vector<Uint32> > m_buckets;
+  std::vector<Uint32> m_invalid;
+};
+
+#endif
@@ -4,35 +4,53 @@
  */
 
 #include <iostream>
-#include <sstream>
-#include <iomanip>
 #include <algorithm>
 #include <cstdlib>
 #include <typeinfo>
-#include <time.h>
 #include <SDL.h>
 #include <SDL_image.h>
 #include "except.hh"
 #include "textwriter.hh"
+#include "hud.hh"
 #include "resources.hh"
+#include "blit.hh"
 #include "playstate.hh"
 #include "effects.hh"
+#include "cube.hh"
+#include "threadpool.hh"
+#include "simulation.hh"
+#include "autoplayer.hh"
+#include "options.hh"
 #include "config.h"
 
-Board::Board(ResourceLoader& loader, Uint32)
-  : m_loader(loader), m_width(16), m_height(16),
+Board::Board(ResourceLoader& loader, Uint32 level)
+  : m_loader(loader), m_width(LEVEL_WIDTH), m_height(LEVEL_HEIGHT),
     m_grid(IMG_LoadDisplayFormat("grid-square.png")),
     m_player(new Player(this, 14, 14)),
-    m_level(dynamic_cast<LevelResource*>(loader.load("levels/level-0001.res"))),
+    m_level(loader.loadLevel(level)),
     m_board(m_width * m_height), m_newObjects(), m_deadObjects(), m_freeTiles(),
-    m_block_time(0)
+    m_detonations(), m_bombs(m_width, m_height), m_blast(m_width, m_height),
+    m_area(m_width, m_height), m_block_time(0), m_random(m_level->randomSeed()),
+    m_oracle(m_width, m_height), m_particles(), m_drawn(m_width * m_height, DrawnTile()),
+    m_drawn_player_x(0xffff), m_drawn_player_y(0xffff), m_drawn_orientation(0),
+    m_drawn_particles()
 {
   for (std::vector<GameObject*>::iterator it = m_board.begin();
        it != m_board.end(); ++it) {
-    // XXX: We want to load a proper level here
     *it = 0;
   }
-  srand(time(0));
+
+  const SDL_Rect start = m_level->playerStartPos();
+  m_player->setPos(start.x, start.y);
+
+  // put the initial walls of the level in place
+  const std::vector<unsigned char> level_map = m_level->initialBoard();
+  updateFreeTiles();
+  for (Uint32 i = 0; i < level_map.size(); ++i) {
+    if (level_map[i] == LEVEL_WALL)
+      new Wall(this, i % m_width, i / m_width);
+  }
+  commitNewObjects();
 }
 
 Board::~Board()
@@ -61,14 +79,84 @@ void Board::removeGameObject(GameObject* dead_obj)
 
 void Board::update(Uint32 delta_time)
 {
+  // While the player has the freeze effect, time stands still for
+  // everything on the board except the player.
+  const Uint32 tile_time = m_player->effects().modifiers().freeze ? 0 : delta_time;
+
+  // effects keep moving even then
+  m_particles.update(delta_time);
+
   // Process all active objects
   for (std::vector<GameObject*>::iterator it = m_board.begin();
        it != m_board.end(); ++it) {
     if (!*it)
       continue;
-    (*it)->update(delta_time);
+    (*it)->update(tile_time);
+  }
+
+  reapDeadObjects();
+  commitNewObjects();
+
+  // Update the player
+  m_player->update(delta_time);
+  m_oracle.trackPlayer(m_player->x(), m_player->y(), m_player->orientation(),
+                       m_player->rolls());
+
+  // Update the free list
+  const bool has_block = updateFreeTiles();
+
+  // if time between blocks for this level has passed,
+  // add a new block
+  m_block_time += tile_time;
+  if (m_block_time > m_level->delayBetweenBlocks()) {
+    newBlock();
+    m_block_time = 0;
+  }
+
+  // if there are no blocks on the board, add one
+  if (!has_block) {
+    newBlock();
+  }
+
+  // If player collides with object, pass on effects
+  GameObject* collider = m_board[m_player->y() * m_width + m_player->x()];
+  if (collider)
+    collider->collision(m_player);
+
+  if (boxedIn()) {
+    Effect e;
+    e.life = -1;
+    m_player->setEffects(e);
   }
 
+  // Set off any bombs that went off during this update and get rid
+  // of whatever they destroyed.
+  resolveDetonations();
+  reapDeadObjects();
+}
+
+bool Board::updateFreeTiles()
+{
+  // This is inefficient.
+  m_freeTiles.clear();
+  bool has_block = false;
+  for (Uint16 y = 0; y < m_height; ++y) {
+    for (Uint16 x = 0; x < m_width; ++x) {
+      const GameObject* go = m_board[y * m_width + x];
+      if (go == 0) {
+        if (m_player->x() == x && m_player->y() == y)
+          continue;
+        m_freeTiles.push_back(std::make_pair(x, y));
+      } else if (dynamic_cast<const Block*>(go)) {
+        has_block = true;
+      }
+    }
+  }
+  return has_block;
+}
+
+void Board::reapDeadObjects()
+{
   // remove all newly dead objects from the board
   for (std::vector<GameObject*>::iterator it = m_board.begin();
        it != m_board.end(); ++it) {
@@ -76,60 +164,86 @@ void Board::update(Uint32 delta_time)
       continue;
     std::set<GameObject*>::iterator dead = m_deadObjects.find(*it);
     if (dead != m_deadObjects.end()) {
+      if (dynamic_cast<const Block*>(*it))
+        m_oracle.removeBlock((*it)->x(), (*it)->y());
+      if ((*it)->isBlocked())
+        m_oracle.setBlocked((*it)->x(), (*it)->y(), false);
       *it = 0;
       delete *dead;
       m_deadObjects.erase(dead);
     }
   }
+}
 
+void Board::commitNewObjects()
+{
   // add any new objects to the board
   for (std::set<GameObject*>::iterator it = m_newObjects.begin();
        it != m_newObjects.end(); ++it) {
     if (m_board[(*it)->y() * m_width + (*it)->x()] != 0)
       throw Exception("Trying to create new game object at already occupied location.");
     m_board[(*it)->y() * m_width + (*it)->x()] = *it;
+
+    if ((*it)->isBlocked())
+      m_oracle.setBlocked((*it)->x(), (*it)->y(), true);
+    if (const Block* block = dynamic_cast<const Block*>(*it))
+      m_oracle.addBlock(block->x(), block->y(), block->color());
   }
   m_newObjects.clear();
+}
 
-  // Update the player
-  m_player->update(delta_time);
+void Board::detonate(Uint16 x, Uint16 y)
+{
+  m_detonations.push_back(y * m_width + x);
+}
 
-  // Update the free list
-  // This is inefficient.
-  m_freeTiles.clear();
-  bool has_block = false;
-  for (Uint16 y = 0; y < m_height; ++y) {
-    for (Uint16 x = 0; x < m_width; ++x) {
-      const GameObject* go = m_board[y * m_width + x];
-      if (go == 0) {
-        if (m_player->x() == x && m_player->y() == y)
-          continue;
-        m_freeTiles.push_back(std::make_pair(x, y));
-      } else if (dynamic_cast<const Block*>(go)) {
-        has_block = true;
-      }
-    }
-  }
+void Board::resolveDetonations()
+{
+  if (m_detonations.empty())
+    return;
 
-  // if time between blocks for this level has passed,
-  // add a new block
-  m_block_time += delta_time;
-  if (m_block_time > m_level->delayBetweenBlocks()) {
-    newBlock();
-    m_block_time = 0;
+  // Find every bomb on the board in one pass. Chain reactions are
+  // then resolved purely on the masks: each bomb that goes off adds
+  // its blast area to m_blast and queues any still unexploded bombs
+  // inside that area. Every bomb is queued at most once since its
+  // bit is cleared when it is queued.
+  m_bombs.clear();
+  for (std::vector<GameObject*>::size_type i = 0; i < m_board.size(); ++i) {
+    if (m_board[i] && dynamic_cast<const Bomb*>(m_board[i]))
+      m_bombs.setIndex(i);
   }
-
-  // if there are no blocks on the board, add one
-  if (!has_block) {
-    newBlock();
+  for (std::vector<Uint32>::const_iterator it = m_detonations.begin();
+       it != m_detonations.end(); ++it)
+    m_bombs.resetIndex(*it);
+
+  const Uint16 radius = m_level->bombRadius();
+  m_blast.clear();
+  while (!m_detonations.empty()) {
+    const Uint32 pos = m_detonations.back();
+    m_detonations.pop_back();
+
+    m_area.clear();
+    m_area.setArea(pos % m_width, pos / m_width, radius);
+    m_blast |= m_area;
+
+    m_area &= m_bombs;
+    for (Uint32 i = 0; m_area.findNext(i); ++i) {
+      m_bombs.resetIndex(i);
+      m_detonations.push_back(i);
+    }
   }
 
-  // If player collides with object, pass on effects
-  GameObject* collider = m_board[m_player->y() * m_width + m_player->x()];
-  if (collider)
-    collider->collision(m_player);
+  // Now clear out everything caught in the blast
+  for (Uint32 i = 0; m_blast.findNext(i); ++i) {
+    if (!m_board[i])
+      continue;
+    if (dynamic_cast<const Bomb*>(m_board[i]))
+      m_particles.explosion(tileCenterX(i % m_width), tileCenterY(i / m_width));
+    removeGameObject(m_board[i]);
+  }
 
-  if (boxedIn()) {
+  if (m_blast.test(m_player->x(), m_player->y())
+      && !m_player->effects().modifiers().shield) {
     Effect e;
     e.life = -1;
     m_player->setEffects(e);
@@ -159,40 +273,109 @@ void Board::centerDraw(const GameObject* obj, const SDL_Rect& srect, SDL_Rect& d
   }
 }
 
-void Board::draw(SDL_Surface* screen)
+void Board::submit(RenderQueue& queue, const GameObject* obj, SDL_Surface* surface,
+                   const SDL_Rect& frame, RenderQueue::LAYER layer)
+{
+  SDL_Rect drect;
+  centerDraw(obj, frame, drect);
+  queue.submit(surface, frame, drect.x, drect.y, layer);
+}
+
+void Board::drawGrid(SDL_Surface* screen)
 {
-  // draw the game grid
-  const int w_off = m_grid->w;
-  const int h_off = m_grid->h;
-  for (Uint16 h = 0; h < m_height; ++h) {
-    for (Uint16 w = 0; w < m_width; ++w) {
+  for (Uint16 y = 0; y < m_height; ++y) {
+    for (Uint16 x = 0; x < m_width; ++x) {
       SDL_Rect r;
-      r.x = h * m_grid->h + h_off;
-      r.y = w * m_grid->w + w_off;
-      SDL_BlitSurface(m_grid, 0, screen, &r);
+      r.x = x * m_grid->w + m_grid->w;
+      r.y = y * m_grid->h + m_grid->h;
+      blit::blitSurface(m_grid, 0, screen, &r);
     }
   }
+}
 
-  // draw all game objects
-  SDL_Rect srect;
-  SDL_Rect drect;
-  SDL_Surface* surf;
-  for (std::vector<GameObject*>::iterator it = m_board.begin();
-       it != m_board.end(); ++it) {
-    if (!*it)
+void Board::markDirty(DirtyRects& dirty, RenderQueue& queue)
+{
+  SDL_Rect tile;
+  tile.w = m_grid->w;
+  tile.h = m_grid->h;
+
+  for (Uint32 i = 0; i < m_board.size(); ++i) {
+    DrawnTile now;
+    now.surface = 0;
+    now.frame.x = now.frame.y = 0;
+    now.frame.w = now.frame.h = 0;
+    now.rect = now.frame;
+    const Uint32 first = queue.size();
+    if (m_board[i])
+      m_board[i]->draw(queue);
+    if (queue.size() > first) {
+      const RenderQueue::Command& c = queue.command(first);
+      now.surface = c.surface;
+      now.frame = c.src;
+      now.rect = c.dst;
+    }
+
+    // a different surface, animation frame or position
+    DrawnTile& then = m_drawn[i];
+    if (now.surface == then.surface && now.frame.x == then.frame.x
+        && now.frame.y == then.frame.y && now.rect.x == then.rect.x
+        && now.rect.y == then.rect.y && now.rect.w == then.rect.w
+        && now.rect.h == then.rect.h)
       continue;
+    tile.x = (i % m_width) * m_grid->w + m_grid->w;
+    tile.y = (i / m_width) * m_grid->h + m_grid->h;
+    dirty.add(tile);
+    if (then.surface)
+      dirty.add(then.rect);
+    if (now.surface)
+      dirty.add(now.rect);
+    then = now;
+  }
 
-    (*it)->draw(surf, srect);
-    centerDraw(*it, srect, drect);
-    if (surf)
-      SDL_BlitSurface(surf, &srect, screen, &drect);
+  m_player->draw(queue);
+  if (m_player->x() != m_drawn_player_x || m_player->y() != m_drawn_player_y
+      || m_player->orientation() != m_drawn_orientation) {
+    if (m_drawn_player_x < m_width) {
+      tile.x = m_drawn_player_x * m_grid->w + m_grid->w;
+      tile.y = m_drawn_player_y * m_grid->h + m_grid->h;
+      dirty.add(tile);
+    }
+    tile.x = m_player->x() * m_grid->w + m_grid->w;
+    tile.y = m_player->y() * m_grid->h + m_grid->h;
+    dirty.add(tile);
+    m_drawn_player_x = m_player->x();
+    m_drawn_player_y = m_player->y();
+    m_drawn_orientation = m_player->orientation();
   }
 
-  // Draw the player on top
-  m_player->draw(surf, srect);
-  centerDraw(m_player, srect, drect);
-  if (surf)
-    SDL_BlitSurface(surf, &srect, screen, &drect);
+  // particles move every frame; where they were and where they are
+  m_particles.draw(queue);
+  const SDL_Rect particles = m_particles.bounds();
+  if (m_drawn_particles.w)
+    dirty.add(m_drawn_particles);
+  if (particles.w)
+    dirty.add(particles);
+  m_drawn_particles = particles;
+}
+
+void Board::pushOff(Player* player)
+{
+  Uint32 best = m_freeTiles.size();
+  Uint32 best_distance = 0;
+  for (Uint32 i = 0; i < m_freeTiles.size(); ++i) {
+    const Uint16 x = m_freeTiles[i].first;
+    const Uint16 y = m_freeTiles[i].second;
+    // new blocks may have taken free tiles since the list was made
+    if (objectAt(y * m_width + x))
+      continue;
+    const Uint32 distance = std::abs(x - player->x()) + std::abs(y - player->y());
+    if (best == m_freeTiles.size() || distance < best_distance) {
+      best = i;
+      best_distance = distance;
+    }
+  }
+  if (best != m_freeTiles.size())
+    player->setPos(m_freeTiles[best].first, m_freeTiles[best].second);
 }
 
 std::vector<std::pair<Uint16, Uint16> > Board::freeTiles() const
@@ -206,39 +389,26 @@ void Board::newBlock()
     if (free_blocks.empty())
       return;
 
-    std::pair<Uint16, Uint16> new_block = free_blocks[rand() % free_blocks.size()];
-    switch (rand() % 6) {
-    case 0:
-      new Block(this, new_block.first, new_block.second,
-                *dynamic_cast<AnimationResource*>(loader().load("animations/red-animation.res")),
-                RED, m_level->blockToWallDelay());
-      break;
-    case 1:
-      new Block(this, new_block.first, new_block.second,
-                *dynamic_cast<AnimationResource*>(loader().load("animations/green-animation.res")),
-                GREEN, m_level->blockToWallDelay());
-      break;
-    case 2:
-      new Block(this, new_block.first, new_block.second,
-                *dynamic_cast<AnimationResource*>(loader().load("animations/blue-animation.res")),
-                BLUE, m_level->blockToWallDelay());
-      break;
-    case 3:
-      new Block(this, new_block.first, new_block.second,
-                *dynamic_cast<AnimationResource*>(loader().load("animations/yellow-animation.res")),
-                YELLOW, m_level->blockToWallDelay());
-      break;
-    case 4:
-      new Block(this, new_block.first, new_block.second,
-                *dynamic_cast<AnimationResource*>(loader().load("animations/purple-animation.res")),
-                PURPLE, m_level->blockToWallDelay());
-      break;
-    case 5:
-      new Block(this, new_block.first, new_block.second,
-                *dynamic_cast<AnimationResource*>(loader().load("animations/cyan-animation.res")),
-                CYAN, m_level->blockToWallDelay());
-      break;
-    }
+    std::pair<Uint16, Uint16> new_block = free_blocks[m_random.next(free_blocks.size())];
+    createBlock(new_block.first, new_block.second,
+                static_cast<BLOCK_COLOR>(m_random.next(6)), m_level->blockToWallDelay());
+}
+
+Block* Board::createBlock(Uint16 x, Uint16 y, BLOCK_COLOR col, Sint32 timeout)
+{
+  // indexed by BLOCK_COLOR
+  static const char* const animations[] = {
+    "animations/red-animation.res",
+    "animations/green-animation.res",
+    "animations/blue-animation.res",
+    "animations/yellow-animation.res",
+    "animations/purple-animation.res",
+    "animations/cyan-animation.res"
+  };
+
+  return new Block(this, x, y,
+                   *dynamic_cast<AnimationResource*>(loader().load(animations[col])),
+                   col, timeout);
 }
 
 bool Board::isBlocked(Uint16 test_x, Uint16 test_y)
@@ -251,38 +421,39 @@ bool Board::isBlocked(Uint16 test_x, Uint16 test_y)
 
 bool Board::boxedIn() const
 {
-  // If the player is surrounded by walls on all sides, the player loses a life
+  // If the player is surrounded by walls (or bombs) on all sides, the
+  // player loses a life
   int wallCount = 0;
   // check left
   if (m_player->x() == 0) {
     ++wallCount;
   } else {
-    Wall* w = dynamic_cast<Wall*>(m_board[m_player->y() * m_width + m_player->x() - 1]);
-    if (w)
+    GameObject* go = m_board[m_player->y() * m_width + m_player->x() - 1];
+    if (go && go->isBlocked())
       ++wallCount;
   }
   // check right
   if (m_player->x() == m_width - 1) {
     ++wallCount;
   } else {
-    Wall* w = dynamic_cast<Wall*>(m_board[m_player->y() * m_width + m_player->x() + 1]);
-    if (w)
+    GameObject* go = m_board[m_player->y() * m_width + m_player->x() + 1];
+    if (go && go->isBlocked())
       ++wallCount;
   }
   // check up
   if (m_player->y() == 0) {
     ++wallCount;
   } else {
-    Wall* w = dynamic_cast<Wall*>(m_board[(m_player->y() - 1) * m_width + m_player->x()]);
-    if (w)
+    GameObject* go = m_board[(m_player->y() - 1) * m_width + m_player->x()];
+    if (go && go->isBlocked())
       ++wallCount;
   }
   // check down
   if (m_player->y() == m_height - 1) {
     ++wallCount;
   } else {
-    Wall* w = dynamic_cast<Wall*>(m_board[(m_player->y() + 1) * m_width + m_player->x()]);
-    if (w)
+    GameObject* go = m_board[(m_player->y() + 1) * m_width + m_player->x()];
+    if (go && go->isBlocked())
       ++wallCount;
   }
 
@@ -292,6 +463,135 @@ bool Board::boxedIn() const
   return false;
 }
 
+namespace {
+  // What a board tile holds, as stored in snapshots
+  enum TILE_KIND { TILE_EMPTY = 0, TILE_BLOCK, TILE_WALL, TILE_BOMB };
+
+  // Bonus for collecting a block in the least possible number of rolls
+  const Sint16 OPTIMUM_PICKUP_BONUS = 200;
+}
+
+const GameObject* Board::objectAt(Uint32 index) const
+{
+  if (m_board[index])
+    return m_board[index];
+
+  // Objects created late in an update (like new blocks) don't get
+  // onto the board until the next update.
+  for (std::set<GameObject*>::const_iterator it = m_newObjects.begin();
+       it != m_newObjects.end(); ++it) {
+    if (static_cast<Uint32>((*it)->y() * m_width + (*it)->x()) == index)
+      return *it;
+  }
+  return 0;
+}
+
+void Board::saveState(SnapshotWriter& out) const
+{
+  out.putByte('B');
+  out.putByte('N');
+  out.putByte('B');
+  out.putByte(SNAPSHOT_VERSION);
+  out.putVarint(m_random.state());
+  out.putVarint(m_width);
+  out.putVarint(m_height);
+  out.putVarint(m_block_time);
+  m_level->saveState(out);
+
+  // One byte per tile, kind in the low two bits and block colour in
+  // the next three, followed by the tile's timers if it has any. Runs
+  // of empty tiles are stored as a zero byte and the length of the run.
+  const Uint32 tiles = m_width * m_height;
+  for (Uint32 i = 0; i < tiles; ++i) {
+    const GameObject* go = objectAt(i);
+    if (!go) {
+      Uint32 run = 1;
+      while (i + run < tiles && !objectAt(i + run))
+        ++run;
+      out.putByte(TILE_EMPTY);
+      out.putVarint(run);
+      i += run - 1;
+    } else if (const Block* block = dynamic_cast<const Block*>(go)) {
+      out.putByte(TILE_BLOCK | (block->color() << 2));
+      out.putSigned(block->startTimeout());
+      out.putSigned(block->timeout());
+    } else if (const Bomb* bomb = dynamic_cast<const Bomb*>(go)) {
+      out.putByte(TILE_BOMB);
+      out.putSigned(bomb->fuse());
+    } else {
+      out.putByte(TILE_WALL);
+    }
+  }
+
+  m_player->saveState(out);
+}
+
+void Board::restoreState(SnapshotReader& in)
+{
+  if (in.getByte() != 'B' || in.getByte() != 'N' || in.getByte() != 'B')
+    throw Exception("Not a Blocks and Bombs snapshot");
+  if (in.getByte() != SNAPSHOT_VERSION)
+    throw Exception("Snapshot is from an incompatible version of the game");
+  const Uint32 random_state = in.getVarint();
+  if (in.getVarint() != m_width || in.getVarint() != m_height)
+    throw Exception("Snapshot board size doesn't match the current board");
+
+  // Throw away the current game objects. Dead objects are always
+  // still on the board, so they go with it.
+  for (std::vector<GameObject*>::iterator it = m_board.begin();
+       it != m_board.end(); ++it) {
+    delete *it;
+    *it = 0;
+  }
+  for (std::set<GameObject*>::iterator it = m_newObjects.begin();
+       it != m_newObjects.end(); ++it)
+    delete *it;
+  m_newObjects.clear();
+  m_deadObjects.clear();
+  m_detonations.clear();
+  // addGameObject() refuses everything once the free list runs dry,
+  // so it has to reflect the now empty board before we refill it.
+  updateFreeTiles();
+
+  m_random.setState(random_state);
+  m_block_time = in.getVarint();
+  m_level->restoreState(in);
+
+  const Uint32 tiles = m_width * m_height;
+  for (Uint32 i = 0; i < tiles; ++i) {
+    const Uint16 x = i % m_width;
+    const Uint16 y = i / m_width;
+    const Uint8 tile = in.getByte();
+    switch (tile & 3) {
+    case TILE_EMPTY:
+      i += in.getVarint() - 1;
+      break;
+    case TILE_BLOCK: {
+      const Uint8 col = (tile >> 2) & 7;
+      if (col > CYAN)
+        throw Exception("Snapshot has a block of unknown colour");
+      const Sint32 start_timeout = in.getSigned();
+      const Sint32 timeout = in.getSigned();
+      createBlock(x, y, static_cast<BLOCK_COLOR>(col), start_timeout)
+        ->setTimeout(start_timeout, timeout);
+      break;
+    }
+    case TILE_WALL:
+      new Wall(this, x, y);
+      break;
+    case TILE_BOMB:
+      new Bomb(this, x, y, in.getSigned());
+      break;
+    }
+  }
+  m_player->restoreState(in);
+  m_oracle.reset();
+  m_oracle.trackPlayer(m_player->x(), m_player->y(), m_player->orientation(),
+                       m_player->rolls());
+  commitNewObjects();
+  updateFreeTiles();
+}
+
 Block::Block(Board* board, Uint16 x, Uint16 y, AnimationResource& anim, BLOCK_COLOR col,
              Sint32 timeout)
   : GameObject(board, x, y), m_col(col), m_anim(anim),
@@ -302,6 +602,11 @@ Block::Block(Board* board, Uint16 x, Uint16 y, AnimationResource& anim, BLOCK_CO
   m_board->addGameObject(this);
 }
 
+Block::~Block()
+{
+  m_board->loader().unload(&m_anim);
+}
+
 void Block::update(Uint32 delta_time)
 {
   m_current_frame = m_anim.currentFrameSurface(delta_time);
@@ -309,7 +614,10 @@ void Block::update(Uint32 delta_time)
   m_timeout -= delta_time;
   if (m_timeout <= 0) {
     m_board->removeGameObject(this);
-    new Wall(m_board, m_x, m_y);
+    if (m_board->random().next(100) < m_board->level()->bombChance())
+      new Bomb(m_board, m_x, m_y, m_board->level()->bombFuse());
+    else
+      new Wall(m_board, m_x, m_y);
     m_board->level()->failedBlockPickup();
     return;
   }
@@ -323,10 +631,9 @@ void Block::update(Uint32 delta_time)
   }
 }
 
-void Block::draw(SDL_Surface*& surface, SDL_Rect& rect)
+void Block::draw(RenderQueue& queue)
 {
-  surface = m_current_frame;
-  rect = m_current_frame_rect;
+  m_board->submit(queue, this, m_current_frame, m_current_frame_rect);
 }
 
 void Block::collision(GameObject* other)
@@ -342,13 +649,16 @@ void Block::collision(GameObject* other)
   e.score = 1000;
   if (m_timeout > 0)
     e.score += 1000.0 * (100.0 / m_start_timeout * m_timeout / 100);
+  if (m_board->pickupOracle().isOptimalPickup(m_x, m_y))
+    e.score += OPTIMUM_PICKUP_BONUS;
   player->setEffects(e);
   m_board->level()->blockPickup(m_col);
+  m_board->particles().pickup(m_board->tileCenterX(m_x), m_board->tileCenterY(m_y), m_col);
   m_board->removeGameObject(this);
 }
 
 Wall::Wall(Board* board, Uint16 x, Uint16 y)
-  : GameObject(board, x, y), m_current_frame(IMG_LoadDisplayFormat("wall.png")),
+  : GameObject(board, x, y), m_current_frame(board->loader().image("wall.png")),
     m_current_frame_rect()
 {
   m_current_frame_rect.x = 0;
@@ -358,11 +668,9 @@ Wall::Wall(Board* board, Uint16 x, Uint16 y)
   m_board->addGameObject(this);
 }
 
-void Wall::draw(SDL_Surface*& surface, SDL_Rect& rect)
+void Wall::draw(RenderQueue& queue)
 {
-  surface = m_current_frame;
-  SDL_Rect r = m_current_frame_rect;
-  rect = r;
+  m_board->submit(queue, this, m_current_frame, m_current_frame_rect);
 }
 
 void Wall::collision(GameObject* other)
@@ -373,50 +681,170 @@ void Wall::collision(GameObject* other)
 
   // Ok, the only way a player can collide with a wall is if the wall
   // materialized from a block while the player was occupying the
-  // tile. If this happens the player loses a life.
+  // tile, or if the player walked onto it as a ghost. If this happens
+  // (and the player isn't, or is no longer, a ghost) the player loses
+  // a life.
+  if (player->effects().modifiers().ghost)
+    return;
 
   Effect e;
   e.life = -1;
   player->setEffects(e);
+  // One life is enough - don't leave the player stuck in the wall,
+  // dying again on every update until they walk out.
+  m_board->pushOff(player);
+}
+
+Bomb::Bomb(Board* board, Uint16 x, Uint16 y, Sint32 fuse)
+  : GameObject(board, x, y), m_current_frame(board->loader().image("bomb.png")),
+    m_current_frame_rect(), m_fuse(fuse), m_lit(true)
+{
+  m_current_frame_rect.x = 0;
+  m_current_frame_rect.y = 0;
+  m_current_frame_rect.w = m_current_frame->w;
+  m_current_frame_rect.h = m_current_frame->h;
+  m_board->addGameObject(this);
+}
+
+void Bomb::update(Uint32 delta_time)
+{
+  if (!m_lit)
+    return;
+
+  m_fuse -= delta_time;
+  if (m_fuse <= 0) {
+    m_lit = false;
+    m_board->detonate(m_x, m_y);
+  }
+}
+
+void Bomb::draw(RenderQueue& queue)
+{
+  m_board->submit(queue, this, m_current_frame, m_current_frame_rect);
+}
+
+void Bomb::collision(GameObject* other)
+{
+  Player* player = dynamic_cast<Player*>(other);
+  if (!player || !m_lit || player->effects().modifiers().ghost)
+    return;
+
+  // Just like with walls, the only way the player can end up on a
+  // bomb is if it materialized from a block underneath the
+  // player. That sets it off right away.
+  m_lit = false;
+  m_board->detonate(m_x, m_y);
+}
+
+namespace {
+  // Composes the 24 orientation sprites of the player's cube from the
+  // strips of cube pieces, each piece strip having one piece per colour.
+  SDL_Surface* buildCubeSprites()
+  {
+    SDL_Surface* sprites = SDL_CreateRGBSurface(SDL_SWSURFACE|SDL_SRCALPHA,
+                                                32 * cube::ORIENTATIONS, 32, 32,
+                                                0, 0, 0, 0);
+    if (!sprites)
+      throw Exception("Unable to create player sprites: " + std::string(SDL_GetError()));
+    if (SDL_FillRect(sprites, 0, SDL_MapRGBA(sprites->format, 0, 0, 0, 0)))
+      throw Exception("Clearing player sprites failed: " + std::string(SDL_GetError()));
+
+    SDL_Surface* top_img = IMG_LoadDisplayFormat("cube-top.png");
+    SDL_Surface* up_img = IMG_LoadDisplayFormat("cube-up.png");
+    SDL_Surface* down_img = IMG_LoadDisplayFormat("cube-down.png");
+    SDL_Surface* left_img = IMG_LoadDisplayFormat("cube-left.png");
+    SDL_Surface* right_img = IMG_LoadDisplayFormat("cube-right.png");
+
+    for (Uint8 o = 0; o < cube::ORIENTATIONS; ++o) {
+      const cube::Faces& f = cube::faces(o);
+      const Sint16 x = 32 * o;
+      SDL_Rect src;
+      SDL_Rect dst;
+
+      // src y is always 0 and x can be determined by the color
+      src.y = 0;
+      src.x = 32 * static_cast<int>(f.up);
+      src.w = 32;
+      src.h = up_img->h;
+      dst.x = x;
+      dst.y = 0;
+      SDL_BlitSurface(up_img, &src, sprites, &dst);
+
+      src.x = 5 * static_cast<int>(f.left);
+      src.w = 5;
+      src.h = left_img->h;
+      dst.x = x;
+      dst.y = 0;
+      SDL_BlitSurface(left_img, &src, sprites, &dst);
+
+      src.x = 22 * static_cast<int>(f.top);
+      src.w = 22;
+      src.h = top_img->h;
+      dst.x = x + 5;
+      dst.y = 5;
+      SDL_BlitSurface(top_img, &src, sprites, &dst);
+
+      src.x = 5 * static_cast<int>(f.right);
+      src.w = 5;
+      src.h = right_img->h;
+      dst.x = x + 27;
+      dst.y = 0;
+      SDL_BlitSurface(right_img, &src, sprites, &dst);
+
+      src.x = 32 * static_cast<int>(f.down);
+      src.w = 32;
+      src.h = down_img->h;
+      dst.x = x;
+      dst.y = 27;
+      SDL_BlitSurface(down_img, &src, sprites, &dst);
+    }
+
+    SDL_FreeSurface(right_img);
+    SDL_FreeSurface(left_img);
+    SDL_FreeSurface(down_img);
+    SDL_FreeSurface(up_img);
+    SDL_FreeSurface(top_img);
+    return sprites;
+  }
 }
 
 Player::Player(Board* board, Uint16 x, Uint16 y)
   : GameObject(board, x, y),
     m_direction(NONE), m_move_delay(120), m_time_since_move(0),
-    m_top(RED), m_bottom(PURPLE), m_up(BLUE), m_down(CYAN), m_left(GREEN),
-    m_right(YELLOW),
-    m_top_img(IMG_LoadDisplayFormat("cube-top.png")),
-    m_up_img(IMG_LoadDisplayFormat("cube-up.png")),
-    m_down_img(IMG_LoadDisplayFormat("cube-down.png")),
-    m_left_img(IMG_LoadDisplayFormat("cube-left.png")),
-    m_right_img(IMG_LoadDisplayFormat("cube-right.png")),
-    m_frame(SDL_CreateRGBSurface(SDL_SWSURFACE|SDL_SRCALPHA, 32, 32, 32, 0, 0, 0, 0)),
-    m_score(0), m_life(3)
+    m_orientation(cube::initialOrientation()), m_sprites(buildCubeSprites()),
+    m_score(0), m_life(3), m_rolls(0), m_effects()
 {
-  if (!m_frame)
-    throw Exception("Unable to create frame surface for player: "
-                    + std::string(SDL_GetError()));
 }
 
 Player::~Player()
 {
-  SDL_FreeSurface(m_frame);
-  SDL_FreeSurface(m_right_img);
-  SDL_FreeSurface(m_left_img);
-  SDL_FreeSurface(m_down_img);
-  SDL_FreeSurface(m_up_img);
-  SDL_FreeSurface(m_top_img);
+  SDL_FreeSurface(m_sprites);
 }
 
 void Player::update(Uint32 delta_time)
 {
+  m_effects.update(delta_time);
+  const EffectModifiers& mods = m_effects.modifiers();
+
   m_time_since_move += delta_time;
 
-  if (m_time_since_move < m_move_delay)
+  if (m_time_since_move < m_move_delay * mods.move_delay_percent / 100)
     return;
 
-  enum BLOCK_COLOR tmp;
-  switch (m_direction) {
+  PLAYER_DIRECTION direction = m_direction;
+  if (mods.backwards) {
+    switch (m_direction) {
+    case UP: direction = DOWN; break;
+    case DOWN: direction = UP; break;
+    case LEFT: direction = RIGHT; break;
+    case RIGHT: direction = LEFT; break;
+    case NONE: break;
+    }
+  }
+
+  const Uint16 old_x = m_x;
+  const Uint16 old_y = m_y;
+  switch (direction) {
   case NONE:
     return;
 
@@ -424,193 +852,184 @@ void Player::update(Uint32 delta_time)
     // roll the cube up (if that field is not blocked and we are not at edge of board)
     if (m_y == 0)
       break;
-    if (m_board->isBlocked(m_x, m_y - 1))
+    if (!mods.ghost && m_board->isBlocked(m_x, m_y - 1))
       break;
     setPos(m_x, m_y - 1);
-    // update the colors
-    tmp = m_bottom;
-    m_bottom = m_up;
-    m_up = m_top;
-    m_top = m_down;
-    m_down = tmp;
+    m_orientation = cube::roll(m_orientation, cube::ROLL_UP);
     break;
 
   case DOWN:
     // roll the cube down
     if (m_y == m_board->height() - 1)
       break;
-    if (m_board->isBlocked(m_x, m_y + 1))
+    if (!mods.ghost && m_board->isBlocked(m_x, m_y + 1))
       break;
     setPos(m_x, m_y + 1);
-    tmp = m_bottom;
-    m_bottom = m_down;
-    m_down = m_top;
-    m_top = m_up;
-    m_up = tmp;
+    m_orientation = cube::roll(m_orientation, cube::ROLL_DOWN);
     break;
 
   case LEFT:
     // roll the cube left
     if (m_x == 0)
       break;
-    if (m_board->isBlocked(m_x - 1, m_y))
+    if (!mods.ghost && m_board->isBlocked(m_x - 1, m_y))
       break;
     setPos(m_x - 1, m_y);
-    tmp = m_bottom;
-    m_bottom = m_left;
-    m_left = m_top;
-    m_top = m_right;
-    m_right = tmp;
+    m_orientation = cube::roll(m_orientation, cube::ROLL_LEFT);
     break;
 
   case RIGHT:
     // roll the cube right
     if (m_x == m_board->width() - 1)
       break;
-    if (m_board->isBlocked(m_x + 1, m_y))
+    if (!mods.ghost && m_board->isBlocked(m_x + 1, m_y))
       break;
     setPos(m_x + 1, m_y);
-    tmp = m_bottom;
-    m_bottom = m_right;
-    m_right = m_top;
-    m_top = m_left;
-    m_left = tmp;
+    m_orientation = cube::roll(m_orientation, cube::ROLL_RIGHT);
     break;
   }
 
   // We don't count hitting a wall or the edge of the board as a move,
   // so only reset the time since last move here.
   m_time_since_move = 0;
+  if (m_x != old_x || m_y != old_y)
+    ++m_rolls;
 }
 
-void Player::draw(SDL_Surface*& surface, SDL_Rect& rect)
-{
-  // clear our frame surface
-  Uint32 col = SDL_MapRGBA(m_frame->format, 0, 0, 0, 0);
-  if (SDL_FillRect(m_frame, 0, col))
-    throw Exception("Clearing player frame failed: "
-                    + std::string(SDL_GetError()));
-
-  SDL_Rect src;
-  SDL_Rect dst;
-
-  // src y is always 0 and x can be determined by the color
-  src.y = 0;
-  src.x = 32 * static_cast<int>(m_up);
-  src.w = 32;
-  src.h = m_up_img->h;
-  dst.x = 0;
-  dst.y = 0;
-  dst.w = 32;
-  dst.h = m_up_img->h;
-  SDL_BlitSurface(m_up_img, &src, m_frame, &dst);
-
-  src.x = 5 * static_cast<int>(m_left);
-  src.w = 5;
-  src.h = m_left_img->h;
-  dst.x = 0;
-  dst.y = 0;
-  dst.w = 5;
-  dst.h = m_left_img->h;
-  SDL_BlitSurface(m_left_img, &src, m_frame, &dst);
-
-  src.x = 22 * static_cast<int>(m_top);
-  src.w = 22;
-  src.h = m_top_img->h;
-  dst.x = 5;
-  dst.y = 5;
-  dst.w = 22;
-  dst.h = m_top_img->h;
-  SDL_BlitSurface(m_top_img, &src, m_frame, &dst);
-
-  src.x = 5 * static_cast<int>(m_right);
-  src.w = 5;
-  src.h = m_right_img->h;
-  dst.x = 27;
-  dst.y = 0;
-  dst.w = 5;
-  dst.h = m_right_img->h;
-  SDL_BlitSurface(m_right_img, &src, m_frame, &dst);
-
-  src.x = 32 * static_cast<int>(m_down);
-  src.w = 32;
-  src.h = m_down_img->h;
-  dst.x = 0;
-  dst.y = 27;
-  dst.w = 32;
-  dst.h = m_down_img->h;
-  SDL_BlitSurface(m_down_img, &src, m_frame, &dst);
-
-  SDL_Rect r;
-  r.x = 0;
-  r.y = 0;
-  r.w = m_frame->w;
-  r.h = m_frame->h;
-  rect = r;
-  surface = m_frame;
+void Player::draw(RenderQueue& queue)
+{
+  SDL_Rect rect;
+  rect.x = 32 * m_orientation;
+  rect.y = 0;
+  rect.w = 32;
+  rect.h = 32;
+  m_board->submit(queue, this, m_sprites, rect, RenderQueue::LAYER_PLAYER);
+}
+
+void Player::saveState(SnapshotWriter& out) const
+{
+  out.putByte(m_x);
+  out.putByte(m_y);
+  out.putByte(m_direction);
+  out.putVarint(m_move_delay);
+  out.putVarint(m_time_since_move);
+  // all six faces in three bytes
+  const cube::Faces& f = cube::faces(m_orientation);
+  out.putByte(f.top | (f.bottom << 4));
+  out.putByte(f.up | (f.down << 4));
+  out.putByte(f.left | (f.right << 4));
+  out.putVarint(m_score);
+  out.putVarint(m_life);
+  out.putVarint(m_rolls);
+  m_effects.saveState(out);
+}
+
+void Player::restoreState(SnapshotReader& in)
+{
+  m_x = in.getByte();
+  m_y = in.getByte();
+  if (m_x >= m_board->width() || m_y >= m_board->height())
+    throw Exception("Snapshot has the player outside the board");
+  m_direction = static_cast<PLAYER_DIRECTION>(in.getByte() % (RIGHT + 1));
+  m_move_delay = in.getVarint();
+  m_time_since_move = in.getVarint();
+  // top and up are enough to tell the orientation
+  const Uint8 top = in.getByte() & 0x0f;
+  const Uint8 up = in.getByte() & 0x0f;
+  in.getByte();
+  if (top > CYAN || up > CYAN)
+    throw Exception("Snapshot has a broken player cube");
+  m_orientation = cube::orientation(static_cast<BLOCK_COLOR>(top), static_cast<BLOCK_COLOR>(up));
+  if (m_orientation >= cube::ORIENTATIONS)
+    throw Exception("Snapshot has a broken player cube");
+  m_score = in.getVarint();
+  m_life = in.getVarint();
+  m_rolls = in.getVarint();
+  m_effects.restoreState(in);
 }
 
 void Player::setEffects(const Effect& e)
 {
-  m_score += e.score;
+  // croesus/poor only scale what is gained, never penalties
+  if (e.score > 0)
+    m_score += e.score * m_effects.modifiers().score_percent / 100;
+  else
+    m_score += e.score;
   m_life += e.life;
+
+  if (e.life < 0) {
+    m_effects.playerDied();
+    m_board->particles().death(m_board->tileCenterX(m_x), m_board->tileCenterY(m_y));
+  }
+  if (e.timed != EFFECT_NONE)
+    m_effects.add(e.timed, e.duration);
 }
 
+namespace {
+  // Where the status area goes on screen
+  SDL_Rect statusRect()
+  {
+    SDL_Rect r;
+    // our width is the fixed screen width minus the max width for the
+    // board, minus 2 times a grid square for a border around the board
+    // minus 1 grid square for a right hand border for us.
+    r.w = 800 - 32*16 - 32*2 - 32;
+    // height is max height of the game board
+    r.h = 16*32;
+    // start one grid square down
+    r.y = 32;
+    // and one grid square right of the board
+    r.x = 32*16 + 32*2;
+    return r;
+  }
+
+  // The game is updated every 30ms, so this keeps 10 seconds of history
+  const Uint32 HISTORY_LENGTH = 334;
+  const Uint32 HISTORY_KEYFRAME_INTERVAL = 32;
+  // How far back (in updates) dying in practice mode and pressing
+  // backspace take us
+  const Uint32 PRACTICE_DEATH_REWIND = 67;
+  const Uint32 PRACTICE_MANUAL_REWIND = 33;
+  const Uint32 AUTOSAVE_INTERVAL = 5000;
+  // long enough for blocks not to run out in any benchmark
+  const Sint32 FILL_TIMEOUT = 1 << 30;
+}
+
+const Uint32 PlayState::PAUSED_INTERVAL;
+
 PlayState::PlayState()
   : m_background(IMG_LoadDisplayFormat("game-background.png")),
-    m_status_background(0), m_pause_background(0),
+    m_layers(), m_queue(), m_hud(statusRect()),
     m_textWriter(new TextWriter("whitrabt.ttf", 20)),
-    m_resourceLoader(), m_board(m_resourceLoader, 1), m_paused(false)
-{
-  Uint32 rmask, gmask, bmask, amask;
-  // SDL interprets each pixel as a 32-bit number, so our masks must
-  // depend on the endianness (byte order) of the machine
-#if SDL_BYTEORDER == SDL_BIG_ENDIAN
-    rmask = 0xff000000;
-    gmask = 0x00ff0000;
-    bmask = 0x0000ff00;
-    amask = 0x000000ff;
-#else
-    rmask = 0x000000ff;
-    gmask = 0x0000ff00;
-    bmask = 0x00ff0000;
-    amask = 0xff000000;
-#endif
-
-  SDL_Rect dstrect;
-  // our width is the fixed screen width minus the max width for the
-  // board, minus 2 times a grid square for a border around the board
-  // minus 1 grid square for a right hand border for us.
-  dstrect.w = 800 - 32*16 - 32*2 - 32;
-  // height is max height of the game board
-  dstrect.h = 16*32;
-  // start one grid square down
-  dstrect.y = 32;
-  // and one grid square right of the board
-  dstrect.x = 32*16 + 32*2;
-
-  SDL_Surface* tmp = SDL_CreateRGBSurface(SDL_SWSURFACE|SDL_SRCALPHA,
-                                          dstrect.w, dstrect.h, 32,
-                                          rmask, gmask, bmask, amask);
-  SDL_FillRect(tmp, 0, SDL_MapRGBA(tmp->format, 0, 0, 0, 127));
-  m_status_background = SDL_DisplayFormatAlpha(tmp);
-  SDL_FreeSurface(tmp);
-
-  tmp = SDL_CreateRGBSurface(SDL_SWSURFACE|SDL_SRCALPHA,
-                             800, 600, 32, rmask, gmask, bmask, amask);
-  SDL_FillRect(tmp, 0, SDL_MapRGBA(tmp->format, 0, 0, 0, 127));
-  m_pause_background = SDL_DisplayFormatAlpha(tmp);
-  SDL_FreeSurface(tmp);
-
+    m_resourceLoader(), m_board(m_resourceLoader, 1), m_paused(false),
+    m_redraw(true),
+    m_snapshot(), m_history(HISTORY_LENGTH, HISTORY_KEYFRAME_INTERVAL),
+    m_autosaver(savePath("autosave")), m_autosave_data(), m_autosave_time(0),
+    m_practice(false), m_pool(new ThreadPool), m_autoplayer(0), m_autoplay(false),
+    m_autoplay_key(SDLK_UNKNOWN)
+{
   SDL_Color col = { 50, 250, 50, 0 };
   m_textWriter->setFontColor(col);
+  m_queue.setPool(m_pool);
+
+  if (options().autoplay)
+    setAutoplay(true);
 }
 
 PlayState::~PlayState()
 {
+  const RenderQueue::Stats& stats = m_queue.stats();
+  if (options().bench_render && stats.frames)
+    std::cout << "render queue: " << stats.submitted / stats.frames << " sprites, "
+              << stats.blits / stats.frames << " blits and " << stats.culled / stats.frames
+              << " culled per frame, " << stats.merged << " merged, "
+              << stats.micros / stats.frames << "us per frame on " << m_pool->threads()
+              << " thread(s)" << std::endl;
+
+  setAutoplay(false);
+  delete m_autoplayer;
+  delete m_pool;
   delete m_textWriter;
-  SDL_FreeSurface(m_pause_background);
-  SDL_FreeSurface(m_status_background);
   SDL_FreeSurface(m_background);
 }
 
@@ -655,8 +1074,35 @@ STATE_CHANGE PlayState::handleKey(const SDL_KeyboardEvent& key)
   case SDLK_p:
     if (key.type == SDL_KEYDOWN) {
       m_paused = !m_paused;
+      m_redraw = true;
     }
     break;
+  case SDLK_F2:
+    if (key.type == SDL_KEYDOWN) {
+      m_practice = !m_practice;
+      m_hud.setPractice(m_practice);
+    }
+    break;
+  case SDLK_F3:
+    if (key.type == SDL_KEYDOWN)
+      setAutoplay(!m_autoplay);
+    break;
+  case SDLK_BACKSPACE:
+    if (key.type == SDL_KEYDOWN && m_practice && !m_paused)
+      rewind(PRACTICE_MANUAL_REWIND);
+    break;
+  case SDLK_F5:
+    if (key.type == SDL_KEYDOWN)
+      saveGame("savegame");
+    break;
+  case SDLK_F9:
+    if (key.type == SDL_KEYDOWN)
+      loadGame("savegame");
+    break;
+  case SDLK_F10:
+    if (key.type == SDL_KEYDOWN)
+      loadGame("autosave");
+    break;
   default:
     break;
   }
@@ -671,67 +1117,195 @@ STATE_CHANGE PlayState::update(Uint32 delta_time)
     return NO_CHANGE;
   }
 
+  if (m_autoplay)
+    updateAutoplay();
+
   const Uint16 playerLife = m_board.player()->livesLeft();
   m_board.update(delta_time);
+  m_hud.update(delta_time);
   // Check if the player has lost a life
   if (m_board.player()->livesLeft() < playerLife) {
     std::cout << "player died" << std::endl;
+    if (m_practice) {
+      rewind(PRACTICE_DEATH_REWIND);
+      return NO_CHANGE;
+    }
   }
 
+  m_snapshot.clear();
+  m_board.saveState(m_snapshot);
+  m_history.push(m_snapshot.data());
+
+  // benchmarks leave the player's autosave alone
+  m_autosave_time += delta_time;
+  if (m_autosave_time >= AUTOSAVE_INTERVAL && !options().bench_render) {
+    m_autosave_data.assign(m_snapshot.data().begin(), m_snapshot.data().end());
+    m_autosaver.save(m_autosave_data);
+    m_autosave_time = 0;
+  }
 
   return NO_CHANGE;
 }
 
-void PlayState::draw(SDL_Surface* screen)
+void PlayState::suspend()
 {
-  SDL_BlitSurface(m_background, 0, screen, 0);
+  // The key that's moving the player may well be let go while we're
+  // away, and we'd never hear of it.
+  m_board.player()->stop();
+}
+
+void PlayState::fillBoard()
+{
+  const std::vector<std::pair<Uint16, Uint16> > tiles = m_board.freeTiles();
+  for (std::vector<std::pair<Uint16, Uint16> >::const_iterator it = tiles.begin();
+       it != tiles.end(); ++it)
+    m_board.createBlock(it->first, it->second,
+                        static_cast<BLOCK_COLOR>(m_board.random().next(6)), FILL_TIMEOUT);
+}
 
-  m_board.draw(screen);
-  drawStatusArea(screen);
+void PlayState::draw(SDL_Surface* screen, DirtyRects& dirty)
+{
+  // Always let the board compare against what it last drew, even when
+  // everything gets redrawn anyway, so it's up to date next frame.
+  m_queue.clear();
+  if (m_layers.stale(screen->w, screen->h))
+    buildStaticLayers(screen);
+  m_layers.submit(m_queue);
+  m_board.markDirty(dirty, m_queue);
+  if (m_redraw) {
+    dirty.addAll();
+    m_redraw = false;
+  }
+  m_hud.markDirty(*m_board.player(), *m_board.level(), dirty);
+
+  if (dirty.full()) {
+    drawArea(screen, 0);
+    return;
+  }
+  std::vector<SDL_Rect>& rects = dirty.rects();
+  for (std::vector<SDL_Rect>::iterator it = rects.begin(); it != rects.end(); ++it) {
+    SDL_SetClipRect(screen, &*it);
+    drawArea(screen, &*it);
+  }
+  SDL_SetClipRect(screen, 0);
+}
+
+void PlayState::drawArea(SDL_Surface* screen, const SDL_Rect* area)
+{
+  m_queue.execute(screen, area);
+  m_hud.draw(screen, area);
   if (m_paused)
     drawPause(screen);
 }
 
-void PlayState::drawScore(SDL_Surface* screen)
+void PlayState::buildStaticLayers(SDL_Surface* screen)
+{
+  SDL_Surface* layers = m_layers.begin(screen->w, screen->h);
+  blit::blitSurface(m_background, 0, layers, 0);
+  m_board.drawGrid(layers);
+  const SDL_Rect status = statusRect();
+  blit::fillAlpha(layers, &status, 0, 0, 0, 127);
+  m_layers.done();
+}
+
+void PlayState::rewind(Uint32 steps)
 {
-  SDL_Rect r;
-  // FIXME: These hardcoded constants need to go away
-  r.x = 18 * 32 + 8;
-  r.y = 32 + 8;
-  std::stringstream out;
-  out << std::setw(8);
-  out.fill('0');
-  out << m_board.player()->score();
-  m_textWriter->render(screen, &r, "Score: " + out.str());
+  std::vector<Uint8> data;
+  if (!m_history.rewind(steps, data))
+    return;
+  SnapshotReader in(data);
+  m_board.restoreState(in);
+  m_hud.snap(m_board.player()->score());
 }
 
-void PlayState::drawStatusArea(SDL_Surface* screen)
+void PlayState::saveGame(const std::string& name)
 {
-  // Draw our status area background.
+  m_snapshot.clear();
+  m_board.saveState(m_snapshot);
+  if (!writeSnapshotFile(savePath(name), m_snapshot.data()))
+    std::cerr << "warning: unable to save game to '" << savePath(name) << "'" << std::endl;
+}
 
-  SDL_Rect dstrect;
-  // our width is the fixed screen width minus the max width for the
-  // board, minus 2 times a grid square for a border around the board
-  // minus 1 grid square for a right hand border for us.
-  dstrect.w = 800 - 32*16 - 32*2 - 32;
-  // height is max height of the game board
-  dstrect.h = 16*32;
-  // start one grid square down
-  dstrect.y = 32;
-  // and one grid square right of the board
-  dstrect.x = 32*16 + 32*2;
+void PlayState::loadGame(const std::string& name)
+{
+  std::vector<Uint8> data;
+  if (!readSnapshotFile(savePath(name), data)) {
+    std::cerr << "warning: no saved game in '" << savePath(name) << "'" << std::endl;
+    return;
+  }
 
-  SDL_BlitSurface(m_status_background, 0, screen, &dstrect);
-  drawScore(screen);
+  // Hold on to the game as it is, in case the saved one is damaged
+  m_snapshot.clear();
+  m_board.saveState(m_snapshot);
+  try {
+    SnapshotReader in(data);
+    m_board.restoreState(in);
+  } catch (const Exception&) {
+    // Exception already told the user what went wrong. The board may
+    // be half restored now, so put the game back the way it was.
+    SnapshotReader current(m_snapshot.data());
+    m_board.restoreState(current);
+    return;
+  }
+  m_hud.snap(m_board.player()->score());
+  m_history.clear();
 }
 
 void PlayState::updatePause()
 {
 }
 
+void PlayState::setAutoplay(bool on)
+{
+  if (on == m_autoplay)
+    return;
+
+  if (on && !m_autoplayer)
+    m_autoplayer = new AutoPlayer(*m_pool);
+  if (!on && m_autoplay_key != SDLK_UNKNOWN) {
+    SDL_KeyboardEvent key;
+    key.type = SDL_KEYUP;
+    key.state = SDL_RELEASED;
+    key.keysym.sym = m_autoplay_key;
+    handleKey(key);
+    m_autoplay_key = SDLK_UNKNOWN;
+  }
+  m_autoplay = on;
+}
+
+void PlayState::updateAutoplay()
+{
+  const cube::ROLL_DIRECTION dir = m_autoplayer->think(SimBoard(m_board));
+
+  // The player rolls the opposite way of the key while backwards
+  const bool backwards = m_board.player()->effects().modifiers().backwards;
+  SDLKey sym = SDLK_UNKNOWN;
+  switch (dir) {
+  case cube::ROLL_UP: sym = backwards ? SDLK_DOWN : SDLK_UP; break;
+  case cube::ROLL_DOWN: sym = backwards ? SDLK_UP : SDLK_DOWN; break;
+  case cube::ROLL_LEFT: sym = backwards ? SDLK_RIGHT : SDLK_LEFT; break;
+  case cube::ROLL_RIGHT: sym = backwards ? SDLK_LEFT : SDLK_RIGHT; break;
+  }
+  if (sym == m_autoplay_key)
+    return;
+
+  SDL_KeyboardEvent key;
+  if (m_autoplay_key != SDLK_UNKNOWN) {
+    key.type = SDL_KEYUP;
+    key.state = SDL_RELEASED;
+    key.keysym.sym = m_autoplay_key;
+    handleKey(key);
+  }
+  key.type = SDL_KEYDOWN;
+  key.state = SDL_PRESSED;
+  key.keysym.sym = sym;
+  handleKey(key);
+  m_autoplay_key = sym;
+}
+
 void PlayState::drawPause(SDL_Surface* screen)
 {
-  SDL_BlitSurface(m_pause_background, 0, screen, 0);
+  blit::fillAlpha(screen, 0, 0, 0, 0, 127);
   const std::string render_text1("Game Paused");
   const std::string render_text2("Press \"Pause\" or \"P\" to continue.");
   const int skip = m_textWriter->lineSkip();
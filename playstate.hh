@@ -7,17 +7,31 @@
 #define BNB_PLAYSTATE_HH
 
 #include <set>
+#include <algorithm>
 #include <vector>
 #include <SDL.h>
 #include "textwriter.hh"
 #include "resources.hh"
 #include "effects.hh"
+#include "tilemask.hh"
+#include "snapshot.hh"
+#include "pickup.hh"
+#include "cube.hh"
+#include "renderqueue.hh"
+#include "particles.hh"
+#include "dirtyrects.hh"
+#include "layercache.hh"
+#include "hud.hh"
+#include "util.hh"
 #include "states.hh"
 
 const SDL_Color PAUSE_COLOR = { 50, 250, 50, 0 };
 
 class GameObject;
+class Block;
 class Player;
+class ThreadPool;
+class AutoPlayer;
 
 class Board {
 public:
@@ -30,25 +44,66 @@ public:
 
   void update(Uint32 delta_time);
   void centerDraw(const GameObject* obj, const SDL_Rect& srect, SDL_Rect& drect);
-  void draw(SDL_Surface* screen);
+  // Queue 'frame' of 'surface' to be drawn centered on the tile 'obj'
+  // is on. Called by the objects from their draw().
+  void submit(RenderQueue& queue, const GameObject* obj, SDL_Surface* surface,
+              const SDL_Rect& frame,
+              RenderQueue::LAYER layer = RenderQueue::LAYER_OBJECTS);
+  // The grid is static and drawn separately by drawGrid().
+  void drawGrid(SDL_Surface* screen);
+  // Queues everything on the board for drawing this frame and adds
+  // everything that looks different from when this was last called
+  // to 'dirty'.
+  void markDirty(DirtyRects& dirty, RenderQueue& queue);
 
   Uint16 width() { return m_width; }
   Uint16 height() { return m_height; }
 
   std::vector<std::pair<Uint16, Uint16> > freeTiles() const;
   void newBlock();
+  Block* createBlock(Uint16 x, Uint16 y, BLOCK_COLOR col, Sint32 timeout);
 
   bool isBlocked(Uint16 test_x, Uint16 test_y);
+  // Move the player to the nearest empty tile, if there is one
+  void pushOff(Player* player);
+
+  // Queue the bomb at (x, y) to go off. All queued bombs, and any
+  // bombs caught in their blast, are resolved together at the end of
+  // the current update.
+  void detonate(Uint16 x, Uint16 y);
 
   Player* player() { return m_player; }
   LevelResource* level() { return m_level; }
   ResourceLoader& loader() { return m_loader; }
+  util::Random& random() { return m_random; }
+  const PickupOracle& pickupOracle() const { return m_oracle; }
+  ParticleSystem& particles() { return m_particles; }
+  // Screen position of the centre of tile (x, y), for effects
+  Sint16 tileCenterX(Uint16 x) const { return (x + 1) * m_grid->w + m_grid->w / 2; }
+  Sint16 tileCenterY(Uint16 y) const { return (y + 1) * m_grid->h + m_grid->h / 2; }
+
+  // Serialize the complete game state - board, player, level and
+  // random number generator - into a compact snapshot, or replace
+  // the current game state with a snapshot. restoreState() throws if
+  // the snapshot is damaged or from an incompatible version.
+  void saveState(SnapshotWriter& out) const;
+  void restoreState(SnapshotReader& in);
+
+  // Object on the tile with the given index (y * width + x),
+  // including objects that only get placed on the board at the next
+  // update.
+  const GameObject* objectAt(Uint32 index) const;
+  Uint32 blockTime() const { return m_block_time; }
 
 private:
   Board(const Board&);
   Board& operator=(const Board&);
   bool boxedIn() const;
-  ResourceLoader m_loader;
+  bool updateFreeTiles();
+  void reapDeadObjects();
+  void commitNewObjects();
+  void resolveDetonations();
+  ResourceLoader& m_loader;
   Uint16 m_width;
   Uint16 m_height;
   SDL_Surface* m_grid;
@@ -59,8 +114,28 @@ private:
   std::set<GameObject*> m_newObjects;
   std::set<GameObject*> m_deadObjects;
   std::vector<std::pair<Uint16, Uint16> > m_freeTiles;
+  std::vector<Uint32> m_detonations;
+  TileMask m_bombs;
+  TileMask m_blast;
+  TileMask m_area;
 
   Uint32 m_block_time;
+  util::Random m_random;
+  PickupOracle m_oracle;
+  ParticleSystem m_particles;
+
+  // What was on screen at the last markDirty()
+  struct DrawnTile {
+    const SDL_Surface* surface;
+    // source frame and where it went on screen
+    SDL_Rect frame;
+    SDL_Rect rect;
+  };
+  std::vector<DrawnTile> m_drawn;
+  Uint16 m_drawn_player_x;
+  Uint16 m_drawn_player_y;
+  Uint8 m_drawn_orientation;
+  SDL_Rect m_drawn_particles;
 };
 
 class GameObject {
@@ -69,16 +144,13 @@ public:
 
    virtual void update(Uint32 /* delta_time */) { }
   // This draw method is called by the Board class when drawing. This
-  // method should not do any actual drawing itself, just return a
-  // pointer to the surface to be used a source and a rectangle
-  // describing the area of that surface the GameObject wishes to have
-  // drawn. The Board class then takes care of centering this on the
-  // tile the object occupies and do the actual drawing.
-  virtual void draw(SDL_Surface*& surface, SDL_Rect& rect)
-  {
-    surface = 0;
-    rect.x = rect.y = rect.w = rect.h = 0;
-  }
+  // method should not do any actual drawing itself, just submit the
+  // surface to be used as source and the area of that surface the
+  // GameObject wishes to have drawn through Board::submit(), which
+  // centers it on the tile the object occupies. At most one sprite
+  // per object. The actual drawing happens later, when the queue is
+  // executed.
+  virtual void draw(RenderQueue& /* queue */) { }
 
   virtual Uint16 x() const { return m_x; }
   virtual Uint16 y() const { return m_y; }
@@ -109,12 +181,16 @@ class Block : public GameObject {
 public:
   Block(Board* board, Uint16 x, Uint16 y, AnimationResource& anim, BLOCK_COLOR col,
         Sint32 timeout);
-  virtual ~Block() { }
+  virtual ~Block();
 
-  BLOCK_COLOR color() { return m_col; }
+  BLOCK_COLOR color() const { return m_col; }
+  Sint32 startTimeout() const { return m_start_timeout; }
+  Sint32 timeout() const { return m_timeout; }
+  void setTimeout(Sint32 start_timeout, Sint32 timeout)
+  { m_start_timeout = start_timeout; m_timeout = timeout; }
 
   virtual void update(Uint32 delta_time);
-  virtual void draw(SDL_Surface*& surface, SDL_Rect& rect);
+  virtual void draw(RenderQueue& queue);
   virtual void collision(GameObject* other);
 private:
   Block(const Block&);
@@ -132,7 +208,7 @@ public:
   Wall(Board* board, Uint16 x, Uint16 y);
   virtual ~Wall() { }
 
-  virtual void draw(SDL_Surface*& surface, SDL_Rect& rect);
+  virtual void draw(RenderQueue& queue);
   virtual void collision(GameObject*);
 
   virtual bool isBlocked() { return true; }
@@ -145,6 +221,29 @@ private:
 };
 
 
+class Bomb : public GameObject {
+public:
+  Bomb(Board* board, Uint16 x, Uint16 y, Sint32 fuse);
+  virtual ~Bomb() { }
+
+  virtual void update(Uint32 delta_time);
+  virtual void draw(RenderQueue& queue);
+  virtual void collision(GameObject* other);
+
+  virtual bool isBlocked() { return true; }
+
+  Sint32 fuse() const { return m_fuse; }
+
+private:
+  Bomb(const Bomb&);
+  Bomb& operator=(const Bomb&);
+  SDL_Surface* m_current_frame;
+  SDL_Rect m_current_frame_rect;
+  Sint32 m_fuse;
+  bool m_lit;
+};
+
+
 enum PLAYER_DIRECTION { NONE = 0,
                         UP,
                         DOWN,
@@ -157,7 +256,7 @@ public:
   ~Player();
 
   void update(Uint32 delta_time);
-  void draw(SDL_Surface*& surface, SDL_Rect& rect);
+  void draw(RenderQueue& queue);
 
   void goUp() { m_direction = UP; }
   void goDown() { m_direction = DOWN; }
@@ -165,14 +264,22 @@ public:
   void goRight() { m_direction = RIGHT; }
   void stop() { m_direction = NONE; m_time_since_move = m_move_delay / 3; }
 
-  BLOCK_COLOR color() const { return m_top; }
+  BLOCK_COLOR color() const { return cube::top(m_orientation); }
+  Uint8 orientation() const { return m_orientation; }
+  Uint32 moveDelay() const { return m_move_delay; }
+  // how many times the cube has been rolled in total
+  Uint32 rolls() const { return m_rolls; }
   PLAYER_DIRECTION direction() const { return m_direction; }
   Uint32 score() const { return m_score; }
 
   void setEffects(const Effect& e);
+  const ActiveEffects& effects() const { return m_effects; }
 
   Uint16 livesLeft() const { return m_life; }
 
+  void saveState(SnapshotWriter& out) const;
+  void restoreState(SnapshotReader& in);
+
 private:
   Player(const Player&);
   Player& operator=(const Player&);
@@ -181,50 +288,81 @@ private:
   Uint32 m_move_delay;
   Uint32 m_time_since_move;
 
-  // current configuration of the player
-  enum BLOCK_COLOR m_top;
-  enum BLOCK_COLOR m_bottom;
-  enum BLOCK_COLOR m_up;
-  enum BLOCK_COLOR m_down;
-  enum BLOCK_COLOR m_left;
-  enum BLOCK_COLOR m_right;
-
-  // Our strips with the various cube pieces
-  SDL_Surface* m_top_img;
-  SDL_Surface* m_up_img;
-  SDL_Surface* m_down_img;
-  SDL_Surface* m_left_img;
-  SDL_Surface* m_right_img;
+  // current configuration of the player, see cube.hh
+  Uint8 m_orientation;
 
-  // composite frame to be drawn at update()
-  SDL_Surface* m_frame;
+  // The cube as seen from above in each of its 24 orientations, side
+  // by side, composed once from the cube-* strips.
+  SDL_Surface* m_sprites;
 
   Uint32 m_score;
   Uint32 m_life;
+  Uint32 m_rolls;
+
+  // currently active powerups and powerdowns
+  ActiveEffects m_effects;
 };
 
 class PlayState : public State {
 public:
+  static const Uint32 PAUSED_INTERVAL = 150000;
+
   PlayState();
   ~PlayState();
   STATE_CHANGE handleKey(const SDL_KeyboardEvent& key);
   STATE_CHANGE update(Uint32 delta_time);
-  void draw(SDL_Surface* screen);
+  void draw(SDL_Surface* screen, DirtyRects& dirty);
+  virtual void suspend();
+  virtual void resume() { m_redraw = true; }
   bool isPaused() const { return m_paused; }
+  // Nothing moves while paused, so save a bit of power until the
+  // user unpauses.
+  virtual Uint32 frameInterval(Uint32 interval) const
+  { return m_paused ? std::max(interval, PAUSED_INTERVAL) : interval; }
+  // For the render benchmark: a block on every free tile, none of
+  // which ever run out
+  void fillBoard();
 private:
   PlayState(const PlayState&);
   PlayState& operator=(const PlayState&);
-  void drawScore(SDL_Surface* screen);
-  void drawStatusArea(SDL_Surface* screen);
+  void drawArea(SDL_Surface* screen, const SDL_Rect* area);
+  void buildStaticLayers(SDL_Surface* screen);
   void updatePause();
   void drawPause(SDL_Surface* screen);
+  void rewind(Uint32 steps);
+  void saveGame(const std::string& name);
+  void loadGame(const std::string& name);
+  void setAutoplay(bool on);
+  void updateAutoplay();
   SDL_Surface* m_background;
-  SDL_Surface* m_status_background;
-  SDL_Surface* m_pause_background;
+  // background, board grid and status area backdrop
+  LayerCache m_layers;
+  RenderQueue m_queue;
+  // score, lives and the rest of the status area
+  Hud m_hud;
   TextWriter* m_textWriter;
   ResourceLoader m_resourceLoader;
   Board m_board;
   bool m_paused;
+  // Set when everything needs drawing on the next frame
+  bool m_redraw;
+
+  // Snapshot of the game taken after every update, the recent history
+  // of those for rewinding and periodic autosaves of them.
+  SnapshotWriter m_snapshot;
+  SnapshotRing m_history;
+  AutoSaver m_autosaver;
+  std::vector<Uint8> m_autosave_data;
+  Uint32 m_autosave_time;
+  // In practice mode dying rewinds the game a little instead
+  bool m_practice;
+
+  // The computer player presses keys through handleKey() just like a
+  // human would. Its thread pool is only started once it is needed.
+  ThreadPool* m_pool;
+  AutoPlayer* m_autoplayer;
+  bool m_autoplay;
+  SDLKey m_autoplay_key;
 };
 
 #endif
@@ -0,0 +1,168 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <SDL.h>
+#include "util.hh"
+#include "dirtyrects.hh"
+#include "blit.hh"
+#include "renderqueue.hh"
+
+const Uint32 RenderQueue::MIN_BAND_HEIGHT;
+const Uint32 RenderQueue::MAX_BANDS;
+
+namespace {
+  bool drawnBefore(const RenderQueue::Command& a, const RenderQueue::Command& b)
+  {
+    if (a.layer != b.layer)
+      return a.layer < b.layer;
+    return std::less<const SDL_Surface*>()(a.surface, b.surface);
+  }
+
+  // Images are loaded without SDL_SRCALPHA when they have no
+  // transparent pixels, so the flags tell
+  bool opaque(const SDL_Surface* surface)
+  {
+    return !(surface->flags & (SDL_SRCALPHA | SDL_SRCCOLORKEY));
+  }
+
+  // Does 'b' continue 'a' to the right, on screen as well as in the
+  // source surface?
+  bool continues(const RenderQueue::Command& a, const RenderQueue::Command& b)
+  {
+    return a.surface == b.surface && a.layer == b.layer
+      && a.src.y == b.src.y && a.src.h == b.src.h && a.dst.y == b.dst.y
+      && a.src.x + a.src.w == b.src.x && a.dst.x + a.dst.w == b.dst.x;
+  }
+}
+
+RenderQueue::Stats::Stats()
+  : frames(0), submitted(0), merged(0), culled(0), blits(0), bands(0), micros(0)
+{
+}
+
+RenderQueue::RenderQueue(ThreadPool* pool)
+  : m_pool(pool), m_commands(), m_sorted(), m_needs_sort(false), m_stats(),
+    m_screen(0), m_area(), m_bands(0), m_band_stats(MAX_BANDS)
+{
+}
+
+void RenderQueue::clear()
+{
+  m_commands.clear();
+  m_sorted.clear();
+  m_needs_sort = false;
+  ++m_stats.frames;
+}
+
+void RenderQueue::submit(SDL_Surface* surface, const SDL_Rect& src, Sint16 x, Sint16 y,
+                         LAYER layer)
+{
+  if (!surface || !src.w || !src.h)
+    return;
+  Command c;
+  c.surface = surface;
+  c.src = src;
+  c.dst.x = x;
+  c.dst.y = y;
+  c.dst.w = src.w;
+  c.dst.h = src.h;
+  c.layer = layer;
+  m_commands.push_back(c);
+  m_needs_sort = true;
+  ++m_stats.submitted;
+}
+
+void RenderQueue::sort()
+{
+  m_sorted = m_commands;
+  std::stable_sort(m_sorted.begin(), m_sorted.end(), drawnBefore);
+
+  // Merge runs of opaque sprites in place. Only the sort order of
+  // layer and surface brings neighbours together; anything else is
+  // left in submission order.
+  std::vector<Command>::iterator out = m_sorted.begin();
+  for (std::vector<Command>::iterator it = m_sorted.begin(); it != m_sorted.end(); ++it) {
+    if (out != it && opaque(it->surface) && continues(*(out - 1), *it)) {
+      (out - 1)->src.w += it->src.w;
+      (out - 1)->dst.w += it->dst.w;
+      ++m_stats.merged;
+      continue;
+    }
+    *out++ = *it;
+  }
+  m_sorted.erase(out, m_sorted.end());
+  m_needs_sort = false;
+}
+
+bool RenderQueue::concurrent(const SDL_Surface* screen) const
+{
+  for (std::vector<Command>::const_iterator it = m_sorted.begin(); it != m_sorted.end(); ++it)
+    if (!blit::canBlit(it->surface, screen))
+      return false;
+  return true;
+}
+
+void RenderQueue::executeBand(const SDL_Rect& band, bool clipped, Stats& stats) const
+{
+  for (std::vector<Command>::const_iterator it = m_sorted.begin(); it != m_sorted.end(); ++it) {
+    if (!intersects(it->dst, band)) {
+      ++stats.culled;
+      continue;
+    }
+    SDL_Rect src = it->src;
+    SDL_Rect dst = it->dst;
+    if (clipped)
+      blit::blitSurface(it->surface, &src, m_screen, &dst, band);
+    else
+      blit::blitSurface(it->surface, &src, m_screen, &dst);
+    ++stats.blits;
+  }
+}
+
+void RenderQueue::execute(SDL_Surface* screen, const SDL_Rect* area)
+{
+  const uint64_t start = util::timeMicros();
+  if (m_needs_sort)
+    sort();
+
+  m_screen = screen;
+  m_area = area ? *area : screen->clip_rect;
+  m_bands = 1;
+  if (m_pool && m_pool->threads() > 1) {
+    m_bands = std::min(m_area.h / MIN_BAND_HEIGHT, 2 * m_pool->threads());
+    m_bands = std::min(m_bands, MAX_BANDS);
+  }
+
+  if (m_bands < 2 || !concurrent(screen)) {
+    executeBand(m_area, false, m_stats);
+  } else {
+    // Only commands outside the whole area count as culled, not the
+    // ones that just miss a band.
+    for (std::vector<Command>::const_iterator it = m_sorted.begin(); it != m_sorted.end(); ++it)
+      if (!intersects(it->dst, m_area))
+        ++m_stats.culled;
+    m_pool->run(*this, m_bands);
+    for (Uint32 i = 0; i < m_bands; ++i) {
+      m_stats.blits += m_band_stats[i].blits;
+      m_band_stats[i] = Stats();
+    }
+    m_stats.bands += m_bands;
+  }
+  m_stats.micros += util::timeMicros() - start;
+}
+
+void RenderQueue::execute(Uint32 index)
+{
+  // Bands are as even as they can be in whole rows
+  SDL_Rect band = m_area;
+  const Uint32 top = m_area.h * index / m_bands;
+  const Uint32 bottom = m_area.h * (index + 1) / m_bands;
+  band.y = m_area.y + top;
+  band.h = bottom - top;
+  executeBand(band, true, m_band_stats[index]);
+}
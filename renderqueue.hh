@@ -0,0 +1,96 @@
+/*
+ * Queue of sprite draws for a frame. Things to be drawn submit a
+ * command - source surface, source rectangle and screen position -
+ * instead of blitting right away. The queue is then executed once per
+ * area of the screen that needs redrawing: commands outside the area
+ * are culled, the rest are drawn sorted by layer and then by source
+ * surface, with runs of opaque sprites that sit next to each other,
+ * both on screen and in their sheet, merged into a single blit.
+ *
+ * Given a thread pool, bigger areas are split into horizontal bands
+ * drawn in parallel. Each band draws the commands overlapping it,
+ * clipped to the band, so no two threads ever write the same pixel
+ * and the result is the same as drawing on one thread.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_RENDERQUEUE_HH
+#define BNB_RENDERQUEUE_HH
+
+#include <vector>
+#include <SDL.h>
+#include "threadpool.hh"
+
+class RenderQueue : private ThreadPool::Job {
+public:
+  // Layers are drawn in this order. Within a layer sprites are not
+  // expected to overlap, so they are free to be reordered.
+  enum LAYER { LAYER_BACKGROUND = 0, LAYER_OBJECTS, LAYER_PLAYER, LAYER_EFFECTS };
+
+  static const Uint32 MIN_BAND_HEIGHT = 16;
+  static const Uint32 MAX_BANDS = 32;
+
+  struct Command {
+    SDL_Surface* surface;
+    SDL_Rect src;
+    SDL_Rect dst;
+    Uint8 layer;
+  };
+
+  // Draw work done, accumulated over all executions
+  struct Stats {
+    Stats();
+    Uint64 frames;
+    Uint64 submitted;
+    Uint64 merged;
+    Uint64 culled;
+    Uint64 blits;
+    Uint64 bands;
+    Uint64 micros;
+  };
+
+  // Drawing is spread over 'pool' if given, else done on the calling
+  // thread.
+  RenderQueue(ThreadPool* pool = 0);
+  void setPool(ThreadPool* pool) { m_pool = pool; }
+
+  void clear();
+  void submit(SDL_Surface* surface, const SDL_Rect& src, Sint16 x, Sint16 y,
+              LAYER layer);
+
+  Uint32 size() const { return m_commands.size(); }
+  const Command& command(Uint32 index) const { return m_commands[index]; }
+
+  // Draws the commands that overlap 'area', or everything on screen
+  // if 'area' is 0. Returns once everything is drawn.
+  void execute(SDL_Surface* screen, const SDL_Rect* area = 0);
+
+  const Stats& stats() const { return m_stats; }
+
+private:
+  RenderQueue(const RenderQueue&);
+  RenderQueue& operator=(const RenderQueue&);
+  void sort();
+  // Can all commands be drawn onto 'screen' from several threads?
+  bool concurrent(const SDL_Surface* screen) const;
+  void executeBand(const SDL_Rect& band, bool clipped, Stats& stats) const;
+  // draws band number 'index' of the current execute()
+  virtual void execute(Uint32 index);
+
+  ThreadPool* m_pool;
+  std::vector<Command> m_commands;
+  // the commands in drawing order, merged
+  std::vector<Command> m_sorted;
+  bool m_needs_sort;
+  Stats m_stats;
+
+  // the execute() in progress when drawing in bands
+  SDL_Surface* m_screen;
+  SDL_Rect m_area;
+  Uint32 m_bands;
+  std::vector<Stats> m_band_stats;
+};
+
+#endif
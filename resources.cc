@@ -11,16 +11,22 @@
 #include <cstdlib>
 #include <SDL.h>
 #include <SDL_image.h>
+#include <algorithm>
 #include "except.hh"
+#include "util.hh"
+#include "snapshot.hh"
+#include "threadpool.hh"
+#include "levelgen.hh"
 #include "resources.hh"
 #include "config.h"
 
-AnimationResource::AnimationResource(std::map<std::string, std::string>& properties)
+AnimationResource::AnimationResource(std::map<std::string, std::string>& properties,
+                                     SDL_Surface* frames)
   : Resource(properties["name"]), frame_w(strtoul(properties["width"].c_str(), 0, 10)),
     frame_h(strtoul(properties["height"].c_str(), 0, 10)),
     initial_ms_per_frame(strtoul(properties["ms_per_frame"].c_str(), 0, 10)),
     ms_per_frame(initial_ms_per_frame), loop_type(NONE),
-    anim(IMG_LoadDisplayFormat(properties["frames"].c_str())),
+    anim(frames),
     current_frame(0), current_frame_off(0), last_frame(anim->w / frame_w - 1),
     moving_forward(true)
 {
@@ -85,38 +91,76 @@ SDL_Rect AnimationResource::currentFrameRect(Uint32 delta_time)
   return retval;
 }
 
+namespace {
+  // Threads generating levels that don't have a file, counting the
+  // generator's own
+  const unsigned int GENERATOR_THREADS = 2;
+
+  // Look up a numeric level property, falling back to 'def' if the
+  // level doesn't specify it.
+  Uint32 levelProperty(std::map<std::string, std::string>& properties,
+                       const std::string& key, Uint32 def)
+  {
+    std::map<std::string, std::string>::const_iterator it = properties.find(key);
+    if (it == properties.end() || it->second.empty())
+      return def;
+    return strtoul(it->second.c_str(), 0, 10);
+  }
+}
+
 LevelResource::LevelResource(const std::string& name,
-                             std::map<std::string, std::string>&,
-                             const std::vector<unsigned char>&)
-  : Resource(name), m_block_to_wall_delay(10000), m_delay_between_blocks(5500),
-    m_successful_pickup_delay_reduction(25), m_failed_pickup_delay_reduction(120),
-    m_red_left(0), m_green_left(0), m_blue_left(0), m_purple_left(0),
-    m_yellow_left(0), m_cyan_left(0), m_arbitrary_left(0)
+                             std::map<std::string, std::string>& properties,
+                             const std::vector<unsigned char>& level_map)
+  : Resource(name), m_map(level_map), m_start(),
+    m_move_delay(levelProperty(properties, "player_move_delay", 120)),
+    m_random_seed(levelProperty(properties, "random_seed", 42)),
+    m_block_to_wall_delay(levelProperty(properties, "block_to_wall_delay", 10000)),
+    m_delay_between_blocks(levelProperty(properties, "delay_between_blocks", 5500)),
+    m_successful_pickup_delay_reduction(levelProperty(properties, "successful_pickup_delay_reduction", 25)),
+    m_failed_pickup_delay_reduction(levelProperty(properties, "failed_pickup_delay_reduction", 120)),
+    m_bomb_chance(levelProperty(properties, "bomb_chance", 20)),
+    m_bomb_fuse(levelProperty(properties, "bomb_fuse", 4000)),
+    m_bomb_radius(levelProperty(properties, "bomb_radius", 1)),
+    m_red_left(levelProperty(properties, "to_win_red", 0)),
+    m_green_left(levelProperty(properties, "to_win_green", 0)),
+    m_blue_left(levelProperty(properties, "to_win_blue", 0)),
+    m_purple_left(levelProperty(properties, "to_win_purple", 0)),
+    m_yellow_left(levelProperty(properties, "to_win_yellow", 0)),
+    m_cyan_left(levelProperty(properties, "to_win_cyan", 0)),
+    m_arbitrary_left(levelProperty(properties, "to_win_arbitrary", 0))
 {
+  if (!m_map.empty() && m_map.size() != LEVEL_WIDTH * LEVEL_HEIGHT)
+    throw Exception("Level '" + name + "' does not have a " +
+                    util::fmt2str("%ux%u", LEVEL_WIDTH, LEVEL_HEIGHT) + " map");
+
+  m_start.x = m_start.y = 14;
+  m_start.w = m_start.h = 0;
+  for (Uint32 i = 0; i < m_map.size(); ++i) {
+    if (m_map[i] == LEVEL_PLAYER) {
+      m_start.x = i % LEVEL_WIDTH;
+      m_start.y = i / LEVEL_WIDTH;
+    }
+  }
 }
 
 std::vector<unsigned char> LevelResource::initialBoard() const
 {
-  std::vector<unsigned char> v;
-  return v;
+  return m_map;
 }
 
 Uint32 LevelResource::randomSeed() const
 {
-  return 42;
+  return m_random_seed;
 }
 
 SDL_Rect LevelResource::playerStartPos() const
 {
-  SDL_Rect r;
-  r.x = r.y = 14;
-  r.w = r.h = 0;
-  return r;
+  return m_start;
 }
 
 Uint32 LevelResource::playerMoveDelay() const
 {
-  return 120;
+  return m_move_delay;
 }
 
 
@@ -174,18 +218,113 @@ void LevelResource::failedBlockPickup()
     m_delay_between_blocks = 0;
 }
 
-Resource* ResourceLoader::load(const std::string& resource_name)
+void LevelResource::saveState(SnapshotWriter& out) const
+{
+  out.putVarint(m_block_to_wall_delay);
+  out.putVarint(m_delay_between_blocks);
+  out.putVarint(m_successful_pickup_delay_reduction);
+  out.putVarint(m_failed_pickup_delay_reduction);
+  out.putVarint(m_bomb_chance);
+  out.putVarint(m_bomb_fuse);
+  out.putVarint(m_bomb_radius);
+  // the remaining counts wrap below zero once a colour is done, so
+  // store them signed to keep them small
+  out.putSigned(m_red_left);
+  out.putSigned(m_green_left);
+  out.putSigned(m_blue_left);
+  out.putSigned(m_purple_left);
+  out.putSigned(m_yellow_left);
+  out.putSigned(m_cyan_left);
+  out.putSigned(m_arbitrary_left);
+}
+
+void LevelResource::restoreState(SnapshotReader& in)
+{
+  m_block_to_wall_delay = in.getVarint();
+  m_delay_between_blocks = in.getVarint();
+  m_successful_pickup_delay_reduction = in.getVarint();
+  m_failed_pickup_delay_reduction = in.getVarint();
+  m_bomb_chance = in.getVarint();
+  m_bomb_fuse = in.getVarint();
+  m_bomb_radius = in.getVarint();
+  m_red_left = in.getSigned();
+  m_green_left = in.getSigned();
+  m_blue_left = in.getSigned();
+  m_purple_left = in.getSigned();
+  m_yellow_left = in.getSigned();
+  m_cyan_left = in.getSigned();
+  m_arbitrary_left = in.getSigned();
+}
+
+ResourceLoader::ResourceLoader()
+  : m_pool(0), m_generator(0), m_images(), m_properties()
+{
+}
+
+ResourceLoader::~ResourceLoader()
 {
-  // XXX: Hack
+  delete m_generator;
+  delete m_pool;
+  for (std::map<std::string, SDL_Surface*>::iterator it = m_images.begin();
+       it != m_images.end(); ++it)
+    SDL_FreeSurface(it->second);
+}
 
-  if (resource_name == "levels/level-0001.res") {
-    std::map<std::string, std::string> a;
-    std::vector<unsigned char> b;
-    return new LevelResource("level-0001", a, b);
+LevelGenerator& ResourceLoader::generator()
+{
+  if (!m_generator) {
+    // The game is running alongside, so leave it most of the CPUs
+    m_pool = new ThreadPool(GENERATOR_THREADS);
+    m_generator = new LevelGenerator(*m_pool);
   }
+  return *m_generator;
+}
 
+LevelResource* ResourceLoader::loadLevel(Uint32 number)
+{
+  const std::string name = util::fmt2str("level-%04u", number);
   std::map<std::string, std::string> properties;
+  std::vector<unsigned char> level_map;
+
+  std::ifstream file((std::string(RESOURCES_DIR) + "levels/" + name + ".res").c_str());
+  if (file) {
+    std::string line;
+    bool in_map = false;
+    while (std::getline(file, line)) {
+      if (in_map) {
+        level_map.insert(level_map.end(), line.begin(),
+                         line.begin() + std::min<std::size_t>(line.size(), LEVEL_WIDTH));
+        continue;
+      }
+      if (line.empty() || line[0] == '#')
+        continue;
+      if (line == LEVEL_MAP_START) {
+        in_map = true;
+        continue;
+      }
+      const std::size_t pos = line.find('=');
+      if (pos != std::string::npos)
+        properties[line.substr(0, pos)] = line.substr(pos + 1);
+    }
+  } else {
+    std::cout << "No file for level " << number << ", generating one" << std::endl;
+    const LevelDescription level = generator().generate(number);
+    properties = level.properties;
+    level_map = level.map;
+  }
+
+  return new LevelResource(name, properties, level_map);
+}
 
+Resource* ResourceLoader::load(const std::string& resource_name)
+{
+  // Blocks each load their animation, so only go to disk once
+  std::map<std::string, std::map<std::string, std::string> >::iterator cached =
+    m_properties.find(resource_name);
+  if (cached != m_properties.end())
+    return new AnimationResource(cached->second, image(cached->second["frames"]));
+
+  std::map<std::string, std::string>& properties = m_properties[resource_name];
   std::string resource_filename = std::string(RESOURCES_DIR) + resource_name;
 
   std::string line;
@@ -202,7 +341,7 @@ Resource* ResourceLoader::load(const std::string& resource_name)
   }
   properties["name"] = resource_name;
 
-  return new AnimationResource(properties);
+  return new AnimationResource(properties, image(properties["frames"]));
 }
 
 void ResourceLoader::unload(Resource* res)
@@ -212,6 +351,41 @@ void ResourceLoader::unload(Resource* res)
   delete res;
 }
 
+SDL_Surface* ResourceLoader::image(const std::string& file)
+{
+  std::map<std::string, SDL_Surface*>::iterator it = m_images.find(file);
+  if (it == m_images.end())
+    it = m_images.insert(std::make_pair(file, IMG_LoadDisplayFormat(file))).first;
+  return it->second;
+}
+
+namespace {
+  // Does the image have no transparent pixels at all?
+  bool isOpaque(SDL_Surface* image)
+  {
+    const SDL_PixelFormat* fmt = image->format;
+    if (image->flags & SDL_SRCCOLORKEY)
+      return false;
+    if (!fmt->Amask)
+      return true;
+    if (fmt->BytesPerPixel != 4)
+      return false;
+
+    bool opaque = true;
+    if (SDL_MUSTLOCK(image))
+      SDL_LockSurface(image);
+    for (int y = 0; opaque && y < image->h; ++y) {
+      const Uint32* row = reinterpret_cast<const Uint32*>(
+        static_cast<const Uint8*>(image->pixels) + y * image->pitch);
+      for (int x = 0; opaque && x < image->w; ++x)
+        opaque = (row[x] & fmt->Amask) == fmt->Amask;
+    }
+    if (SDL_MUSTLOCK(image))
+      SDL_UnlockSurface(image);
+    return opaque;
+  }
+}
+
 SDL_Surface* IMG_LoadDisplayFormat(const std::string& file)
 {
   const std::string filename = std::string(RESOURCES_DIR) + "images/" + file;
@@ -219,7 +393,10 @@ SDL_Surface* IMG_LoadDisplayFormat(const std::string& file)
   if (!tmp)
     throw Exception("Failed to load image '" + filename + "': " + std::string(IMG_GetError()));
 
-  SDL_Surface* ret = SDL_DisplayFormatAlpha(tmp);
+  // Images without any transparency lose their alpha channel, so
+  // they're plain copies when drawn - and can be merged with their
+  // neighbours by the render queue.
+  SDL_Surface* ret = isOpaque(tmp) ? SDL_DisplayFormat(tmp) : SDL_DisplayFormatAlpha(tmp);
   SDL_FreeSurface(tmp);
   if (!ret)
     throw Exception("Failed to convert image '" + filename + "': " + std::string(IMG_GetError()));
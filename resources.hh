@@ -11,8 +11,24 @@
 #include <vector>
 #include <SDL.h>
 
+class SnapshotWriter;
+class SnapshotReader;
+class ThreadPool;
+class LevelGenerator;
+
 enum BLOCK_COLOR { RED = 0, GREEN = 1, BLUE = 2, YELLOW = 3, PURPLE = 4, CYAN = 5 };
 
+// Size of the level map in tiles
+const Uint16 LEVEL_WIDTH = 16;
+const Uint16 LEVEL_HEIGHT = 16;
+
+// Characters used in level maps
+const unsigned char LEVEL_EMPTY = '0';
+const unsigned char LEVEL_WALL = '#';
+const unsigned char LEVEL_PLAYER = 'P';
+// Separates the properties of a level file from its map
+const char LEVEL_MAP_START[] = "-----[LEVEL MAP START]-----";
+
 /*
   Base class for all game resources
 */
@@ -27,9 +43,9 @@ protected:
 
 class AnimationResource : public Resource {
 public:
-  AnimationResource(std::map<std::string, std::string>& properties);
-  ~AnimationResource()
-  { SDL_FreeSurface(anim); }
+  // 'frames' is the animation's image, which the loader owns
+  AnimationResource(std::map<std::string, std::string>& properties, SDL_Surface* frames);
+  ~AnimationResource() { }
 
   SDL_Surface* currentFrameSurface(Uint32 /* delta_time */) { return anim; }
   SDL_Rect currentFrameRect(Uint32 delta_time);
@@ -58,12 +74,23 @@ public:
                 std::map<std::string, std::string>& properties,
                 const std::vector<unsigned char>& level_map);
   ~LevelResource() { }
+  // LEVEL_WIDTH * LEVEL_HEIGHT map characters, row by row, or nothing
+  // for an empty board.
   std::vector<unsigned char> initialBoard() const;
   Uint32 randomSeed() const;
   SDL_Rect playerStartPos() const;
   Uint32 playerMoveDelay() const;
   Uint32 blockToWallDelay() const { return m_block_to_wall_delay; }
   Uint32 delayBetweenBlocks() const { return m_delay_between_blocks; }
+  Uint32 successfulPickupDelayReduction() const { return m_successful_pickup_delay_reduction; }
+  Uint32 failedPickupDelayReduction() const { return m_failed_pickup_delay_reduction; }
+  // Chance (in percent) that a block which times out turns into a
+  // bomb rather than a wall.
+  Uint32 bombChance() const { return m_bomb_chance; }
+  // How long a bomb sits on the board before it goes off.
+  Uint32 bombFuse() const { return m_bomb_fuse; }
+  // How many tiles around a bomb are cleared when it goes off.
+  Uint16 bombRadius() const { return m_bomb_radius; }
   Uint32 remainingRed() const { return m_red_left; }
   Uint32 remainingGreen() const { return m_green_left; }
   Uint32 remainingBlue() const { return m_blue_left; }
@@ -74,11 +101,22 @@ public:
   Uint32 remainingTotal() const;
   void blockPickup(BLOCK_COLOR col);
   void failedBlockPickup();
+
+  // Save/restore everything that changes while the level is played
+  void saveState(SnapshotWriter& out) const;
+  void restoreState(SnapshotReader& in);
 private:
+  std::vector<unsigned char> m_map;
+  SDL_Rect m_start;
+  Uint32 m_move_delay;
+  Uint32 m_random_seed;
   Uint32 m_block_to_wall_delay;
   Uint32 m_delay_between_blocks;
   Uint32 m_successful_pickup_delay_reduction;
   Uint32 m_failed_pickup_delay_reduction;
+  Uint32 m_bomb_chance;
+  Uint32 m_bomb_fuse;
+  Uint16 m_bomb_radius;
   Uint32 m_red_left;
   Uint32 m_green_left;
   Uint32 m_blue_left;
@@ -90,13 +128,33 @@ private:
 
 class ResourceLoader {
 public:
-  ResourceLoader() { }
-  ~ResourceLoader() { }
+  ResourceLoader();
+  ~ResourceLoader();
 
   Resource* load(const std::string& resource_name);
+  // Level 'number' from its level file, or a generated one once we run
+  // out of those. Either way the level after it gets generated in the
+  // background if there is no file for it.
+  LevelResource* loadLevel(Uint32 number);
   void unload(Resource* res);
+  // An image in the display format. Each file is only read once; the
+  // surface is shared and stays around as long as the loader does.
+  SDL_Surface* image(const std::string& file);
+
+private:
+  ResourceLoader(const ResourceLoader&);
+  ResourceLoader& operator=(const ResourceLoader&);
+  LevelGenerator& generator();
+
+  ThreadPool* m_pool;
+  LevelGenerator* m_generator;
+  std::map<std::string, SDL_Surface*> m_images;
+  // resource files read so far, by name
+  std::map<std::string, std::map<std::string, std::string> > m_properties;
 };
 
+// An image from the images directory in the display format, with per
+// pixel alpha unless it's fully opaque
 SDL_Surface* IMG_LoadDisplayFormat(const std::string& file);
 
 #endif
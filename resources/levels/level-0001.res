@@ -4,6 +4,10 @@ block_to_wall_delay=12000
 delay_between_blocks=11000
 successful_pickup_delay_reduction=10
 failed_pickup_delay_reduction=100
+# percentage of timed out blocks that become bombs rather than walls
+bomb_chance=20
+bomb_fuse=4000
+bomb_radius=1
 to_win_red=3
 to_win_green=3
 to_win_blue=3
@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <algorithm>
+#include <vector>
+#include <SDL.h>
+#include "except.hh"
+#include "blit.hh"
+#include "scaler.hh"
+
+Scaler::Scaler(Uint16 src_width, Uint16 src_height, Uint16 dst_width, Uint16 dst_height)
+  : m_src_width(src_width), m_src_height(src_height), m_viewport(), m_columns(),
+    m_rows(), m_row(src_width), m_left(), m_right(), m_weights()
+{
+  // as big as fits without changing the aspect ratio
+  Uint32 w = dst_width;
+  Uint32 h = static_cast<Uint32>(src_height) * dst_width / src_width;
+  if (h > dst_height) {
+    h = dst_height;
+    w = static_cast<Uint32>(src_width) * dst_height / src_height;
+  }
+  m_viewport.x = (dst_width - w) / 2;
+  m_viewport.y = (dst_height - h) / 2;
+  m_viewport.w = w;
+  m_viewport.h = h;
+
+  samples(src_width, w, m_columns);
+  samples(src_height, h, m_rows);
+  m_left.resize(w);
+  m_right.resize(w);
+  m_weights.resize(w);
+  for (Uint32 x = 0; x < w; ++x)
+    m_weights[x] = m_columns[x].weight;
+}
+
+void Scaler::samples(Uint16 src_size, Uint16 dst_size, std::vector<Sample>& out)
+{
+  // Pixel centres line up: destination pixel d samples the source at
+  // (d + 0.5) * src_size / dst_size - 0.5, in 16.16 fixed point.
+  out.resize(dst_size);
+  const Sint64 step = (static_cast<Sint64>(src_size) << 16) / dst_size;
+  for (Uint32 d = 0; d < dst_size; ++d) {
+    const Sint64 pos = std::max(step / 2 - 0x8000 + step * d, static_cast<Sint64>(0));
+    Sample s;
+    s.first = pos >> 16;
+    s.weight = (pos >> 8) & 0xff;
+    if (s.first >= src_size - 1) {
+      s.first = src_size - 1;
+      s.weight = 0;
+    }
+    out[d] = s;
+  }
+}
+
+void Scaler::span(const std::vector<Sample>& samples, int from, int to, int& first, int& last)
+{
+  // Samples are in order, so the destination pixels touching source
+  // pixels [from, to) are a contiguous run.
+  first = samples.size();
+  last = 0;
+  for (int d = 0; d < static_cast<int>(samples.size()); ++d) {
+    const int s0 = samples[d].first;
+    const int s1 = s0 + (samples[d].weight ? 1 : 0);
+    if (s1 >= from && s0 < to) {
+      first = std::min(first, d);
+      last = d + 1;
+    }
+  }
+}
+
+SDL_Rect Scaler::scale(SDL_Surface* src, const SDL_Rect& area, SDL_Surface* dst)
+{
+  int x0, x1, y0, y1;
+  span(m_columns, area.x, area.x + area.w, x0, x1);
+  span(m_rows, area.y, area.y + area.h, y0, y1);
+  SDL_Rect changed;
+  changed.x = m_viewport.x + x0;
+  changed.y = m_viewport.y + y0;
+  changed.w = std::max(x1 - x0, 0);
+  changed.h = std::max(y1 - y0, 0);
+  if (!changed.w || !changed.h)
+    return changed;
+
+  if (SDL_MUSTLOCK(dst) && SDL_LockSurface(dst) < 0)
+    throw Exception("Unable to lock the display: " + std::string(SDL_GetError()));
+
+  // source columns the destination span reads
+  const int first = m_columns[x0].first;
+  const int last = std::min(m_columns[x1 - 1].first + 1, m_src_width - 1);
+  const Uint8* src_pixels = static_cast<const Uint8*>(src->pixels);
+  for (int y = y0; y < y1; ++y) {
+    const Sample& row = m_rows[y];
+    const Uint32* a = reinterpret_cast<const Uint32*>(src_pixels + row.first * src->pitch) + first;
+    const Uint32* line = a;
+    if (row.weight) {
+      const Uint32* b = reinterpret_cast<const Uint32*>(src_pixels + (row.first + 1) * src->pitch)
+        + first;
+      blit::lerpRow(a, b, &m_row[0], last - first + 1, row.weight);
+      line = &m_row[0];
+    }
+
+    Uint32* out = reinterpret_cast<Uint32*>(static_cast<Uint8*>(dst->pixels)
+                                            + (m_viewport.y + y) * dst->pitch) + m_viewport.x;
+    for (int x = x0; x < x1; ++x) {
+      const Sample& col = m_columns[x];
+      const Uint32* p = line + (col.first - first);
+      m_left[x] = p[0];
+      m_right[x] = col.weight ? p[1] : p[0];
+    }
+    blit::lerpRow(&m_left[x0], &m_right[x0], out + x0, x1 - x0, &m_weights[x0]);
+  }
+
+  if (SDL_MUSTLOCK(dst))
+    SDL_UnlockSurface(dst);
+  return changed;
+}
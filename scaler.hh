@@ -0,0 +1,58 @@
+/*
+ * Bilinear scaling of the game's fixed size screen to whatever the
+ * display actually is. The game always draws at its own resolution
+ * and only the parts that changed get scaled up on their way to the
+ * display, so a bigger window costs a bit more per changed pixel but
+ * nothing for the rest. The aspect ratio is kept, with black borders
+ * where the display's differs.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_SCALER_HH
+#define BNB_SCALER_HH
+
+#include <vector>
+#include <SDL.h>
+
+class Scaler {
+public:
+  Scaler(Uint16 src_width, Uint16 src_height, Uint16 dst_width, Uint16 dst_height);
+
+  // Where on the display the scaled screen ends up
+  const SDL_Rect& viewport() const { return m_viewport; }
+
+  // Scales 'area' of src onto dst, which are both 32bpp in the same
+  // format and of the sizes given at construction, and returns the
+  // part of dst that changed.
+  SDL_Rect scale(SDL_Surface* src, const SDL_Rect& area, SDL_Surface* dst);
+
+private:
+  // Source pixel to the left of/above each destination pixel, and
+  // how much (0 - 256) of the next one to mix in
+  struct Sample {
+    Uint16 first;
+    Uint16 weight;
+  };
+  static void samples(Uint16 src_size, Uint16 dst_size, std::vector<Sample>& out);
+  // First and one past last destination pixel depending on source
+  // pixels from 'from' to 'to'
+  static void span(const std::vector<Sample>& samples, int from, int to, int& first,
+                   int& last);
+
+  Uint16 m_src_width;
+  Uint16 m_src_height;
+  SDL_Rect m_viewport;
+  std::vector<Sample> m_columns;
+  std::vector<Sample> m_rows;
+  // a source row blended vertically, before horizontal scaling
+  std::vector<Uint32> m_row;
+  // the pixels to the left and right of each destination column, and
+  // their weights, lined up for lerpRow()
+  std::vector<Uint32> m_left;
+  std::vector<Uint32> m_right;
+  std::vector<Uint16> m_weights;
+};
+
+#endif
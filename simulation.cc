@@ -0,0 +1,241 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <SDL.h>
+#include "resources.hh"
+#include "effects.hh"
+#include "playstate.hh"
+#include "cube.hh"
+#include "simulation.hh"
+
+SimBoard::Params::Params()
+  : move_delay(120), block_to_wall_delay(10000), delay_between_blocks(5500),
+    successful_pickup_delay_reduction(25), failed_pickup_delay_reduction(120),
+    bomb_chance(20), bomb_fuse(4000), bomb_radius(1)
+{
+}
+
+SimBoard::SimBoard(Uint16 width, Uint16 height, const Params& params, Uint16 x, Uint16 y,
+                   Uint32 seed)
+  : m_width(width), m_height(height), m_params(params), m_tiles(width * height, EMPTY),
+    m_timers(width * height, 0), m_start_timers(width * height, 0), m_detonations(),
+    m_x(x), m_y(y), m_orientation(cube::initialOrientation()), m_block_time(0),
+    m_blocks(0), m_score(0), m_lives_lost(0), m_pickups(0), m_time(0), m_random(seed)
+{
+}
+
+SimBoard::SimBoard(Board& board)
+  : m_width(board.width()), m_height(board.height()), m_params(),
+    m_tiles(m_width * m_height, EMPTY), m_timers(m_width * m_height, 0),
+    m_start_timers(m_width * m_height, 0), m_detonations(),
+    m_x(board.player()->x()), m_y(board.player()->y()),
+    m_orientation(board.player()->orientation()), m_block_time(board.blockTime()),
+    m_blocks(0), m_score(0), m_lives_lost(0), m_pickups(0), m_time(0),
+    m_random(board.random().state())
+{
+  const LevelResource* level = board.level();
+  m_params.move_delay = board.player()->moveDelay()
+    * board.player()->effects().modifiers().move_delay_percent / 100;
+  m_params.block_to_wall_delay = level->blockToWallDelay();
+  m_params.delay_between_blocks = level->delayBetweenBlocks();
+  m_params.successful_pickup_delay_reduction = level->successfulPickupDelayReduction();
+  m_params.failed_pickup_delay_reduction = level->failedPickupDelayReduction();
+  m_params.bomb_chance = level->bombChance();
+  m_params.bomb_fuse = level->bombFuse();
+  m_params.bomb_radius = level->bombRadius();
+
+  for (Uint32 i = 0; i < m_tiles.size(); ++i) {
+    const GameObject* go = board.objectAt(i);
+    if (!go)
+      continue;
+    if (const Block* block = dynamic_cast<const Block*>(go)) {
+      m_tiles[i] = BLOCK | (block->color() << 2);
+      m_timers[i] = block->timeout();
+      m_start_timers[i] = block->startTimeout();
+      ++m_blocks;
+    } else if (const Bomb* bomb = dynamic_cast<const Bomb*>(go)) {
+      m_tiles[i] = BOMB;
+      m_timers[i] = bomb->fuse();
+    } else {
+      m_tiles[i] = WALL;
+    }
+  }
+}
+
+void SimBoard::setWall(Uint16 x, Uint16 y)
+{
+  const Uint32 i = y * m_width + x;
+  if ((m_tiles[i] & 3) == BLOCK)
+    --m_blocks;
+  m_tiles[i] = WALL;
+}
+
+bool SimBoard::canRoll(cube::ROLL_DIRECTION dir) const
+{
+  switch (dir) {
+  case cube::ROLL_UP:
+    return m_y > 0 && (m_tiles[(m_y - 1) * m_width + m_x] & 3) < WALL;
+  case cube::ROLL_DOWN:
+    return m_y < m_height - 1 && (m_tiles[(m_y + 1) * m_width + m_x] & 3) < WALL;
+  case cube::ROLL_LEFT:
+    return m_x > 0 && (m_tiles[m_y * m_width + m_x - 1] & 3) < WALL;
+  case cube::ROLL_RIGHT:
+    return m_x < m_width - 1 && (m_tiles[m_y * m_width + m_x + 1] & 3) < WALL;
+  }
+  return false;
+}
+
+void SimBoard::roll(cube::ROLL_DIRECTION dir)
+{
+  step(dir);
+}
+
+void SimBoard::wait()
+{
+  step(-1);
+}
+
+void SimBoard::step(int dir)
+{
+  const Uint32 dt = m_params.move_delay;
+  m_time += dt;
+
+  // Blocks time out into walls or bombs and bomb fuses burn down
+  for (Uint32 i = 0; i < m_tiles.size(); ++i) {
+    const Uint8 kind = m_tiles[i] & 3;
+    if (kind == BLOCK) {
+      m_timers[i] -= dt;
+      if (m_timers[i] <= 0) {
+        --m_blocks;
+        if (m_random.next(100) < m_params.bomb_chance) {
+          m_tiles[i] = BOMB;
+          m_timers[i] = m_params.bomb_fuse;
+        } else {
+          m_tiles[i] = WALL;
+        }
+        m_params.block_to_wall_delay -= std::min(m_params.block_to_wall_delay,
+                                                 m_params.failed_pickup_delay_reduction);
+        m_params.delay_between_blocks -= std::min<Uint32>(m_params.delay_between_blocks,
+                                                          m_params.failed_pickup_delay_reduction * 1.2);
+      }
+    } else if (kind == BOMB) {
+      m_timers[i] -= dt;
+      if (m_timers[i] <= 0 && m_timers[i] + static_cast<Sint32>(dt) > 0)
+        m_detonations.push_back(i);
+    }
+  }
+
+  if (dir >= 0 && canRoll(static_cast<cube::ROLL_DIRECTION>(dir))) {
+    switch (dir) {
+    case cube::ROLL_UP: --m_y; break;
+    case cube::ROLL_DOWN: ++m_y; break;
+    case cube::ROLL_LEFT: --m_x; break;
+    case cube::ROLL_RIGHT: ++m_x; break;
+    }
+    m_orientation = cube::roll(m_orientation, static_cast<cube::ROLL_DIRECTION>(dir));
+  }
+
+  m_block_time += dt;
+  if (m_block_time > m_params.delay_between_blocks) {
+    newBlock();
+    m_block_time = 0;
+  }
+  if (!m_blocks)
+    newBlock();
+
+  // What the player is standing on
+  const Uint32 here = m_y * m_width + m_x;
+  switch (m_tiles[here] & 3) {
+  case BLOCK:
+    if ((m_tiles[here] >> 2) == cube::top(m_orientation)) {
+      m_score += 1000;
+      if (m_timers[here] > 0)
+        m_score += 1000.0 * m_timers[here] / m_start_timers[here];
+      ++m_pickups;
+      --m_blocks;
+      m_tiles[here] = EMPTY;
+      m_params.block_to_wall_delay -= std::min(m_params.block_to_wall_delay,
+                                               m_params.successful_pickup_delay_reduction);
+      m_params.delay_between_blocks -= std::min<Uint32>(m_params.delay_between_blocks,
+                                                        m_params.successful_pickup_delay_reduction * 1.1);
+    }
+    break;
+  case WALL:
+    loseLife();
+    break;
+  case BOMB:
+    m_detonations.push_back(here);
+    break;
+  }
+
+  // Boxed in?
+  int blocked = 0;
+  blocked += m_x == 0 || (m_tiles[here - 1] & 3) >= WALL;
+  blocked += m_x == m_width - 1 || (m_tiles[here + 1] & 3) >= WALL;
+  blocked += m_y == 0 || (m_tiles[here - m_width] & 3) >= WALL;
+  blocked += m_y == m_height - 1 || (m_tiles[here + m_width] & 3) >= WALL;
+  if (blocked == 4)
+    loseLife();
+
+  resolveDetonations();
+}
+
+void SimBoard::newBlock()
+{
+  const Uint32 player = m_y * m_width + m_x;
+  Uint32 free = 0;
+  for (Uint32 i = 0; i < m_tiles.size(); ++i)
+    free += m_tiles[i] == EMPTY && i != player;
+  if (!free)
+    return;
+
+  Uint32 n = m_random.next(free);
+  for (Uint32 i = 0; i < m_tiles.size(); ++i) {
+    if (m_tiles[i] != EMPTY || i == player)
+      continue;
+    if (!n--) {
+      m_tiles[i] = BLOCK | (m_random.next(6) << 2);
+      m_timers[i] = m_start_timers[i] = m_params.block_to_wall_delay;
+      ++m_blocks;
+      return;
+    }
+  }
+}
+
+void SimBoard::resolveDetonations()
+{
+  // Bombs are cleared as soon as they are queued, so each one goes
+  // off exactly once however many blasts reach it.
+  bool player_hit = false;
+  const Sint32 r = m_params.bomb_radius;
+  while (!m_detonations.empty()) {
+    const Uint32 pos = m_detonations.back();
+    m_detonations.pop_back();
+    m_tiles[pos] = EMPTY;
+
+    const Sint32 bx = pos % m_width;
+    const Sint32 by = pos / m_width;
+    for (Sint32 y = std::max(by - r, 0); y <= std::min<Sint32>(by + r, m_height - 1); ++y) {
+      for (Sint32 x = std::max(bx - r, 0); x <= std::min<Sint32>(bx + r, m_width - 1); ++x) {
+        const Uint32 i = y * m_width + x;
+        switch (m_tiles[i] & 3) {
+        case BOMB:
+          m_detonations.push_back(i);
+          break;
+        case BLOCK:
+          --m_blocks;
+          break;
+        }
+        m_tiles[i] = EMPTY;
+        if (x == m_x && y == m_y)
+          player_hit = true;
+      }
+    }
+  }
+  if (player_hit)
+    loseLife();
+}
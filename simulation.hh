@@ -0,0 +1,103 @@
+/*
+ * Stripped down model of a game in progress, for when we need to
+ * play out lots of games quickly - the autoplayer's lookahead search
+ * for example. The rules follow Board::update(), but there are no
+ * GameObjects or surfaces involved and time advances one player move
+ * at a time rather than one frame at a time. A SimBoard is cheap to
+ * copy, so searches can work on clones of it.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_SIMULATION_HH
+#define BNB_SIMULATION_HH
+
+#include <vector>
+#include <SDL.h>
+#include "resources.hh"
+#include "cube.hh"
+#include "util.hh"
+
+class Board;
+
+class SimBoard {
+public:
+  enum TILE { EMPTY = 0, BLOCK, WALL, BOMB };
+
+  // The level parameters that drive the simulation
+  struct Params {
+    Params();
+    Uint32 move_delay;
+    Uint32 block_to_wall_delay;
+    Uint32 delay_between_blocks;
+    Uint32 successful_pickup_delay_reduction;
+    Uint32 failed_pickup_delay_reduction;
+    Uint32 bomb_chance;
+    Uint32 bomb_fuse;
+    Uint16 bomb_radius;
+  };
+
+  // An empty board with the player at (x, y) in its initial orientation
+  SimBoard(Uint16 width, Uint16 height, const Params& params, Uint16 x, Uint16 y,
+           Uint32 seed);
+  // A copy of the game currently being played on 'board'
+  SimBoard(Board& board);
+
+  Uint16 width() const { return m_width; }
+  Uint16 height() const { return m_height; }
+  const Params& params() const { return m_params; }
+
+  TILE tile(Uint16 x, Uint16 y) const { return static_cast<TILE>(m_tiles[y * m_width + x] & 3); }
+  // Colour of the block at (x, y), if there is one
+  BLOCK_COLOR color(Uint16 x, Uint16 y) const { return static_cast<BLOCK_COLOR>(m_tiles[y * m_width + x] >> 2); }
+  void setWall(Uint16 x, Uint16 y);
+
+  Uint16 playerX() const { return m_x; }
+  Uint16 playerY() const { return m_y; }
+  Uint8 orientation() const { return m_orientation; }
+
+  // Can the player roll in this direction right now?
+  bool canRoll(cube::ROLL_DIRECTION dir) const;
+  // Roll the player in 'dir' (if possible) and let the time one move
+  // takes pass.
+  void roll(cube::ROLL_DIRECTION dir);
+  // Let the time one move takes pass without moving
+  void wait();
+
+  Uint32 score() const { return m_score; }
+  Uint32 livesLost() const { return m_lives_lost; }
+  Uint32 pickups() const { return m_pickups; }
+  // ms of game time simulated
+  Uint32 time() const { return m_time; }
+
+  util::Random& random() { return m_random; }
+
+private:
+  void step(int dir);
+  void newBlock();
+  void loseLife() { ++m_lives_lost; }
+  void resolveDetonations();
+
+  Uint16 m_width;
+  Uint16 m_height;
+  Params m_params;
+  // per tile: kind in the low two bits, block colour in the next three
+  std::vector<Uint8> m_tiles;
+  // per tile: block timeout or bomb fuse
+  std::vector<Sint32> m_timers;
+  std::vector<Sint32> m_start_timers;
+  std::vector<Uint32> m_detonations;
+  Uint16 m_x;
+  Uint16 m_y;
+  Uint8 m_orientation;
+  Uint32 m_block_time;
+  Uint32 m_blocks;
+  Uint32 m_score;
+  Uint32 m_lives_lost;
+  Uint32 m_pickups;
+  Uint32 m_time;
+  util::Random m_random;
+};
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <cstdio>
+#include <cstdlib>
+#include <SDL.h>
+#include <SDL_thread.h>
+#include "except.hh"
+#include "snapshot.hh"
+
+namespace {
+  void appendVarint(std::vector<Uint8>& buf, Uint32 v)
+  {
+    while (v >= 0x80) {
+      buf.push_back(static_cast<Uint8>(v | 0x80));
+      v >>= 7;
+    }
+    buf.push_back(static_cast<Uint8>(v));
+  }
+
+  Uint32 readVarint(const std::vector<Uint8>& buf, std::vector<Uint8>::size_type& pos)
+  {
+    Uint32 v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+      if (pos >= buf.size())
+        throw Exception("Snapshot data is truncated");
+      const Uint8 b = buf[pos++];
+      v |= static_cast<Uint32>(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        return v;
+    }
+    throw Exception("Snapshot data contains a malformed number");
+  }
+}
+
+void SnapshotWriter::putVarint(Uint32 v)
+{
+  appendVarint(m_data, v);
+}
+
+Uint8 SnapshotReader::getByte()
+{
+  if (m_pos >= m_data.size())
+    throw Exception("Snapshot data is truncated");
+  return m_data[m_pos++];
+}
+
+Uint32 SnapshotReader::getVarint()
+{
+  return readVarint(m_data, m_pos);
+}
+
+SnapshotRing::SnapshotRing(Uint32 capacity, Uint32 keyframe_interval)
+  : m_entries(capacity), m_keyframe_interval(keyframe_interval), m_head(0),
+    m_count(0), m_since_keyframe(0), m_last()
+{
+  if (!capacity || !keyframe_interval)
+    throw Exception("Snapshot ring needs room for at least one snapshot");
+}
+
+void SnapshotRing::push(const std::vector<Uint8>& snapshot)
+{
+  Entry& entry = m_entries[m_head];
+  if (!m_count || m_since_keyframe + 1 >= m_keyframe_interval) {
+    entry.keyframe = true;
+    entry.data.assign(snapshot.begin(), snapshot.end());
+    m_since_keyframe = 0;
+  } else {
+    entry.keyframe = false;
+    encodeDelta(m_last, snapshot, entry.data);
+    ++m_since_keyframe;
+  }
+  m_last.assign(snapshot.begin(), snapshot.end());
+
+  m_head = (m_head + 1) % m_entries.size();
+  if (m_count < m_entries.size())
+    ++m_count;
+}
+
+void SnapshotRing::clear()
+{
+  m_head = 0;
+  m_count = 0;
+  m_since_keyframe = 0;
+  m_last.clear();
+}
+
+Uint32 SnapshotRing::depth() const
+{
+  // Deltas older than the oldest keyframe left in the ring have lost
+  // the snapshot they were made against.
+  if (!m_count)
+    return 0;
+  Uint32 age = m_count - 1;
+  while (age > 0 && !m_entries[slot(age)].keyframe)
+    --age;
+  return age;
+}
+
+bool SnapshotRing::rewind(Uint32 steps, std::vector<Uint8>& out)
+{
+  if (!m_count)
+    return false;
+
+  const Uint32 max_steps = depth();
+  if (steps > max_steps)
+    steps = max_steps;
+
+  // Start at the nearest keyframe at or before the one we want and
+  // replay deltas forward from there.
+  Uint32 age = steps;
+  while (!m_entries[slot(age)].keyframe)
+    ++age;
+  const Uint32 deltas = age - steps;
+  out.assign(m_entries[slot(age)].data.begin(), m_entries[slot(age)].data.end());
+  while (age > steps)
+    applyDelta(out, m_entries[slot(--age)].data);
+
+  m_head = (m_head + m_entries.size() - steps) % m_entries.size();
+  m_count -= steps;
+  m_since_keyframe = deltas;
+  m_last.assign(out.begin(), out.end());
+
+  return true;
+}
+
+void SnapshotRing::encodeDelta(const std::vector<Uint8>& prev, const std::vector<Uint8>& next,
+                               std::vector<Uint8>& delta)
+{
+  // Layout: size of 'next', followed by pairs of (number of unchanged
+  // bytes, number of changed bytes) each followed by the changed
+  // bytes XORed with their previous value. Bytes past the end of
+  // 'prev' count as zero.
+  delta.clear();
+  appendVarint(delta, next.size());
+
+  const std::vector<Uint8>::size_type size = next.size();
+  std::vector<Uint8>::size_type i = 0;
+  while (i < size) {
+    std::vector<Uint8>::size_type start = i;
+    while (i < size && next[i] == (i < prev.size() ? prev[i] : 0))
+      ++i;
+    if (i == size)
+      break;
+    appendVarint(delta, i - start);
+
+    // Changed run. Single unchanged bytes are cheaper to keep in the
+    // run than to start a new pair for.
+    start = i;
+    std::vector<Uint8>::size_type end = i;
+    while (i < size) {
+      if (next[i] != (i < prev.size() ? prev[i] : 0))
+        end = i + 1;
+      else if (i - end >= 1)
+        break;
+      ++i;
+    }
+    appendVarint(delta, end - start);
+    for (i = start; i < end; ++i)
+      delta.push_back(next[i] ^ (i < prev.size() ? prev[i] : 0));
+  }
+}
+
+void SnapshotRing::applyDelta(std::vector<Uint8>& buf, const std::vector<Uint8>& delta)
+{
+  std::vector<Uint8>::size_type pos = 0;
+  const Uint32 size = readVarint(delta, pos);
+  buf.resize(size, 0);
+
+  Uint32 i = 0;
+  while (pos < delta.size()) {
+    i += readVarint(delta, pos);
+    const Uint32 changed = readVarint(delta, pos);
+    if (i + changed > size || pos + changed > delta.size())
+      throw Exception("Snapshot delta is corrupt");
+    for (Uint32 n = 0; n < changed; ++n)
+      buf[i++] ^= delta[pos++];
+  }
+}
+
+bool writeSnapshotFile(const std::string& path, const std::vector<Uint8>& data)
+{
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file)
+      return false;
+    if (!data.empty())
+      file.write(reinterpret_cast<const char*>(&data[0]), data.size());
+    file.flush();
+    if (!file)
+      return false;
+  }
+#if defined(WIN32)
+  // rename() won't replace an existing file on Windows
+  std::remove(path.c_str());
+#endif
+  return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+bool readSnapshotFile(const std::string& path, std::vector<Uint8>& data)
+{
+  std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+  if (!file)
+    return false;
+  data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return !data.empty();
+}
+
+std::string savePath(const std::string& name)
+{
+#if defined(WIN32)
+  const char* dir = getenv("APPDATA");
+#else
+  const char* dir = getenv("HOME");
+#endif
+  if (!dir)
+    dir = ".";
+  return std::string(dir) + "/.blocks-and-bombs-" + name;
+}
+
+AutoSaver::AutoSaver(const std::string& path)
+  : m_path(path), m_pending(), m_has_pending(false), m_quit(false),
+    m_lock(SDL_CreateMutex()), m_wakeup(SDL_CreateCond()), m_thread(0)
+{
+  if (!m_lock || !m_wakeup)
+    throw Exception("Unable to create autosave synchronization primitives: "
+                    + std::string(SDL_GetError()));
+  m_thread = SDL_CreateThread(threadMain, this);
+  if (!m_thread)
+    throw Exception("Unable to start autosave thread: " + std::string(SDL_GetError()));
+}
+
+AutoSaver::~AutoSaver()
+{
+  SDL_LockMutex(m_lock);
+  m_quit = true;
+  SDL_CondSignal(m_wakeup);
+  SDL_UnlockMutex(m_lock);
+  // the thread writes out anything still pending before it exits
+  SDL_WaitThread(m_thread, 0);
+  SDL_DestroyCond(m_wakeup);
+  SDL_DestroyMutex(m_lock);
+}
+
+void AutoSaver::save(std::vector<Uint8>& data)
+{
+  SDL_LockMutex(m_lock);
+  m_pending.swap(data);
+  m_has_pending = true;
+  SDL_CondSignal(m_wakeup);
+  SDL_UnlockMutex(m_lock);
+}
+
+int AutoSaver::threadMain(void* param)
+{
+  AutoSaver* self = static_cast<AutoSaver*>(param);
+  std::vector<Uint8> data;
+  for (;;) {
+    SDL_LockMutex(self->m_lock);
+    while (!self->m_has_pending && !self->m_quit)
+      SDL_CondWait(self->m_wakeup, self->m_lock);
+    if (!self->m_has_pending) {
+      SDL_UnlockMutex(self->m_lock);
+      break;
+    }
+    data.swap(self->m_pending);
+    self->m_has_pending = false;
+    SDL_UnlockMutex(self->m_lock);
+
+    if (!writeSnapshotFile(self->m_path, data))
+      std::cerr << "warning: unable to write autosave to '" << self->m_path << "'" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * Compact binary snapshots of the game state. Used for rewinding,
+ * saving/resuming a game in progress and autosaving.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_SNAPSHOT_HH
+#define BNB_SNAPSHOT_HH
+
+#include <string>
+#include <vector>
+#include <SDL.h>
+#include <SDL_thread.h>
+
+// Bump this whenever the layout of a snapshot changes
+const Uint8 SNAPSHOT_VERSION = 2;
+
+// Appends values to a byte buffer. Numbers are stored as varints
+// (7 bits per byte, high bit set on all but the last byte) so the
+// small values that make up most of the game state take a byte or two.
+class SnapshotWriter {
+public:
+  SnapshotWriter() : m_data() { }
+
+  // Empties the buffer but keeps its memory around for reuse
+  void clear() { m_data.clear(); }
+
+  void putByte(Uint8 b) { m_data.push_back(b); }
+  void putVarint(Uint32 v);
+  // zigzag encoded so small negative numbers stay small too
+  void putSigned(Sint32 v) { putVarint((static_cast<Uint32>(v) << 1) ^ static_cast<Uint32>(v >> 31)); }
+
+  const std::vector<Uint8>& data() const { return m_data; }
+
+private:
+  std::vector<Uint8> m_data;
+};
+
+// Reads back what a SnapshotWriter wrote. Throws an Exception if the
+// data runs out.
+class SnapshotReader {
+public:
+  SnapshotReader(const std::vector<Uint8>& data) : m_data(data), m_pos(0) { }
+
+  Uint8 getByte();
+  Uint32 getVarint();
+  Sint32 getSigned()
+  {
+    const Uint32 v = getVarint();
+    return static_cast<Sint32>(v >> 1) ^ -static_cast<Sint32>(v & 1);
+  }
+  bool atEnd() const { return m_pos == m_data.size(); }
+
+private:
+  SnapshotReader(const SnapshotReader&);
+  SnapshotReader& operator=(const SnapshotReader&);
+  const std::vector<Uint8>& m_data;
+  std::vector<Uint8>::size_type m_pos;
+};
+
+// Ring buffer of the most recent snapshots. Every 'keyframe_interval'
+// snapshots one is stored in full; the ones in between are stored as
+// the run length encoded XOR against the previous snapshot, which is
+// mostly zeros from one tick to the next. Entry buffers are reused as
+// the ring wraps, so once it's full pushing doesn't allocate.
+class SnapshotRing {
+public:
+  SnapshotRing(Uint32 capacity, Uint32 keyframe_interval);
+
+  void push(const std::vector<Uint8>& snapshot);
+  void clear();
+
+  // How many steps back we can currently go
+  Uint32 depth() const;
+
+  // Reconstructs the snapshot from 'steps' pushes ago (clamped to the
+  // oldest one available) into 'out' and throws away everything
+  // newer, so recording continues from there. Returns false if the
+  // ring is empty.
+  bool rewind(Uint32 steps, std::vector<Uint8>& out);
+
+private:
+  struct Entry {
+    Entry() : keyframe(false), data() { }
+    bool keyframe;
+    std::vector<Uint8> data;
+  };
+
+  Uint32 slot(Uint32 age) const { return (m_head + m_entries.size() - 1 - age) % m_entries.size(); }
+  static void encodeDelta(const std::vector<Uint8>& prev, const std::vector<Uint8>& next,
+                          std::vector<Uint8>& delta);
+  static void applyDelta(std::vector<Uint8>& buf, const std::vector<Uint8>& delta);
+
+  std::vector<Entry> m_entries;
+  const Uint32 m_keyframe_interval;
+  Uint32 m_head;
+  Uint32 m_count;
+  Uint32 m_since_keyframe;
+  std::vector<Uint8> m_last;
+};
+
+// Write a snapshot to disk. The data is first written to a temporary
+// file which is then renamed over the real one, so a crash halfway
+// through never leaves a broken save behind.
+bool writeSnapshotFile(const std::string& path, const std::vector<Uint8>& data);
+bool readSnapshotFile(const std::string& path, std::vector<Uint8>& data);
+
+// Where save files named 'name' live
+std::string savePath(const std::string& name);
+
+// Writes snapshots to disk on a background thread so the game never
+// waits for the disk. If a new snapshot is handed over before the
+// previous one got written, only the newest is kept.
+class AutoSaver {
+public:
+  AutoSaver(const std::string& path);
+  ~AutoSaver();
+
+  // Hand over a snapshot to be written. Swaps with 'data', so the
+  // caller gets back a buffer to reuse.
+  void save(std::vector<Uint8>& data);
+
+private:
+  AutoSaver(const AutoSaver&);
+  AutoSaver& operator=(const AutoSaver&);
+  static int threadMain(void* param);
+
+  const std::string m_path;
+  std::vector<Uint8> m_pending;
+  bool m_has_pending;
+  bool m_quit;
+  SDL_mutex* m_lock;
+  SDL_cond* m_wakeup;
+  SDL_Thread* m_thread;
+};
+
+#endif
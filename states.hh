@@ -9,6 +9,7 @@
 #define BNB_STATES_HH
 
 #include <SDL.h>
+#include "dirtyrects.hh"
 
 enum STATE_CHANGE {
   NO_CHANGE = 0,
@@ -16,7 +17,9 @@ enum STATE_CHANGE {
   GOTO_PLAY,
   GOTO_HELP,
   GOTO_HIGHSCORE,
-  GOTO_ABOUT
+  GOTO_ABOUT,
+  // back to the game the menu was brought up over
+  RESUME_PLAY
 };
 
 class State {
@@ -31,9 +34,30 @@ public:
   // called by engine regularly and should update state based on
   // elapsed time since last call (passed in argument.
   virtual STATE_CHANGE update(Uint32 delta_time) = 0;
-  // must draw the current state to 'screen'. Should only redraw dirty
-  // rectangles.
-  virtual void draw(SDL_Surface* screen) = 0;
+  // must draw the current state to 'screen' and add the areas it
+  // changed to 'dirty' - only those get sent to the display. States
+  // that redraw everything just mark the whole screen.
+  virtual void draw(SDL_Surface* screen, DirtyRects& dirty) = 0;
+
+  // Called when another state is put over this one, or this one is
+  // put aside to be used again later. It isn't updated or drawn
+  // until resumed.
+  virtual void suspend() { }
+  // Called whenever this state becomes the one on screen, new or
+  // resumed. Whatever is on screen then belongs to another state, so
+  // the next draw() must cover all of it.
+  virtual void resume() { }
+  // Roughly how much memory the state holds on to, for deciding how
+  // many inactive states to keep around
+  virtual Uint32 memoryUsage() const { return 0; }
+  // How often, in microseconds, the state wants to be updated and
+  // drawn, given the game's usual 'interval'. States with little
+  // going on can ask for less.
+  virtual Uint32 frameInterval(Uint32 interval) const { return interval; }
+
+protected:
+  static Uint32 surfaceBytes(const SDL_Surface* surface)
+  { return surface ? surface->h * surface->pitch : 0; }
 };
 
 #endif
@@ -0,0 +1,95 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <vector>
+#include <list>
+#include <SDL.h>
+#include "except.hh"
+#include "states.hh"
+#include "statestack.hh"
+
+StateStack::StateStack(Uint32 budget)
+  : m_budget(budget), m_stack(), m_cache(), m_cached_bytes(0)
+{
+}
+
+StateStack::~StateStack()
+{
+  // top down, the way they were put there
+  while (!m_stack.empty()) {
+    delete m_stack.back().state;
+    m_stack.pop_back();
+  }
+  for (std::list<Entry>::iterator it = m_cache.begin(); it != m_cache.end(); ++it)
+    delete it->state;
+}
+
+State* StateStack::top() const
+{
+  if (m_stack.empty())
+    throw Exception("No state to run");
+  return m_stack.back().state;
+}
+
+STATE_CHANGE StateStack::topKind() const
+{
+  return m_stack.empty() ? NO_CHANGE : m_stack.back().kind;
+}
+
+bool StateStack::contains(STATE_CHANGE kind) const
+{
+  for (std::vector<Entry>::const_iterator it = m_stack.begin(); it != m_stack.end(); ++it) {
+    if (it->kind == kind)
+      return true;
+  }
+  return false;
+}
+
+void StateStack::push(STATE_CHANGE kind, State* state)
+{
+  if (!m_stack.empty())
+    m_stack.back().state->suspend();
+  Entry entry = { kind, state, 0 };
+  m_stack.push_back(entry);
+  state->resume();
+}
+
+void StateStack::pop(bool keep)
+{
+  if (m_stack.empty())
+    return;
+  Entry entry = m_stack.back();
+  m_stack.pop_back();
+  entry.state->suspend();
+
+  entry.bytes = entry.state->memoryUsage();
+  if (!keep || entry.bytes > m_budget) {
+    delete entry.state;
+  } else {
+    m_cache.push_back(entry);
+    m_cached_bytes += entry.bytes;
+    while (m_cached_bytes > m_budget) {
+      m_cached_bytes -= m_cache.front().bytes;
+      delete m_cache.front().state;
+      m_cache.pop_front();
+    }
+  }
+
+  if (!m_stack.empty())
+    m_stack.back().state->resume();
+}
+
+State* StateStack::takeCached(STATE_CHANGE kind)
+{
+  for (std::list<Entry>::iterator it = m_cache.begin(); it != m_cache.end(); ++it) {
+    if (it->kind == kind) {
+      State* state = it->state;
+      m_cached_bytes -= it->bytes;
+      m_cache.erase(it);
+      return state;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * The states the game is in, the one on top being the one on screen.
+ * States further down are suspended and come back as they were when
+ * the states above them are taken off. States taken off can be kept
+ * in a cache instead of being deleted, so going back to the menu or
+ * the About text costs no loading at all. Cached states are thrown
+ * out, oldest first, once they hold more memory than the budget.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_STATESTACK_HH
+#define BNB_STATESTACK_HH
+
+#include <vector>
+#include <list>
+#include <SDL.h>
+#include "states.hh"
+
+class StateStack {
+public:
+  // 'budget' is in bytes, as reported by State::memoryUsage()
+  StateStack(Uint32 budget);
+  // Deletes every state, stacked or cached
+  ~StateStack();
+
+  bool empty() const { return m_stack.empty(); }
+  State* top() const;
+  // What the top state is, by the change that leads to it
+  STATE_CHANGE topKind() const;
+  bool contains(STATE_CHANGE kind) const;
+
+  // Suspends the top state and puts 'state' over it. Takes ownership.
+  void push(STATE_CHANGE kind, State* state);
+  // Takes the top state off and resumes the one below. The state is
+  // kept in the cache if 'keep' and it fits, else deleted.
+  void pop(bool keep = true);
+
+  // A cached state of 'kind', no longer in the cache, or 0
+  State* takeCached(STATE_CHANGE kind);
+
+  Uint32 cachedBytes() const { return m_cached_bytes; }
+
+private:
+  StateStack(const StateStack&);
+  StateStack& operator=(const StateStack&);
+  struct Entry {
+    STATE_CHANGE kind;
+    State* state;
+    Uint32 bytes;
+  };
+
+  Uint32 m_budget;
+  std::vector<Entry> m_stack;
+  // oldest first
+  std::list<Entry> m_cache;
+  Uint32 m_cached_bytes;
+};
+
+#endif
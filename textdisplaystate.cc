@@ -6,8 +6,10 @@
 #include <SDL.h>
 #include "textdisplaystate.hh"
 #include "resources.hh"
+#include "blit.hh"
 #include <sstream>
 #include <iterator>
+#include <map>
 
 #include <iostream>
 
@@ -16,14 +18,25 @@ TextDisplayState::TextDisplayState(const std::string& text)
     m_background(IMG_LoadDisplayFormat("default-background.png")),
     m_textWriter(new TextWriter("whitrabt.ttf", 20)),
     m_lines(),
-    m_curLine(),
+    m_rendered(),
+    m_curLine(0),
+    m_pageLines(0),
     m_margin(20),
-    m_reachedEnd(true)
+    m_reachedEnd(true),
+    m_redraw(true),
+    m_page(),
+    m_queue()
 {
+  const SDL_Color color = { 50, 250, 50, 0 };
+  m_textWriter->setFontColor(color);
 }
 
 TextDisplayState::~TextDisplayState()
 {
+  for (std::vector<SDL_Surface*>::iterator it = m_rendered.begin(); it != m_rendered.end(); ++it) {
+    if (*it)
+      SDL_FreeSurface(*it);
+  }
   SDL_FreeSurface(m_background);
   delete m_textWriter;
 }
@@ -35,12 +48,16 @@ STATE_CHANGE TextDisplayState::handleKey(const SDL_KeyboardEvent& key)
 
   switch (key.keysym.sym) {
   case SDLK_DOWN:
-    if (!m_reachedEnd)
+    if (!m_reachedEnd) {
       m_curLine++;
+      m_page.invalidate();
+    }
     return NO_CHANGE;
   case SDLK_UP:
-    if (m_curLine != m_lines.begin())
+    if (m_curLine > 0) {
       m_curLine--;
+      m_page.invalidate();
+    }
     return NO_CHANGE;
   default:
     break;
@@ -55,24 +72,49 @@ STATE_CHANGE TextDisplayState::update(Uint32)
   return NO_CHANGE;
 }
 
-void TextDisplayState::draw(SDL_Surface* screen)
+void TextDisplayState::draw(SDL_Surface* screen, DirtyRects& dirty)
 {
-  const SDL_Color color = { 50, 250, 50, 0 };
-  SDL_BlitSurface(m_background, 0, screen, 0);
+  // The page only changes when scrolled; until then what's on screen
+  // is still right.
+  const bool stale = m_page.stale(screen->w, screen->h);
+  if (!stale && !m_redraw)
+    return;
+  m_redraw = false;
+
+  if (stale) {
+    if (m_lines.empty())
+      parseLines(screen->w);
+    buildPage(screen->w, screen->h);
+  }
 
-  if (m_lines.empty())
-    parseLines(screen->w);
+  m_queue.clear();
+  m_page.submit(m_queue);
+  m_queue.execute(screen);
+  dirty.addAll();
+}
 
-  m_reachedEnd = true;
+Uint32 TextDisplayState::memoryUsage() const
+{
+  Uint32 bytes = surfaceBytes(m_background) + m_page.bytes();
+  for (std::vector<SDL_Surface*>::const_iterator it = m_rendered.begin();
+       it != m_rendered.end(); ++it)
+    bytes += surfaceBytes(*it);
+  return bytes;
+}
 
-  Uint16 y = m_margin;
+void TextDisplayState::buildPage(Uint16 width, Uint16 height)
+{
+  SDL_Surface* page = m_page.begin(width, height);
+  blit::blitSurface(m_background, 0, page, 0);
 
-  // Iterate over each line of text and draw it to the screen using
-  // the TextWriter class.
-  for (std::vector<std::string>::const_iterator it = m_curLine;
-       it != m_lines.end(); ++it) {
-    SDL_Rect rect = m_textWriter->sizeText(*it);
-    if ((y += rect.h + m_textWriter->lineSkip()) >= screen->h - m_margin) {
+  // Every line is the height of the font, so only what's on the page
+  // needs rendering.
+  const int line_height = m_textWriter->sizeText(" ").h;
+  m_reachedEnd = true;
+  m_pageLines = 0;
+  Uint16 y = m_margin;
+  for (Uint32 i = m_curLine; i < m_lines.size(); ++i) {
+    if ((y += line_height + m_textWriter->lineSkip()) >= height - m_margin) {
       // If we were to draw one more line of text, we would exceed the
       // screen height. Get out and remember that there is more text
       // to be displayed if the user presses the down key.
@@ -80,34 +122,72 @@ void TextDisplayState::draw(SDL_Surface* screen)
       break;
     }
 
-    rect.y = y;
-    rect.x = m_margin;
-    m_textWriter->setFontColor(color);
-    m_textWriter->render(screen, &rect, *it);
+    SDL_Surface* text = line(i);
+    if (text) {
+      SDL_Rect rect = { static_cast<Sint16>(m_margin), static_cast<Sint16>(y), 0, 0 };
+      blit::blitSurface(text, 0, page, &rect);
+    }
+    ++m_pageLines;
+  }
+  m_page.done();
+
+  // Keep the lines a page either side rendered for scrolling, and
+  // free the rest so long texts don't hold on to every line.
+  const Uint32 keep_from = m_curLine > m_pageLines ? m_curLine - m_pageLines : 0;
+  const Uint32 keep_to = m_curLine + 2 * m_pageLines;
+  for (Uint32 i = 0; i < m_rendered.size(); ++i) {
+    if ((i < keep_from || i >= keep_to) && m_rendered[i]) {
+      SDL_FreeSurface(m_rendered[i]);
+      m_rendered[i] = 0;
+    }
   }
 }
 
+SDL_Surface* TextDisplayState::line(Uint32 index)
+{
+  if (m_lines[index].empty())
+    return 0;
+  if (!m_rendered[index])
+    m_rendered[index] = m_textWriter->render(m_lines[index]);
+  return m_rendered[index];
+}
+
 void TextDisplayState::parseLines(Uint16 width)
 {
   // Split the input text into lines to respect newlines and then
   // build up lines of string not exceeding the width obtained from
-  // the screen.
+  // the screen. Each distinct word is measured once and lines are
+  // measured by adding up their words, rather than measuring every
+  // line again as it grows.
+  std::map<std::string, int> word_widths;
+  const int space = m_textWriter->sizeText(" ").w;
   std::istringstream istream(m_text);
   std::string input;
   while(std::getline(istream, input)) {
     std::istringstream lstream(input, std::istringstream::in);
     std::string line;
+    int line_width = 0;
     std::string word;
     while (lstream >> word) {
-      SDL_Rect rect = m_textWriter->sizeText(line.empty() ? word : line + " " + word);
-      if (rect.w + 2 * m_margin > width) {
+      std::map<std::string, int>::iterator known = word_widths.find(word);
+      if (known == word_widths.end())
+        known = word_widths.insert(std::make_pair(word, m_textWriter->sizeText(word).w)).first;
+      const int word_width = known->second;
+
+      if (!line.empty() && line_width + space + word_width + 2 * m_margin > width) {
         m_lines.push_back(line);
+        line.clear();
+      }
+      if (line.empty()) {
         line = word;
+        line_width = word_width;
       } else {
-        line += line.empty() ? word : " " + word;
+        line += " " + word;
+        line_width += space + word_width;
       }
     }
     m_lines.push_back(line);
   }
-  m_curLine = m_lines.begin();
+  m_rendered.assign(m_lines.size(), 0);
+  m_curLine = 0;
 }
@@ -1,6 +1,9 @@
 /*
  * Class for displaying larger amounts of text. Will automatically
  * wrap the text and react to key up and down for scrolling the text.
+ * The page on screen is composed once into a cache and only drawn
+ * again when it scrolls, from lines that stay rendered while they're
+ * near the page.
  *
  * Copyright © 2011 by Jesper Juhl
  * Licensed under the terms of the GNU General Public License (GPL) version 2.
@@ -13,6 +16,8 @@
 #include <vector>
 #include "states.hh"
 #include "textwriter.hh"
+#include "layercache.hh"
+#include "renderqueue.hh"
 
 class TextDisplayState : public State {
 public:
@@ -20,20 +25,34 @@ public:
   ~TextDisplayState();
   STATE_CHANGE handleKey(const SDL_KeyboardEvent& key);
   STATE_CHANGE update(Uint32 delta_time);
-  void draw(SDL_Surface* screen);
+  void draw(SDL_Surface* screen, DirtyRects& dirty);
+  virtual void resume() { m_redraw = true; }
+  virtual Uint32 memoryUsage() const;
 
 private:
   TextDisplayState(const TextDisplayState&);
   TextDisplayState& operator=(const TextDisplayState&);
   void parseLines(Uint16 width);
+  void buildPage(Uint16 width, Uint16 height);
+  // The rendered line, 0 if it's blank
+  SDL_Surface* line(Uint32 index);
 
   const std::string m_text;
   SDL_Surface* m_background;
   TextWriter* m_textWriter;
   std::vector<std::string> m_lines;
-  std::vector<std::string>::const_iterator m_curLine;
+  // rendered lines, by index into m_lines
+  std::vector<SDL_Surface*> m_rendered;
+  // index of the line at the top of the page
+  Uint32 m_curLine;
+  // lines on the current page
+  Uint32 m_pageLines;
   Uint16 m_margin;
   bool m_reachedEnd;
+  // set when the screen needs the page even if it hasn't changed
+  bool m_redraw;
+  LayerCache m_page;
+  RenderQueue m_queue;
 };
 
 #endif
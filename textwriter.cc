@@ -8,21 +8,22 @@
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include "except.hh"
+#include "blit.hh"
+#include "options.hh"
+#include "fontmanager.hh"
+#include "glyphatlas.hh"
 #include "textwriter.hh"
 #include "config.h"
 
 TextWriter::TextWriter(const std::string& font, int ptsize)
-  : m_fontFile(RESOURCES_DIR"/fonts/" + font), m_mode(BLENDED), m_font(TTF_OpenFont(m_fontFile.c_str(),
-                                                           ptsize)), m_color()
+  : m_fontFile(RESOURCES_DIR"/fonts/" + font), m_mode(BLENDED), m_ptsize(ptsize),
+    m_font(fonts().font(m_fontFile, ptsize)), m_fixed(TTF_FontFaceIsFixedWidth(m_font)),
+    m_color()
 {
-  if (!m_font)
-    throw Exception("Unable to open font '" + m_fontFile + "': "
-                    + std::string(TTF_GetError()));
 }
 
 TextWriter::~TextWriter()
 {
-  TTF_CloseFont(m_font);
 }
 
 TextWriter& TextWriter::setRenderMode(enum RENDER_MODE mode)
@@ -34,12 +35,9 @@ TextWriter& TextWriter::setRenderMode(enum RENDER_MODE mode)
 
 TextWriter& TextWriter::setPointSize(int ptsize)
 {
-  TTF_CloseFont(m_font);
-  m_font = TTF_OpenFont(m_fontFile.c_str(), ptsize);
-  if (!m_font)
-    throw Exception("Unable to re-open font '" + m_fontFile
-                    + "' in order to change point size: "
-                    + std::string(TTF_GetError()));
+  m_font = fonts().font(m_fontFile, ptsize);
+  m_fixed = TTF_FontFaceIsFixedWidth(m_font);
+  m_ptsize = ptsize;
 
   return *this;
 }
@@ -91,13 +89,136 @@ SDL_Surface* TextWriter::render(const std::string& text)
 
 bool TextWriter::render(SDL_Surface* dest, SDL_Rect* dst, const std::string& text)
 {
-  SDL_Surface* text_surf = render(text);
+  if (m_fixed && m_mode == BLENDED && TTF_GetFontStyle(m_font) == TTF_STYLE_NORMAL
+      && GlyphAtlas::covers(text)) {
+    const GlyphAtlas* atlas = fonts().atlas(m_font, m_color);
+    if (atlas) {
+      atlas->render(dest, dst, text);
+      return true;
+    }
+  }
+
+  TextCache& cache = textCache();
+  TextCache::Key key;
+  key.font = m_fontFile;
+  key.ptsize = m_ptsize;
+  key.style = TTF_GetFontStyle(m_font);
+  key.color = (m_color.r << 16) | (m_color.g << 8) | m_color.b;
+  key.mode = m_mode;
+  key.text = text;
+
+  SDL_Surface* text_surf = cache.find(key);
+  if (text_surf)
+    return blit::blitSurface(text_surf, 0, dest, dst) == 0;
 
+  text_surf = render(text);
   if (!text_surf)
     return false;
 
-  int err = SDL_BlitSurface(text_surf, 0, dest, dst);
-  SDL_FreeSurface(text_surf);
+  const int err = blit::blitSurface(text_surf, 0, dest, dst);
+  cache.insert(key, text_surf);
+
+  return err == 0;
+}
+
+bool TextCache::Key::operator<(const Key& other) const
+{
+  // cheapest comparisons first, the font name last as it rarely differs
+  if (ptsize != other.ptsize)
+    return ptsize < other.ptsize;
+  if (color != other.color)
+    return color < other.color;
+  if (style != other.style)
+    return style < other.style;
+  if (mode != other.mode)
+    return mode < other.mode;
+  if (text != other.text)
+    return text < other.text;
+  return font < other.font;
+}
+
+TextCache::Stats::Stats()
+  : hits(0), misses(0), evictions(0)
+{
+}
+
+TextCache::TextCache(Uint32 budget)
+  : m_budget(budget), m_bytes(0), m_lru(), m_entries(), m_stats()
+{
+}
+
+TextCache::~TextCache()
+{
+  clear();
+}
+
+SDL_Surface* TextCache::find(const Key& key)
+{
+  std::map<Key, std::list<Entry>::iterator>::iterator it = m_entries.find(key);
+  if (it == m_entries.end()) {
+    ++m_stats.misses;
+    return 0;
+  }
+  ++m_stats.hits;
+  m_lru.splice(m_lru.begin(), m_lru, it->second);
+  return it->second->surface;
+}
 
-  return !!err;
+bool TextCache::insert(const Key& key, SDL_Surface* surface)
+{
+  const Uint32 bytes = surface->h * surface->pitch;
+  if (bytes > m_budget || m_entries.count(key)) {
+    SDL_FreeSurface(surface);
+    return false;
+  }
+  makeRoom(bytes);
+
+  const Entry entry = { key, surface };
+  m_lru.push_front(entry);
+  m_entries[key] = m_lru.begin();
+  m_bytes += bytes;
+  return true;
+}
+
+void TextCache::clear()
+{
+  for (std::list<Entry>::iterator it = m_lru.begin(); it != m_lru.end(); ++it)
+    SDL_FreeSurface(it->surface);
+  m_lru.clear();
+  m_entries.clear();
+  m_bytes = 0;
+}
+
+void TextCache::setBudget(Uint32 budget)
+{
+  m_budget = budget;
+  makeRoom(0);
+}
+
+void TextCache::makeRoom(Uint32 bytes)
+{
+  while (!m_lru.empty() && m_bytes + bytes > m_budget) {
+    const Entry& victim = m_lru.back();
+    m_bytes -= victim.surface->h * victim.surface->pitch;
+    SDL_FreeSurface(victim.surface);
+    m_entries.erase(victim.key);
+    m_lru.pop_back();
+    ++m_stats.evictions;
+  }
+}
+
+void reportTextCache()
+{
+  const TextCache& cache = textCache();
+  const TextCache::Stats& stats = cache.stats();
+  if (stats.hits + stats.misses)
+    std::cout << "text cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+              << stats.evictions << " evicted, " << cache.entries() << " surfaces in "
+              << cache.bytes() / 1024 << " of " << cache.budget() / 1024 << "KB" << std::endl;
+}
+
+TextCache& textCache()
+{
+  static TextCache cache(options().text_cache_kb * 1024);
+  return cache;
 }
@@ -1,7 +1,8 @@
 /*
  * This class is intended to encapsulate all text writing with TTF
  * fonts for use in the BNBEngine.
- * TTF_Init() must have been called before instantiating this class.
+ * TTF_Init() must have been called before instantiating this class,
+ * and the fonts it uses come from fonts().
  *
  * Copyright © 2011 by Jesper Juhl
  * Licensed under the terms of the GNU General Public License (GPL) version 2.
@@ -11,6 +12,8 @@
 #define BNB_TEXTWRITER_HH
 
 #include <string>
+#include <list>
+#include <map>
 #include <SDL.h>
 #include <SDL_ttf.h>
 
@@ -32,14 +35,9 @@ public:
   // this function.
   TextWriter& setRenderMode(enum RENDER_MODE mode);
 
-  // Set a new point size for the font. Note that this unloads the
-  // current font and reloads it again at a new point size. This means
-  // that it may fail (and you'll get an exception) if the font file
-  // has gone away and in any case it's not fast. If you often need a
-  // font at different point sizes it's often better to create
-  // multiple instances of this class and specify different point
-  // sizes to the constructor, but this function still exists for
-  // those one-off size changes that sometimes creep up.
+  // Set a new point size for the font. The font is shared through
+  // fonts(), so after the first time a size is used this is cheap.
+  // Throws if the font can't be opened at that size.
   TextWriter& setPointSize(int ptsize);
 
   // Sets the colour that text is drawn with. If never called, the
@@ -65,7 +63,10 @@ public:
 
   // write text onto the given destination surface at location
   // indicated by the 'dst' rectangle - returns true on success, false
-  // on errors.
+  // on errors. Plain ASCII text in a fixed width font is drawn from
+  // a glyph atlas once its colour is in steady use. Anything else is
+  // kept in textCache() once rendered, so drawing the same text the
+  // same way again is just a blit.
   bool render(SDL_Surface* dest, SDL_Rect* dst, const std::string& text);
 
 private:
@@ -73,8 +74,73 @@ private:
   TextWriter& operator=(const TextWriter&);
   const std::string m_fontFile;
   RENDER_MODE m_mode;
+  int m_ptsize;
   TTF_Font* m_font;
+  // is m_font fixed width?
+  bool m_fixed;
   SDL_Color m_color;
 };
 
+// Text rendered by TextWriters, least recently used thrown out first
+// once the surfaces take up more than the budget.
+class TextCache {
+public:
+  struct Key {
+    Key() : font(), ptsize(0), style(0), color(0), mode(0), text() { }
+    std::string font;
+    int ptsize;
+    int style;
+    Uint32 color;
+    int mode;
+    std::string text;
+    bool operator<(const Key& other) const;
+  };
+
+  struct Stats {
+    Stats();
+    Uint64 hits;
+    Uint64 misses;
+    Uint64 evictions;
+  };
+
+  TextCache(Uint32 budget);
+  ~TextCache();
+
+  // The cached surface for 'key', or 0
+  SDL_Surface* find(const Key& key);
+  // Takes ownership of 'surface', which is freed right away if it
+  // doesn't fit in the budget at all. Returns false then.
+  bool insert(const Key& key, SDL_Surface* surface);
+  // Frees all surfaces. Must be done before SDL goes away.
+  void clear();
+
+  void setBudget(Uint32 budget);
+  Uint32 budget() const { return m_budget; }
+  Uint32 bytes() const { return m_bytes; }
+  Uint32 entries() const { return m_entries.size(); }
+  const Stats& stats() const { return m_stats; }
+
+private:
+  TextCache(const TextCache&);
+  TextCache& operator=(const TextCache&);
+  struct Entry {
+    Key key;
+    SDL_Surface* surface;
+  };
+  // Evict until 'bytes' more fit
+  void makeRoom(Uint32 bytes);
+
+  Uint32 m_budget;
+  Uint32 m_bytes;
+  // most recently used first
+  std::list<Entry> m_lru;
+  std::map<Key, std::list<Entry>::iterator> m_entries;
+  Stats m_stats;
+};
+
+// The cache all TextWriters share; its budget comes from options()
+TextCache& textCache();
+// Prints how the cache has done, for the benchmarks
+void reportTextCache();
+
 #endif
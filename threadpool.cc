@@ -0,0 +1,117 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <vector>
+#include <string>
+#include <SDL.h>
+#include <SDL_thread.h>
+#include "except.hh"
+#include "util.hh"
+#include "threadpool.hh"
+
+ThreadPool::ThreadPool(unsigned int threads)
+  : m_workers(), m_lock(SDL_CreateMutex()), m_start(SDL_CreateCond()),
+    m_done(SDL_CreateCond()), m_job(0), m_generation(0), m_next(0), m_count(0),
+    m_finished(0), m_failed(false), m_quit(false)
+{
+  if (!m_lock || !m_start || !m_done)
+    throw Exception("Unable to create thread pool synchronization primitives: "
+                    + std::string(SDL_GetError()));
+
+  if (!threads)
+    threads = util::cpuCount();
+  for (unsigned int i = 1; i < threads; ++i) {
+    SDL_Thread* thread = SDL_CreateThread(workerMain, this);
+    if (!thread)
+      break;  // make do with what we got
+    m_workers.push_back(thread);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  SDL_LockMutex(m_lock);
+  m_quit = true;
+  SDL_CondBroadcast(m_start);
+  SDL_UnlockMutex(m_lock);
+  for (std::vector<SDL_Thread*>::iterator it = m_workers.begin();
+       it != m_workers.end(); ++it)
+    SDL_WaitThread(*it, 0);
+  SDL_DestroyCond(m_done);
+  SDL_DestroyCond(m_start);
+  SDL_DestroyMutex(m_lock);
+}
+
+void ThreadPool::run(Job& job, Uint32 count)
+{
+  if (!count)
+    return;
+
+  SDL_LockMutex(m_lock);
+  m_job = &job;
+  m_next = 0;
+  m_count = count;
+  m_finished = 0;
+  m_failed = false;
+  const Uint32 generation = ++m_generation;
+  SDL_CondBroadcast(m_start);
+  SDL_UnlockMutex(m_lock);
+
+  // lend a hand ourselves rather than just sit and wait
+  work(generation);
+
+  SDL_LockMutex(m_lock);
+  while (m_finished != m_count)
+    SDL_CondWait(m_done, m_lock);
+  m_job = 0;
+  const bool failed = m_failed;
+  SDL_UnlockMutex(m_lock);
+
+  if (failed)
+    throw Exception("A job running in the thread pool failed");
+}
+
+void ThreadPool::work(Uint32 generation)
+{
+  SDL_LockMutex(m_lock);
+  while (m_generation == generation && m_next < m_count) {
+    const Uint32 index = m_next++;
+    Job* job = m_job;
+    SDL_UnlockMutex(m_lock);
+
+    bool failed = false;
+    try {
+      job->execute(index);
+    } catch (...) {
+      failed = true;
+    }
+
+    SDL_LockMutex(m_lock);
+    if (failed)
+      m_failed = true;
+    if (++m_finished == m_count)
+      SDL_CondSignal(m_done);
+  }
+  SDL_UnlockMutex(m_lock);
+}
+
+int ThreadPool::workerMain(void* param)
+{
+  ThreadPool* self = static_cast<ThreadPool*>(param);
+  Uint32 seen = 0;
+  for (;;) {
+    SDL_LockMutex(self->m_lock);
+    while (self->m_generation == seen && !self->m_quit)
+      SDL_CondWait(self->m_start, self->m_lock);
+    if (self->m_quit) {
+      SDL_UnlockMutex(self->m_lock);
+      return 0;
+    }
+    seen = self->m_generation;
+    SDL_UnlockMutex(self->m_lock);
+
+    self->work(seen);
+  }
+}
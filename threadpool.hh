@@ -0,0 +1,59 @@
+/*
+ * Fixed set of worker threads for spreading CPU heavy work (search,
+ * simulation, rendering) over all available CPUs.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_THREADPOOL_HH
+#define BNB_THREADPOOL_HH
+
+#include <vector>
+#include <SDL.h>
+#include <SDL_thread.h>
+
+class ThreadPool {
+public:
+  // Work handed to the pool. execute() gets called exactly once for
+  // each index in the range passed to run(), from any of the threads
+  // in the pool, so it must be safe to call concurrently.
+  class Job {
+  public:
+    virtual ~Job() { }
+    virtual void execute(Uint32 index) = 0;
+  };
+
+  // Passing 0 threads means one thread per CPU. The thread calling
+  // run() counts as one of them.
+  ThreadPool(unsigned int threads = 0);
+  ~ThreadPool();
+
+  unsigned int threads() const { return m_workers.size() + 1; }
+
+  // Runs job.execute(0) .. job.execute(count - 1) spread over the
+  // pool and returns once all of them are done. Throws if any of them
+  // threw.
+  void run(Job& job, Uint32 count);
+
+private:
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+  static int workerMain(void* param);
+  // claims and executes indices of the current job until there are none left
+  void work(Uint32 generation);
+
+  std::vector<SDL_Thread*> m_workers;
+  SDL_mutex* m_lock;
+  SDL_cond* m_start;
+  SDL_cond* m_done;
+  Job* m_job;
+  Uint32 m_generation;
+  Uint32 m_next;
+  Uint32 m_count;
+  Uint32 m_finished;
+  bool m_failed;
+  bool m_quit;
+};
+
+#endif
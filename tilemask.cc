@@ -0,0 +1,108 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <SDL.h>
+#include "tilemask.hh"
+
+namespace {
+  // index of the lowest set bit in a non-zero word
+  inline Uint32 lowestBit(Uint32 word)
+  {
+#if defined(__GNUC__)
+    return __builtin_ctz(word);
+#else
+    Uint32 bit = 0;
+    while (!(word & 1)) {
+      word >>= 1;
+      ++bit;
+    }
+    return bit;
+#endif
+  }
+}
+
+TileMask::TileMask(Uint16 width, Uint16 height)
+  : m_width(width), m_height(height),
+    m_bits((static_cast<Uint32>(width) * height + 31) / 32, 0)
+{
+}
+
+void TileMask::clear()
+{
+  std::fill(m_bits.begin(), m_bits.end(), 0);
+}
+
+bool TileMask::any() const
+{
+  for (std::vector<Uint32>::const_iterator it = m_bits.begin();
+       it != m_bits.end(); ++it) {
+    if (*it)
+      return true;
+  }
+  return false;
+}
+
+void TileMask::setRange(Uint32 first, Uint32 last)
+{
+  // sets the bits first..last (both inclusive)
+  const Uint32 first_word = first >> 5;
+  const Uint32 last_word = last >> 5;
+  const Uint32 first_mask = ~0u << (first & 31);
+  const Uint32 last_mask = ~0u >> (31 - (last & 31));
+
+  if (first_word == last_word) {
+    m_bits[first_word] |= first_mask & last_mask;
+    return;
+  }
+  m_bits[first_word] |= first_mask;
+  for (Uint32 w = first_word + 1; w < last_word; ++w)
+    m_bits[w] = ~0u;
+  m_bits[last_word] |= last_mask;
+}
+
+void TileMask::setArea(Uint16 x, Uint16 y, Uint16 radius)
+{
+  const Uint16 x0 = x > radius ? x - radius : 0;
+  const Uint16 y0 = y > radius ? y - radius : 0;
+  const Uint16 x1 = std::min<Uint32>(x + radius, m_width - 1);
+  const Uint16 y1 = std::min<Uint32>(y + radius, m_height - 1);
+
+  for (Uint32 row = y0; row <= y1; ++row)
+    setRange(row * m_width + x0, row * m_width + x1);
+}
+
+bool TileMask::findNext(Uint32& index) const
+{
+  const Uint32 size = static_cast<Uint32>(m_width) * m_height;
+  if (index >= size)
+    return false;
+
+  Uint32 w = index >> 5;
+  Uint32 word = m_bits[w] & (~0u << (index & 31));
+  while (!word) {
+    if (++w == m_bits.size())
+      return false;
+    word = m_bits[w];
+  }
+
+  index = (w << 5) + lowestBit(word);
+  return index < size;
+}
+
+TileMask& TileMask::operator|=(const TileMask& other)
+{
+  for (std::vector<Uint32>::size_type i = 0; i < m_bits.size(); ++i)
+    m_bits[i] |= other.m_bits[i];
+  return *this;
+}
+
+TileMask& TileMask::operator&=(const TileMask& other)
+{
+  for (std::vector<Uint32>::size_type i = 0; i < m_bits.size(); ++i)
+    m_bits[i] &= other.m_bits[i];
+  return *this;
+}
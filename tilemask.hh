@@ -0,0 +1,55 @@
+/*
+ * Compact bitmask with one bit per tile of the game board. Bits are
+ * packed row by row into 32 bit words so that whole board operations
+ * (like resolving bomb chain reactions) can work a word at a time
+ * rather than chasing GameObject pointers.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_TILEMASK_HH
+#define BNB_TILEMASK_HH
+
+#include <vector>
+#include <SDL.h>
+
+class TileMask {
+public:
+  TileMask(Uint16 width, Uint16 height);
+
+  Uint16 width() const { return m_width; }
+  Uint16 height() const { return m_height; }
+
+  void clear();
+  bool any() const;
+
+  void set(Uint16 x, Uint16 y) { setIndex(y * m_width + x); }
+  void reset(Uint16 x, Uint16 y) { resetIndex(y * m_width + x); }
+  bool test(Uint16 x, Uint16 y) const { return testIndex(y * m_width + x); }
+
+  // Same as above, but addressing tiles by their index (y * width + x)
+  void setIndex(Uint32 i) { m_bits[i >> 5] |= 1u << (i & 31); }
+  void resetIndex(Uint32 i) { m_bits[i >> 5] &= ~(1u << (i & 31)); }
+  bool testIndex(Uint32 i) const { return (m_bits[i >> 5] >> (i & 31)) & 1; }
+
+  // Set every tile within 'radius' tiles (horizontally, vertically
+  // and diagonally) of (x, y), clipped to the board.
+  void setArea(Uint16 x, Uint16 y, Uint16 radius);
+
+  // Finds the first set tile index at or after 'index' and stores it
+  // in 'index'. Returns false if there are no more set tiles.
+  bool findNext(Uint32& index) const;
+
+  TileMask& operator|=(const TileMask& other);
+  TileMask& operator&=(const TileMask& other);
+
+private:
+  void setRange(Uint32 first, Uint32 last);
+
+  Uint16 m_width;
+  Uint16 m_height;
+  std::vector<Uint32> m_bits;
+};
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <SDL.h>
+#include "except.hh"
+#include "blit.hh"
+#include "transition.hh"
+
+namespace {
+  const Uint32* row(const SDL_Surface* s, int y)
+  {
+    return reinterpret_cast<const Uint32*>(static_cast<const Uint8*>(s->pixels) + y * s->pitch);
+  }
+
+  Uint32* row(SDL_Surface* s, int y)
+  {
+    return reinterpret_cast<Uint32*>(static_cast<Uint8*>(s->pixels) + y * s->pitch);
+  }
+}
+
+Transition::Transition()
+  : m_from(0), m_kind(FADE), m_start(0), m_started(false), m_active(false), m_weights()
+{
+}
+
+Transition::~Transition()
+{
+  if (m_from)
+    SDL_FreeSurface(m_from);
+}
+
+void Transition::start(const SDL_Surface* outgoing, KIND kind)
+{
+  const SDL_PixelFormat* fmt = outgoing->format;
+  if (fmt->BitsPerPixel != 32)
+    return;
+  if (m_from && (m_from->w != outgoing->w || m_from->h != outgoing->h
+                 || m_from->format->Rmask != fmt->Rmask || m_from->format->Gmask != fmt->Gmask
+                 || m_from->format->Bmask != fmt->Bmask)) {
+    SDL_FreeSurface(m_from);
+    m_from = 0;
+  }
+  if (!m_from) {
+    m_from = SDL_CreateRGBSurface(SDL_SWSURFACE, outgoing->w, outgoing->h, 32,
+                                  fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask);
+    if (!m_from)
+      throw Exception("Unable to create transition surface: " + std::string(SDL_GetError()));
+  }
+  for (int y = 0; y < outgoing->h; ++y)
+    std::memcpy(row(m_from, y), row(outgoing, y), outgoing->w * sizeof(Uint32));
+
+  m_kind = kind;
+  m_started = false;
+  m_active = true;
+}
+
+bool Transition::compose(const SDL_Surface* incoming, SDL_Surface* out, Uint32 now)
+{
+  if (!m_active)
+    return false;
+  if (!m_started) {
+    m_start = now;
+    m_started = true;
+  }
+  const Uint32 elapsed = now - m_start;
+  if (elapsed >= DURATION) {
+    m_active = false;
+    return false;
+  }
+
+  const int w = m_from->w;
+  if (SDL_MUSTLOCK(out) && SDL_LockSurface(out) < 0)
+    throw Exception("Unable to lock surface for transition: " + std::string(SDL_GetError()));
+  if (m_kind == FADE) {
+    const Uint32 weight = elapsed * 256 / DURATION;
+    for (int y = 0; y < m_from->h; ++y)
+      blit::lerpRow(row(m_from, y), row(incoming, y), row(out, y), w, weight);
+  } else {
+    // the edge runs from just off the left side to just off the right
+    const int edge = static_cast<int>((w + WIPE_EDGE) * elapsed / DURATION)
+      - static_cast<int>(WIPE_EDGE);
+    m_weights.resize(w);
+    for (int x = 0; x < w; ++x)
+      m_weights[x] = std::max(0, std::min(256, (edge + static_cast<int>(WIPE_EDGE) - x) * 256
+                                          / static_cast<int>(WIPE_EDGE)));
+    for (int y = 0; y < m_from->h; ++y)
+      blit::lerpRow(row(m_from, y), row(incoming, y), row(out, y), w, &m_weights[0]);
+  }
+  if (SDL_MUSTLOCK(out))
+    SDL_UnlockSurface(out);
+  return true;
+}
@@ -0,0 +1,53 @@
+/*
+ * Animated transition between two states: the last frame of the
+ * outgoing state is kept and blended with the frames the incoming
+ * state draws, either as a cross-fade or as a soft-edged wipe from
+ * left to right.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_TRANSITION_HH
+#define BNB_TRANSITION_HH
+
+#include <vector>
+#include <SDL.h>
+
+class Transition {
+public:
+  enum KIND { FADE, WIPE };
+  // ms from start to finish
+  static const Uint32 DURATION = 300;
+  // width of the blended edge of a wipe
+  static const Uint32 WIPE_EDGE = 96;
+
+  Transition();
+  ~Transition();
+
+  // Keeps a copy of 'outgoing' to transition away from. The clock
+  // starts at the first compose(), so however long the incoming state
+  // takes to load, the whole transition gets shown.
+  void start(const SDL_Surface* outgoing, KIND kind);
+  bool active() const { return m_active; }
+
+  // Draws the transition as it is at 'now', from the outgoing frame to
+  // 'incoming', onto 'out'. Both have the size and format of the
+  // outgoing frame. Once the transition is over this draws nothing
+  // and returns false.
+  bool compose(const SDL_Surface* incoming, SDL_Surface* out, Uint32 now);
+
+private:
+  Transition(const Transition&);
+  Transition& operator=(const Transition&);
+
+  SDL_Surface* m_from;
+  KIND m_kind;
+  Uint32 m_start;
+  bool m_started;
+  bool m_active;
+  // per column weight of the incoming frame during a wipe
+  std::vector<Uint16> m_weights;
+};
+
+#endif
@@ -0,0 +1,299 @@
+/*
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <SDL.h>
+#include "cube.hh"
+#include "util.hh"
+#include "simulation.hh"
+#include "threadpool.hh"
+#include "tuner.hh"
+
+namespace {
+  // Games last until the first life is lost or this much game time
+  // has passed.
+  const Uint32 MAX_GAME_TIME = 180000;
+  // Chunks of games handed out per thread, so the work evens out
+  const Uint32 CHUNKS_PER_THREAD = 8;
+
+  // Plays about like a decent human: goes for the nearest block it can
+  // reach with the right colour on top, by the shortest route, and
+  // sticks to that plan until it's done or no longer works.
+  class ScriptedPlayer {
+  public:
+    ScriptedPlayer(Uint16 width, Uint16 height, Uint32 seed)
+      : m_width(width), m_height(height),
+        m_seen(width * height * cube::ORIENTATIONS, 0),
+        m_parent(width * height * cube::ORIENTATIONS, 0),
+        m_via(width * height * cube::ORIENTATIONS, 0),
+        m_queue(), m_path(), m_stamp(0), m_target(0),
+        m_random(seed)
+    {
+      m_queue.reserve(width * height * cube::ORIENTATIONS);
+      // local copies of the cube tables keep the search loop tight
+      for (Uint8 o = 0; o < cube::ORIENTATIONS; ++o) {
+        m_top[o] = cube::top(o);
+        for (int d = 0; d < 4; ++d)
+          m_roll[o][d] = cube::roll(o, static_cast<cube::ROLL_DIRECTION>(d));
+      }
+    }
+
+    void reset()
+    {
+      m_path.clear();
+    }
+
+    cube::ROLL_DIRECTION move(const SimBoard& board)
+    {
+      const Uint16 tx = m_target % m_width;
+      const Uint16 ty = m_target / m_width;
+      if (m_path.empty() || board.tile(tx, ty) != SimBoard::BLOCK
+          || !board.canRoll(static_cast<cube::ROLL_DIRECTION>(m_path.back())))
+        plan(board);
+
+      if (m_path.empty()) {
+        // nothing to go for; wander
+        const Uint32 r = m_random.next(4);
+        for (Uint32 d = 0; d < 4; ++d) {
+          const cube::ROLL_DIRECTION dir = static_cast<cube::ROLL_DIRECTION>((r + d) & 3);
+          if (board.canRoll(dir))
+            return dir;
+        }
+        return cube::ROLL_UP;
+      }
+      const cube::ROLL_DIRECTION dir = static_cast<cube::ROLL_DIRECTION>(m_path.back());
+      m_path.pop_back();
+      return dir;
+    }
+
+  private:
+    ScriptedPlayer(const ScriptedPlayer&);
+    ScriptedPlayer& operator=(const ScriptedPlayer&);
+
+    // Breadth first over (tile, orientation) to the nearest block we
+    // would pick up on arrival.
+    void plan(const SimBoard& board)
+    {
+      m_path.clear();
+      ++m_stamp;
+      m_queue.clear();
+
+      const Uint32 start = (board.playerY() * m_width + board.playerX())
+        * cube::ORIENTATIONS + board.orientation();
+      m_queue.push_back(start);
+      m_seen[start] = m_stamp;
+
+      for (Uint32 head = 0; head < m_queue.size(); ++head) {
+        const Uint32 state = m_queue[head];
+        const Uint32 tile = state / cube::ORIENTATIONS;
+        const Uint8 o = state % cube::ORIENTATIONS;
+        const Uint16 x = tile % m_width;
+        const Uint16 y = tile / m_width;
+
+        if (state != start && board.tile(x, y) == SimBoard::BLOCK
+            && board.color(x, y) == m_top[o]) {
+          m_target = tile;
+          for (Uint32 s = state; s != start; s = m_parent[s])
+            m_path.push_back(m_via[s]);
+          return;
+        }
+
+        for (int d = 0; d < 4; ++d) {
+          Sint32 nx = x;
+          Sint32 ny = y;
+          switch (d) {
+          case cube::ROLL_UP: --ny; break;
+          case cube::ROLL_DOWN: ++ny; break;
+          case cube::ROLL_LEFT: --nx; break;
+          case cube::ROLL_RIGHT: ++nx; break;
+          }
+          if (nx < 0 || ny < 0 || nx >= m_width || ny >= m_height)
+            continue;
+          const SimBoard::TILE t = board.tile(nx, ny);
+          if (t == SimBoard::WALL || t == SimBoard::BOMB)
+            continue;
+          const Uint32 next = (ny * m_width + nx) * cube::ORIENTATIONS
+            + m_roll[o][d];
+          if (m_seen[next] == m_stamp)
+            continue;
+          m_seen[next] = m_stamp;
+          m_parent[next] = state;
+          m_via[next] = d;
+          m_queue.push_back(next);
+        }
+      }
+    }
+
+    Uint16 m_width;
+    Uint16 m_height;
+    std::vector<Uint32> m_seen;
+    std::vector<Uint32> m_parent;
+    std::vector<Uint8> m_via;
+    std::vector<Uint32> m_queue;
+    // directions still to roll, next one last
+    std::vector<Uint8> m_path;
+    Uint32 m_stamp;
+    Uint32 m_target;
+    Uint8 m_top[cube::ORIENTATIONS];
+    Uint8 m_roll[cube::ORIENTATIONS][4];
+    util::Random m_random;
+  };
+
+  // p-th percentile of 'values', which gets sorted
+  Uint32 percentile(std::vector<Uint32>& values, Uint32 p)
+  {
+    std::sort(values.begin(), values.end());
+    return values[std::min<Uint32>(values.size() * p / 100, values.size() - 1)];
+  }
+}
+
+DifficultyTuner::Result::Result()
+  : params(), survival_p10(0), survival_p50(0), survival_p90(0),
+    score_p10(0), score_p50(0), score_p90(0), survived_percent(0)
+{
+}
+
+DifficultyTuner::Games::Games(DifficultyTuner& tuner, const SimBoard::Params& params,
+                              Uint32 per_chunk)
+  : m_tuner(tuner), m_params(params), m_per_chunk(per_chunk)
+{
+}
+
+void DifficultyTuner::Games::execute(Uint32 index)
+{
+  const Uint32 first = index * m_per_chunk;
+  const Uint32 last = std::min(first + m_per_chunk, m_tuner.m_games);
+  ScriptedPlayer player(16, 16, index * 2654435761u + 1);
+  for (Uint32 game = first; game < last; ++game) {
+    SimBoard board(16, 16, m_params, 14, 14, game * 2246822519u + 1);
+    player.reset();
+    while (!board.livesLost() && board.time() < MAX_GAME_TIME)
+      board.roll(player.move(board));
+    m_tuner.m_survival[game] = board.time();
+    m_tuner.m_scores[game] = board.score();
+  }
+}
+
+DifficultyTuner::DifficultyTuner(ThreadPool& pool, Uint32 games)
+  : m_pool(pool), m_games(games), m_survival(games), m_scores(games)
+{
+}
+
+DifficultyTuner::Result DifficultyTuner::evaluate(const SimBoard::Params& params)
+{
+  const Uint32 chunks = m_pool.threads() * CHUNKS_PER_THREAD;
+  const Uint32 per_chunk = (m_games + chunks - 1) / chunks;
+  Games games(*this, params, per_chunk);
+  m_pool.run(games, (m_games + per_chunk - 1) / per_chunk);
+
+  Result result;
+  result.params = params;
+  Uint32 survived = 0;
+  for (Uint32 i = 0; i < m_games; ++i)
+    survived += m_survival[i] >= MAX_GAME_TIME;
+  result.survived_percent = survived * 100 / m_games;
+  result.survival_p10 = percentile(m_survival, 10);
+  result.survival_p50 = percentile(m_survival, 50);
+  result.survival_p90 = percentile(m_survival, 90);
+  result.score_p10 = percentile(m_scores, 10);
+  result.score_p50 = percentile(m_scores, 50);
+  result.score_p90 = percentile(m_scores, 90);
+  return result;
+}
+
+std::vector<DifficultyTuner::Result>
+DifficultyTuner::sweep(const std::vector<Uint32>& block_to_wall_delays,
+                       const std::vector<Uint32>& delays_between_blocks,
+                       const std::vector<Uint32>& successful_reductions,
+                       const std::vector<Uint32>& failed_reductions)
+{
+  std::vector<Result> results;
+  SimBoard::Params params;
+  for (Uint32 a = 0; a < block_to_wall_delays.size(); ++a) {
+    params.block_to_wall_delay = block_to_wall_delays[a];
+    for (Uint32 b = 0; b < delays_between_blocks.size(); ++b) {
+      params.delay_between_blocks = delays_between_blocks[b];
+      for (Uint32 c = 0; c < successful_reductions.size(); ++c) {
+        params.successful_pickup_delay_reduction = successful_reductions[c];
+        for (Uint32 d = 0; d < failed_reductions.size(); ++d) {
+          params.failed_pickup_delay_reduction = failed_reductions[d];
+          results.push_back(evaluate(params));
+        }
+      }
+    }
+  }
+  return results;
+}
+
+namespace {
+  const Uint32 BLOCK_TO_WALL_DELAYS[] = { 6000, 9000, 12000 };
+  const Uint32 DELAYS_BETWEEN_BLOCKS[] = { 3000, 5500, 11000 };
+  const Uint32 SUCCESSFUL_REDUCTIONS[] = { 10, 50 };
+  const Uint32 FAILED_REDUCTIONS[] = { 60, 200 };
+  // median survival (ms) we'd like for levels 1, 5, 10, ...
+  const Uint32 TARGET_CURVE[] = { 170000, 120000, 90000, 60000, 45000, 30000 };
+
+  template <typename T, size_t N>
+  std::vector<Uint32> values(const T (&array)[N])
+  {
+    return std::vector<Uint32>(array, array + N);
+  }
+
+  void printResult(const DifficultyTuner::Result& r)
+  {
+    std::cout << std::setw(6) << r.params.block_to_wall_delay
+              << std::setw(6) << r.params.delay_between_blocks
+              << std::setw(4) << r.params.successful_pickup_delay_reduction
+              << std::setw(4) << r.params.failed_pickup_delay_reduction
+              << "  survival s " << std::setw(4) << r.survival_p10 / 1000
+              << std::setw(4) << r.survival_p50 / 1000
+              << std::setw(4) << r.survival_p90 / 1000
+              << "  score " << std::setw(7) << r.score_p10
+              << std::setw(7) << r.score_p50
+              << std::setw(7) << r.score_p90
+              << "  full " << std::setw(3) << r.survived_percent << "%" << std::endl;
+  }
+}
+
+int tuneDifficulty(Uint32 games)
+{
+  ThreadPool pool;
+  DifficultyTuner tuner(pool, games);
+  std::cout << games << " games per parameter set on " << pool.threads()
+            << " thread(s)" << std::endl
+            << "b2wall between succ fail  survival p10/50/90  score p10/50/90" << std::endl;
+
+  const uint64_t start = util::timeMicros();
+  const std::vector<DifficultyTuner::Result> results =
+    tuner.sweep(values(BLOCK_TO_WALL_DELAYS), values(DELAYS_BETWEEN_BLOCKS),
+                values(SUCCESSFUL_REDUCTIONS), values(FAILED_REDUCTIONS));
+  for (std::vector<DifficultyTuner::Result>::const_iterator it = results.begin();
+       it != results.end(); ++it)
+    printResult(*it);
+  std::cout << "sweep took " << (util::timeMicros() - start) / 1000000 << "s" << std::endl;
+
+  std::cout << "closest to the target curve:" << std::endl;
+  const Uint32 points = sizeof(TARGET_CURVE) / sizeof(TARGET_CURVE[0]);
+  for (Uint32 i = 0; i < points; ++i) {
+    const DifficultyTuner::Result* best = 0;
+    Uint32 best_error = 0;
+    for (std::vector<DifficultyTuner::Result>::const_iterator it = results.begin();
+         it != results.end(); ++it) {
+      const Uint32 error = it->survival_p50 > TARGET_CURVE[i]
+        ? it->survival_p50 - TARGET_CURVE[i] : TARGET_CURVE[i] - it->survival_p50;
+      if (!best || error < best_error) {
+        best = &*it;
+        best_error = error;
+      }
+    }
+    std::cout << "level " << std::setw(2) << (i ? i * 5 : 1) << " (" << std::setw(3)
+              << TARGET_CURVE[i] / 1000 << "s): ";
+    printResult(*best);
+  }
+  return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * Offline difficulty tuner. Plays thousands of simulated games with a
+ * scripted player for each combination of level parameters, spread
+ * over all CPUs, and reports how long the player survives and what it
+ * scores. A sweep over a grid of parameters then picks the combination
+ * closest to each point of a target difficulty curve.
+ *
+ * Copyright © 2011 by Jesper Juhl
+ * Licensed under the terms of the GNU General Public License (GPL) version 2.
+ */
+
+#ifndef BNB_TUNER_HH
+#define BNB_TUNER_HH
+
+#include <vector>
+#include <SDL.h>
+#include "simulation.hh"
+#include "threadpool.hh"
+
+class DifficultyTuner {
+public:
+  // How the games played with one set of parameters went
+  struct Result {
+    Result();
+    SimBoard::Params params;
+    // game time (ms) until the first life was lost
+    Uint32 survival_p10;
+    Uint32 survival_p50;
+    Uint32 survival_p90;
+    // score at that point
+    Uint32 score_p10;
+    Uint32 score_p50;
+    Uint32 score_p90;
+    // percentage of games that lasted the whole time limit
+    Uint32 survived_percent;
+  };
+
+  DifficultyTuner(ThreadPool& pool, Uint32 games);
+
+  Result evaluate(const SimBoard::Params& params);
+
+  // Evaluates every combination of the given values and returns the
+  // results in the same order as the nested loops (block to wall delay
+  // outermost).
+  std::vector<Result> sweep(const std::vector<Uint32>& block_to_wall_delays,
+                            const std::vector<Uint32>& delays_between_blocks,
+                            const std::vector<Uint32>& successful_reductions,
+                            const std::vector<Uint32>& failed_reductions);
+
+private:
+  DifficultyTuner(const DifficultyTuner&);
+  DifficultyTuner& operator=(const DifficultyTuner&);
+
+  class Games : public ThreadPool::Job {
+  public:
+    Games(DifficultyTuner& tuner, const SimBoard::Params& params, Uint32 per_chunk);
+    void execute(Uint32 index);
+  private:
+    Games(const Games&);
+    Games& operator=(const Games&);
+    DifficultyTuner& m_tuner;
+    const SimBoard::Params& m_params;
+    Uint32 m_per_chunk;
+  };
+
+  ThreadPool& m_pool;
+  Uint32 m_games;
+  std::vector<Uint32> m_survival;
+  std::vector<Uint32> m_scores;
+};
+
+// The --tune tool: sweeps the default parameter grid and prints the
+// results and the best match for each point of the target curve.
+int tuneDifficulty(Uint32 games);
+
+#endif
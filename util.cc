@@ -9,6 +9,16 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdarg.h>
+#if defined(WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
 #include "except.hh"
 #include "util.hh"
 
@@ -68,4 +78,42 @@ namespace util {
     return std::string(&buf[0], required);
   }
 
+  uint64_t timeMicros()
+  {
+#if defined(WIN32)
+    LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return now.QuadPart / freq.QuadPart * 1000000
+      + now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+  }
+
+  unsigned int cpuCount()
+  {
+#if defined(WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+#endif
+  }
+
+  void lowerThreadPriority()
+  {
+#if defined(WIN32)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__linux__)
+    // Linux keeps a nice value per thread, not per process
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+#endif
+  }
+
 }
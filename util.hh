@@ -26,6 +26,39 @@ namespace util {
   // This is the same as fmt2str() except it takes a va_list as input.
   std::string vfmt2str(const char* fmt, va_list vl);
 
+  // Microseconds from some arbitrary fixed point on a monotonic clock
+  // - SDL_GetTicks() only has millisecond resolution which is too
+  // coarse for timing things within a frame.
+  uint64_t timeMicros();
+
+  // Number of CPUs available to us (at least 1)
+  unsigned int cpuCount();
+
+  // Lets the calling thread give way to the rest of the program. Does
+  // nothing where there is no way to do that for a single thread.
+  void lowerThreadPriority();
+
+  // Small and fast pseudo random number generator (xorshift). Its
+  // whole state is a single word, so unlike rand() it can be saved
+  // and restored along with the rest of the game state.
+  class Random {
+  public:
+    Random(uint32_t seed = 1) : m_state(seed ? seed : 0x9e3779b9u) { }
+    uint32_t next()
+    {
+      m_state ^= m_state << 13;
+      m_state ^= m_state >> 17;
+      m_state ^= m_state << 5;
+      return m_state;
+    }
+    // random number in the range [0, n)
+    uint32_t next(uint32_t n) { return next() % n; }
+    uint32_t state() const { return m_state; }
+    void setState(uint32_t state) { m_state = state ? state : 0x9e3779b9u; }
+  private:
+    uint32_t m_state;
+  };
+
   // Simple little garbage collector template. Takes care of deleting
   // the pointer it holds when the object goes out of scope.
   template <class T>
@@ -35,6 +68,8 @@ namespace util {
     ~GC() { delete m_ptr; }
     void forget() { m_ptr = 0; }
   private:
+    GC(const GC&);
+    GC& operator=(const GC&);
     T* m_ptr;
 
   };